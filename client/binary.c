@@ -0,0 +1,274 @@
+/*
+ *	BIRD Client -- Binary Route Records
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/*
+ * Reply lines with binary route records (see nest/rt-binary.c) are decoded
+ * and printed in a readable form, which also allows to check that records
+ * are decoded to the same routes as shown by 'show route all'.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "nest/bird.h"
+#include "nest/rt-binary.h"
+#include "lib/base64.h"
+#include "lib/unaligned.h"
+#include "lib/alloca.h"
+#include "client/client.h"
+
+struct rtb_reader {
+  byte *pos, *end;
+  uint alen;
+  int err;
+};
+
+static const char *rtb_dest_names[] = {
+  "router", "device", "blackhole", "unreachable", "prohibited", "multipath"
+};
+
+static byte *
+rtb_get(struct rtb_reader *r, uint len)
+{
+  byte *pos = r->pos;
+
+  if (r->err || (r->pos + len > r->end))
+  {
+    r->err = 1;
+    return NULL;
+  }
+
+  r->pos += len;
+  return pos;
+}
+
+static uint
+rtb_get_u8(struct rtb_reader *r)
+{
+  byte *pos = rtb_get(r, 1);
+  return pos ? pos[0] : 0;
+}
+
+static uint
+rtb_get_u16(struct rtb_reader *r)
+{
+  byte *pos = rtb_get(r, 2);
+  return pos ? get_u16(pos) : 0;
+}
+
+static u32
+rtb_get_u32(struct rtb_reader *r)
+{
+  byte *pos = rtb_get(r, 4);
+  return pos ? get_u32(pos) : 0;
+}
+
+static char *
+rtb_format_addr(byte *data, uint alen, char *buf)
+{
+  if (!inet_ntop((alen == 16) ? AF_INET6 : AF_INET, data, buf, INET6_ADDRSTRLEN))
+    strcpy(buf, "?");
+  return buf;
+}
+
+static char *
+rtb_get_addr(struct rtb_reader *r, char *buf)
+{
+  byte *pos = rtb_get(r, r->alen);
+  uint i;
+
+  /* Zero address is returned as empty string */
+  for (i = 0; pos && (i < r->alen) && !pos[i]; i++)
+    ;
+
+  if (pos && (i == r->alen))
+    buf[0] = 0;
+  else if (pos)
+    rtb_format_addr(pos, r->alen, buf);
+  else
+    strcpy(buf, "?");
+
+  return buf;
+}
+
+static char *
+rtb_get_str(struct rtb_reader *r, char *buf)
+{
+  uint len = rtb_get_u8(r);
+  byte *pos = rtb_get(r, len);
+
+  if (pos)
+    memcpy(buf, pos, len);
+  else
+    len = 0;
+
+  buf[len] = 0;
+  return buf;
+}
+
+static int
+rtb_print_attr(struct rtb_reader *r)
+{
+  char abuf[INET6_ADDRSTRLEN];
+  uint id = rtb_get_u16(r);
+  uint flags UNUSED = rtb_get_u8(r);
+  uint type = rtb_get_u8(r);
+  uint len = rtb_get_u16(r);
+  byte *data = rtb_get(r, len);
+  int n = 0;
+  uint i;
+
+  if (!data)
+    return 0;
+
+  n += printf("\t%02x.%02x:", id >> 8, id & 0xff);
+
+  switch (type)
+  {
+  case RTB_A_INT:
+    n += printf(" %u", (len == 4) ? get_u32(data) : 0);
+    break;
+
+  case RTB_A_BITFIELD:
+    n += printf(" %08x", (len == 4) ? get_u32(data) : 0);
+    break;
+
+  case RTB_A_ROUTER_ID:
+    if (len == 4)
+      n += printf(" %u.%u.%u.%u", data[0], data[1], data[2], data[3]);
+    break;
+
+  case RTB_A_IP_ADDRESS:
+    if (len == r->alen)
+      n += printf(" %s", rtb_format_addr(data, len, abuf));
+    break;
+
+  case RTB_A_AS_PATH:
+    /* Segments of type, length and 4-byte AS numbers */
+    for (i = 0; i + 2 <= len; i += 2 + 4 * data[i + 1])
+    {
+      uint j, cnt = data[i + 1], set = (data[i] == 1);
+
+      if (i + 2 + 4 * cnt > len)
+	break;
+
+      n += printf("%s", set ? " {" : "");
+      for (j = 0; j < cnt; j++)
+	n += printf(" %u", get_u32(data + i + 2 + 4 * j));
+      n += printf("%s", set ? " }" : "");
+    }
+    break;
+
+  case RTB_A_INT_SET:
+    for (i = 0; i + 4 <= len; i += 4)
+      n += printf(" (%u,%u)", get_u16(data + i), get_u16(data + i + 2));
+    break;
+
+  case RTB_A_EC_SET:
+    for (i = 0; i + 8 <= len; i += 8)
+      n += printf(" (%08x,%08x)", get_u32(data + i), get_u32(data + i + 4));
+    break;
+
+  case RTB_A_LC_SET:
+    for (i = 0; i + 12 <= len; i += 12)
+      n += printf(" (%u,%u,%u)", get_u32(data + i), get_u32(data + i + 4), get_u32(data + i + 8));
+    break;
+
+  default:
+    for (i = 0; i < len; i++)
+      n += printf("%s%02x", i ? ":" : " ", data[i]);
+  }
+
+  n += printf("\n");
+  return n;
+}
+
+/**
+ * rtb_print_record - decode and print a binary route record
+ * @line: Base64 encoded record (content of the reply line)
+ *
+ * Returns the number of printed characters.
+ */
+int
+rtb_print_record(char *line)
+{
+  uint len = strlen(line);
+  byte *buf = alloca(BASE64_DEC_LENGTH(len) + 1);
+  char net[INET6_ADDRSTRLEN], gw[INET6_ADDRSTRLEN], from[INET6_ADDRSTRLEN];
+  char ifname[256], proto[256], tm[32];
+  struct rtb_reader r = {};
+  int dlen, n = 0;
+  uint flags, pxlen, dest, pref, cnt, i;
+  time_t lastmod;
+
+  dlen = base64_decode(buf, line, len);
+  if ((dlen < 4) || (buf[0] != RTB_VERSION) || ((buf[2] != 4) && (buf[2] != 16)) ||
+      (dlen < 4 + buf[2]))
+    return printf("??? <invalid binary record>\n");
+
+  r.pos = buf + 4;
+  r.end = buf + dlen;
+  r.alen = buf[2];
+  flags = buf[1];
+  pxlen = buf[3];
+
+  rtb_format_addr(rtb_get(&r, r.alen), r.alen, net);
+  rtb_get_u8(&r);			/* Source */
+  rtb_get_u8(&r);			/* Scope */
+  rtb_get_u8(&r);			/* Cast */
+  dest = rtb_get_u8(&r);
+  pref = rtb_get_u16(&r);
+  rtb_get_u16(&r);
+  lastmod = rtb_get_u32(&r);
+  rtb_get_addr(&r, gw);
+  rtb_get_addr(&r, from);
+  rtb_get_str(&r, ifname);
+  rtb_get_str(&r, proto);
+
+  if (r.err)
+    return printf("??? <truncated binary record>\n");
+
+  strftime(tm, sizeof(tm), "%Y-%m-%d %H:%M:%S", localtime(&lastmod));
+
+  n += printf("%s/%u ", net, pxlen);
+  if (dest == 0)
+    n += printf("via %s on %s", gw, ifname);
+  else if (dest == 1)
+    n += printf("dev %s", ifname);
+  else
+    n += printf("%s", (dest < ARRAY_SIZE(rtb_dest_names)) ? rtb_dest_names[dest] : "???");
+
+  n += printf(" [%s %s", proto, tm);
+  if (from[0] && strcmp(from, gw))
+    n += printf(" from %s", from);
+  n += printf("]%s (%u)%s%s\n", (flags & RTB_F_PRIMARY) ? " *" : "", pref,
+	      (flags & RTB_F_FILTERED) ? " filtered" : "",
+	      (flags & RTB_F_TRUNCATED) ? " truncated" : "");
+
+  cnt = rtb_get_u16(&r);
+  for (i = 0; (i < cnt) && !r.err; i++)
+  {
+    uint weight;
+
+    rtb_get_addr(&r, gw);
+    weight = rtb_get_u8(&r);
+    rtb_get_str(&r, ifname);
+
+    if (!r.err)
+      n += printf("\tvia %s on %s weight %u\n", gw, ifname, weight + 1);
+  }
+
+  cnt = rtb_get_u16(&r);
+  for (i = 0; (i < cnt) && !r.err; i++)
+    n += rtb_print_attr(&r);
+
+  if (r.err)
+    n += printf("??? <truncated binary record>\n");
+
+  return n;
+}
@@ -33,10 +33,11 @@
 #include "nest/bird.h"
 #include "lib/resource.h"
 #include "lib/string.h"
+#include "nest/rt-binary.h"
 #include "client/client.h"
 #include "sysdep/unix/unix.h"
 
-#define SERVER_READ_BUF_LEN 4096
+#define SERVER_READ_BUF_LEN 16384	/* Enough for lines with binary route records */
 
 static char *opt_list = "s:vrl";
 static int verbose, restricted, once;
@@ -280,7 +281,9 @@ server_got_reply(char *x)
            sscanf(x, "%d", &code) == 1 && code >= 0 && code < 10000 &&
            (x[4] == ' ' || x[4] == '-'))
     {
-      if (code)
+      if ((code == RTB_REPLY_CODE) && !verbose)
+        len = skip_input ? 0 : rtb_print_record(x+5);
+      else if (code)
         PRINTF(len, "%s\n", verbose ? x : x+5);
 
       if (x[4] == ' ')
@@ -31,6 +31,10 @@ void cmd_help(char *cmd, int len);
 int cmd_complete(char *cmd, int len, char *buf, int again);
 char *cmd_expand(char *cmd);
 
+/* binary.c */
+
+int rtb_print_record(char *line);
+
 /* client.c */
 
 void submit_command(char *cmd_raw);
@@ -38,6 +38,12 @@
  * &config structure associated with them and they are lex-ed and parsed by the
  * same functions, only a special fake token is prepended before the command
  * text to make the parser recognize only the rules corresponding to CLI commands.
+ *
+ * The system dependent code may run config_parse() in a separate thread, so
+ * routing is not blocked while a large configuration is parsed. The parser is
+ * not reentrant, therefore @config_parsing is set meanwhile and CLI commands
+ * wait until it is cleared. Code called by the parser must not touch the state
+ * of the main thread, it may use sysdep_main_call() when it needs to.
  */
 
 #include <setjmp.h>
@@ -74,6 +80,7 @@ static timer *config_timer;		/* Timer for scheduled configuration rollback */
 int shutting_down;			/* Shutdown requested, do not accept new config changes */
 int configuring;			/* Reconfiguration is running */
 int undo_available;			/* Undo was not requested from last reconfiguration */
+int config_parsing;			/* Configuration is parsed in background, parser is busy */
 /* Note that both shutting_down and undo_available are related to requests, not processing */
 
 /**
@@ -260,6 +267,8 @@ config_do_commit(struct config *c, int type)
   if (old_config)
     old_config->obstacle_count++;
 
+  filter_same_flush();
+
   DBG("sysdep_commit\n");
   int force_restart = sysdep_commit(c, old_config);
   DBG("global_commit\n");
@@ -25,6 +25,8 @@ struct config {
   list logfiles;			/* Configured log files (sysdep) */
 
   int mrtdump_file;			/* Configured MRTDump file (sysdep, fd in unix) */
+  uint log_buffer_size;			/* Buffer for asynchronous writes of logs and MRT dumps (sysdep) */
+  int log_buffer_drop;			/* Drop messages when the buffer is full, instead of waiting */
   char *syslog_name;			/* Name used for syslog (NULL -> no syslog) */
   struct rtable_config *master_rtc;	/* Configuration of master routing table */
   struct iface_patt *router_id_from;	/* Configured list of router ID iface patterns */
@@ -61,6 +63,7 @@ struct config {
 /* Please don't use these variables in protocols. Use proto_config->global instead. */
 extern struct config *config;		/* Currently active configuration */
 extern struct config *new_config;	/* Configuration being parsed */
+extern int config_parsing;		/* Configuration is parsed in background */
 
 struct config *config_alloc(const byte *name);
 int config_parse(struct config *);
@@ -176,5 +179,6 @@ int cf_parse(void);
 void sysdep_preconfig(struct config *);
 int sysdep_commit(struct config *, struct config *);
 void sysdep_shutdown_done(void);
+void sysdep_main_call(void (*hook)(void *), void *data);
 
 #endif
@@ -236,6 +236,51 @@ val_same(struct f_val v1, struct f_val v2)
   }
 }
 
+/**
+ * val_hash - compute a content hash of a value
+ * @v: value
+ *
+ * Values found same by val_same() have the same hash.
+ */
+u32
+val_hash(struct f_val v)
+{
+  switch (v.type) {
+  case T_ENUM:
+  case T_INT:
+  case T_BOOL:
+  case T_PAIR:
+  case T_QUAD:
+    return f_hash_mix(v.type, v.val.i);
+  case T_IP:
+#ifndef IPV6
+    /* IP->Quad implicit conversion in val_compare() */
+    return f_hash_mix(T_QUAD, ipa_to_u32(v.val.px.ip));
+#else
+    return f_hash_mix(T_IP, ipa_hash32(v.val.px.ip));
+#endif
+  case T_EC:
+    return f_hash_mix(f_hash_mix(T_EC, v.val.ec >> 32), (u32) v.val.ec);
+  case T_LC:
+    return f_hash_mix(f_hash_mix(f_hash_mix(T_LC, v.val.lc.asn), v.val.lc.ldp1), v.val.lc.ldp2);
+  case T_PREFIX:
+    return f_hash_mix(f_hash_mix(T_PREFIX, ipa_hash32(v.val.px.ip)), v.val.px.len);
+  case T_STRING:
+    return f_hash_str(T_STRING, v.val.s);
+  case T_PATH:
+  case T_CLIST:
+  case T_ECLIST:
+  case T_LCLIST:
+    return f_hash_mem(v.type, v.val.ad->data, v.val.ad->length);
+  case T_SET:
+    return f_hash_mix(T_SET, tree_hash(v.val.t));
+  case T_PREFIX_SET:
+    return f_hash_mix(T_PREFIX_SET, trie_hash(v.val.ti));
+  default:
+    return v.type;
+  }
+}
+
 void
 fprefix_get_bounds(struct f_prefix *px, int *l, int *h)
 {
@@ -548,12 +593,13 @@ val_format(struct f_val v, buffer *buf)
   }
 }
 
-static struct rte **f_rte;
-static struct rta *f_old_rta;
-static struct ea_list **f_tmp_attrs;
-static struct linpool *f_pool;
-static struct buffer f_buf;
-static int f_flags;
+/* Constant expressions are also evaluated by the parser, which may run in background */
+static THREAD_LOCAL struct rte **f_rte;
+static THREAD_LOCAL struct rta *f_old_rta;
+static THREAD_LOCAL struct ea_list **f_tmp_attrs;
+static THREAD_LOCAL struct linpool *f_pool;
+static THREAD_LOCAL struct buffer f_buf;
+static THREAD_LOCAL int f_flags;
 
 static inline void f_rte_cow(void)
 {
@@ -584,7 +630,7 @@ f_rta_cow(void)
   (*f_rte)->attrs = rta_do_cow((*f_rte)->attrs, f_pool);
 }
 
-static struct tbf rl_runtime_err = TBF_DEFAULT_LOG_LIMITS;
+static THREAD_LOCAL struct tbf rl_runtime_err = TBF_DEFAULT_LOG_LIMITS;
 
 #define runtime(x) do { \
     if (!(f_flags & FF_SILENT)) \
@@ -1673,6 +1719,104 @@ i_same(struct f_inst *f1, struct f_inst *f2)
   return i_same(f1->next, f2->next);
 }
 
+#undef ARG
+#undef ONEARG
+#undef TWOARGS
+#define ARG(y) h = f_hash_mix(h, i_hash(f->y))
+#define ONEARG ARG(a1.p)
+#define TWOARGS ARG(a1.p); ARG(a2.p)
+#define A2_HASH h = f_hash_mix(h, f->a2.i)
+
+/**
+ * i_hash - compute a content hash of an instruction tree
+ * @f: instruction list
+ *
+ * Instruction trees found same by i_same() have the same hash. Bodies of
+ * called functions are not hashed, only i_same() compares them.
+ */
+u32
+i_hash(struct f_inst *f)
+{
+  u32 h = 0;
+
+  for (; f; f = f->next)
+  {
+    h = f_hash_mix(h, (f->fi_code << 16) | f->aux);
+
+    switch(f->fi_code) {
+    case FI_ADD:
+    case FI_SUBTRACT:
+    case FI_MULTIPLY:
+    case FI_DIVIDE:
+    case FI_OR:
+    case FI_AND:
+    case FI_PAIR_CONSTRUCT:
+    case FI_EC_CONSTRUCT:
+    case FI_NEQ:
+    case FI_EQ:
+    case FI_LT:
+    case FI_LTE: TWOARGS; break;
+
+    case FI_PATHMASK_CONSTRUCT: break;
+
+    case FI_NOT: ONEARG; break;
+    case FI_NOT_MATCH:
+    case FI_MATCH: TWOARGS; break;
+    case FI_DEFINED: ONEARG; break;
+
+    case FI_LC_CONSTRUCT: TWOARGS; h = f_hash_mix(h, i_hash(INST3(f).p)); break;
+
+    case FI_SET:
+      ARG(a2.p);
+      h = f_hash_str(h, ((struct symbol *) f->a1.p)->name);
+      h = f_hash_mix(h, ((struct symbol *) f->a1.p)->class);
+      break;
+
+    case FI_CONSTANT:
+      switch (f->aux) {
+      case T_PREFIX_SET: h = f_hash_mix(h, trie_hash(f->a2.p)); break;
+      case T_SET: h = f_hash_mix(h, tree_hash(f->a2.p)); break;
+      case T_STRING: h = f_hash_str(h, f->a2.p); break;
+      default: A2_HASH;
+      }
+      break;
+
+    case FI_CONSTANT_INDIRECT: h = f_hash_mix(h, val_hash(* (struct f_val *) f->a1.p)); break;
+    case FI_VARIABLE: h = f_hash_str(h, f->a2.p); break;
+    case FI_PRINT: case FI_LENGTH: ONEARG; break;
+    case FI_CONDITION: TWOARGS; break;
+    case FI_NOP: case FI_EMPTY: break;
+    case FI_PRINT_AND_DIE: ONEARG; A2_HASH; break;
+    case FI_PREF_GET:
+    case FI_RTA_GET: A2_HASH; break;
+    case FI_EA_GET: A2_HASH; break;
+    case FI_PREF_SET:
+    case FI_RTA_SET:
+    case FI_EA_SET: ONEARG; A2_HASH; break;
+
+    case FI_RETURN: ONEARG; break;
+    case FI_IP: ONEARG; break;
+    case FI_CALL: ONEARG; break;
+    case FI_CLEAR_LOCAL_VARS: break;
+    case FI_SWITCH: ONEARG; h = f_hash_mix(h, tree_hash(f->a2.p)); break;
+    case FI_IP_MASK: TWOARGS; break;
+    case FI_PATH_PREPEND: TWOARGS; break;
+    case FI_CLIST_ADD_DEL: TWOARGS; break;
+    case FI_AS_PATH_FIRST:
+    case FI_AS_PATH_LAST:
+    case FI_AS_PATH_LAST_NAG: ONEARG; break;
+    case FI_ROA_CHECK:
+      TWOARGS;
+      h = f_hash_str(h, ((struct f_inst_roa_check *) f)->rtc->name);
+      break;
+    default:
+      bug( "Unknown instruction %d in hash (%c)", f->fi_code, f->fi_code & 0xff);
+    }
+  }
+
+  return h;
+}
+
 /**
  * f_run - run a filter for a route
  * @filter: filter to run
@@ -1798,6 +1942,24 @@ f_eval_int(struct f_inst *expr)
   return res.val.i;
 }
 
+/**
+ * filter_hash - get a content hash of a filter
+ * @f: filter (not %FILTER_ACCEPT or %FILTER_REJECT)
+ *
+ * The hash is computed when the filter is parsed, or on the first call.
+ * Filters with different hashes are never same.
+ */
+u32
+filter_hash(struct filter *f)
+{
+  if (!f->hash)
+    f->hash = i_hash(f->root) ?: 1;
+
+  return f->hash;
+}
+
+static u32 filter_same_gen = 1;	/* Validity of filter->same_as */
+
 /**
  * filter_same - compare two filters
  * @new: first filter to be compared
@@ -1807,6 +1969,10 @@ f_eval_int(struct f_inst *expr)
  * Returns 1 in case filters are same, otherwise 0. If there are
  * underlying bugs, it will rather say 0 on same filters than say
  * 1 on different.
+ *
+ * Filters with different content hashes are not compared at all. The
+ * result of a successful comparison is remembered, so a named filter
+ * used by many protocols is compared just once during reconfiguration.
  */
 int
 filter_same(struct filter *new, struct filter *old)
@@ -1816,5 +1982,27 @@ filter_same(struct filter *new, struct filter *old)
   if (old == FILTER_ACCEPT || old == FILTER_REJECT ||
       new == FILTER_ACCEPT || new == FILTER_REJECT)
     return 0;
-  return i_same(new->root, old->root);
+  if (filter_hash(new) != filter_hash(old))
+    return 0;
+  if ((new->same_as == old) && (new->same_gen == filter_same_gen))
+    return 1;
+  if (!i_same(new->root, old->root))
+    return 0;
+
+  new->same_as = old;
+  new->same_gen = filter_same_gen;
+  return 1;
+}
+
+/**
+ * filter_same_flush - forget remembered results of filter_same()
+ *
+ * The remembered filter belongs to an older configuration, which may be freed
+ * and its memory reused by another one. Therefore, results of filter_same()
+ * are valid only during one commit and this function is called before each.
+ */
+void
+filter_same_flush(void)
+{
+  filter_same_gen++;
 }
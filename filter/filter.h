@@ -148,6 +148,9 @@ struct f_static_attr {
 struct filter {
   char *name;
   struct f_inst *root;
+  u32 hash;				/* Content hash, see filter_hash() */
+  struct filter *same_as;		/* Last filter found same by filter_same() */
+  u32 same_gen;				/* Generation of same_as, see filter_same_flush() */
 };
 
 struct f_inst *f_new_inst(enum f_instruction_code fi_code);
@@ -165,12 +168,14 @@ struct f_inst *f_generate_roa_check(struct symbol *sym, struct f_inst *prefix, s
 struct f_tree *build_tree(struct f_tree *);
 struct f_tree *find_tree(struct f_tree *t, struct f_val val);
 int same_tree(struct f_tree *t1, struct f_tree *t2);
+u32 tree_hash(struct f_tree *t);
 void tree_format(struct f_tree *t, buffer *buf);
 
 struct f_trie *f_new_trie(linpool *lp, uint node_size);
 void *trie_add_prefix(struct f_trie *t, ip_addr px, int plen, int l, int h);
 int trie_match_prefix(struct f_trie *t, ip_addr px, int plen);
 int trie_same(struct f_trie *t1, struct f_trie *t2);
+u32 trie_hash(struct f_trie *t);
 void trie_format(struct f_trie *t, buffer *buf);
 
 void fprefix_get_bounds(struct f_prefix *px, int *l, int *h);
@@ -200,11 +205,32 @@ uint f_eval_int(struct f_inst *expr);
 
 char *filter_name(struct filter *filter);
 int filter_same(struct filter *new, struct filter *old);
+void filter_same_flush(void);
+u32 filter_hash(struct filter *f);
 
 int i_same(struct f_inst *f1, struct f_inst *f2);
+u32 i_hash(struct f_inst *f);
 
 int val_compare(struct f_val v1, struct f_val v2);
 int val_same(struct f_val v1, struct f_val v2);
+u32 val_hash(struct f_val v);
+
+/* Content hashes are equal for values and instructions found same by *_same() */
+static inline u32 f_hash_mix(u32 h, u32 v)
+{ h = u32_hash(h ^ v); return h ^ (h >> 16); }
+
+static inline u32 f_hash_mem(u32 h, const void *data, uint len)
+{
+  const byte *b = data;
+  uint i;
+
+  for (i = 0; i < len; i++)
+    h = f_hash_mix(h, b[i]);
+  return h;
+}
+
+static inline u32 f_hash_str(u32 h, const char *s)
+{ return f_hash_mem(h, s, strlen(s)); }
 
 void val_format(struct f_val v, buffer *buf);
 
@@ -138,6 +138,26 @@ same_tree(struct f_tree *t1, struct f_tree *t2)
   return 1;
 }
 
+/**
+ * tree_hash
+ * @t: tree to be hashed
+ *
+ * Computes a content hash of the tree, same trees have the same hash
+ */
+u32
+tree_hash(struct f_tree *t)
+{
+  u32 h;
+
+  if (!t)
+    return 0;
+
+  h = f_hash_mix(val_hash(t->from), val_hash(t->to));
+  h = f_hash_mix(h, tree_hash(t->left));
+  h = f_hash_mix(h, tree_hash(t->right));
+  return f_hash_mix(h, i_hash(t->data));
+}
+
 
 static void
 tree_node_format(struct f_tree *t, buffer *buf)
@@ -271,6 +271,32 @@ trie_same(struct f_trie *t1, struct f_trie *t2)
   return (t1->zero == t2->zero) && trie_node_same(t1->root, t2->root);
 }
 
+static u32
+trie_node_hash(struct f_trie_node *t)
+{
+  u32 h;
+
+  if (t == NULL)
+    return 0;
+
+  h = f_hash_mix(ipa_hash32(t->addr), t->plen);
+  h = f_hash_mix(h, ipa_hash32(t->accept));
+  h = f_hash_mix(h, trie_node_hash(t->c[0]));
+  return f_hash_mix(h, trie_node_hash(t->c[1]));
+}
+
+/**
+ * trie_hash
+ * @t: trie to be hashed
+ *
+ * Computes a content hash of the trie, same tries have the same hash
+ */
+u32
+trie_hash(struct f_trie *t)
+{
+  return f_hash_mix(t->zero, trie_node_hash(t->root));
+}
+
 static void
 trie_node_format(struct f_trie_node *t, buffer *buf)
 {
@@ -0,0 +1,112 @@
+/*
+ *	BIRD Library -- Base64 Encoding
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include "nest/bird.h"
+#include "lib/base64.h"
+
+static const char base64_chars[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * base64_encode - encode binary data to Base64
+ * @dst: destination buffer, at least BASE64_ENC_LENGTH(@len) bytes long
+ * @src: data to be encoded
+ * @len: length of @src
+ *
+ * This function encodes @src by Base64 (RFC 4648), with padding. The result
+ * is not zero-terminated. Returns the length of the result.
+ */
+uint
+base64_encode(byte *dst, const byte *src, uint len)
+{
+  byte *pos = dst;
+  u32 v;
+
+  for (; len >= 3; src += 3, len -= 3)
+  {
+    v = (src[0] << 16) | (src[1] << 8) | src[2];
+    *pos++ = base64_chars[(v >> 18) & 0x3f];
+    *pos++ = base64_chars[(v >> 12) & 0x3f];
+    *pos++ = base64_chars[(v >> 6) & 0x3f];
+    *pos++ = base64_chars[v & 0x3f];
+  }
+
+  if (len)
+  {
+    v = (src[0] << 16) | ((len > 1) ? (src[1] << 8) : 0);
+    *pos++ = base64_chars[(v >> 18) & 0x3f];
+    *pos++ = base64_chars[(v >> 12) & 0x3f];
+    *pos++ = (len > 1) ? base64_chars[(v >> 6) & 0x3f] : '=';
+    *pos++ = '=';
+  }
+
+  return pos - dst;
+}
+
+static inline int
+base64_value(byte c)
+{
+  if ((c >= 'A') && (c <= 'Z'))
+    return c - 'A';
+  if ((c >= 'a') && (c <= 'z'))
+    return c - 'a' + 26;
+  if ((c >= '0') && (c <= '9'))
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
+}
+
+/**
+ * base64_decode - decode Base64 data
+ * @dst: destination buffer, at least BASE64_DEC_LENGTH(@len) bytes long
+ * @src: Base64 encoded data, with padding
+ * @len: length of @src
+ *
+ * Returns the length of decoded data, or -1 if @src is not valid Base64.
+ */
+int
+base64_decode(byte *dst, const byte *src, uint len)
+{
+  byte *pos = dst;
+  int a, b, c, d;
+
+  if (len % 4)
+    return -1;
+
+  for (; len; src += 4, len -= 4)
+  {
+    a = base64_value(src[0]);
+    b = base64_value(src[1]);
+    if ((a < 0) || (b < 0))
+      return -1;
+
+    *pos++ = (a << 2) | (b >> 4);
+
+    /* Padding is allowed only in the last quantum */
+    if ((len == 4) && (src[2] == '='))
+      return (src[3] == '=') ? (pos - dst) : -1;
+
+    c = base64_value(src[2]);
+    if (c < 0)
+      return -1;
+
+    *pos++ = (b << 4) | (c >> 2);
+
+    if ((len == 4) && (src[3] == '='))
+      break;
+
+    d = base64_value(src[3]);
+    if (d < 0)
+      return -1;
+
+    *pos++ = (c << 6) | d;
+  }
+
+  return pos - dst;
+}
@@ -0,0 +1,17 @@
+/*
+ *	BIRD Library -- Base64 Encoding
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_BASE64_H_
+#define _BIRD_BASE64_H_
+
+/* Length of encoded data (without padding removal) and max length of decoded data */
+#define BASE64_ENC_LENGTH(x)	(4 * (((x) + 2) / 3))
+#define BASE64_DEC_LENGTH(x)	(3 * ((x) / 4))
+
+uint base64_encode(byte *dst, const byte *src, uint len);
+int base64_decode(byte *dst, const byte *src, uint len);
+
+#endif
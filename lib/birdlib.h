@@ -9,6 +9,25 @@
 #ifndef _BIRD_BIRDLIB_H_
 #define _BIRD_BIRDLIB_H_
 
+/* Microsecond time */
+
+typedef s64 btime;
+
+#define BTIME_INFINITY	((btime) 0x7fffffffffffffffLL)
+
+#define S_	*1000000
+#define MS_	*1000
+#define US_	*1
+#define TO_S	/1000000
+#define TO_MS	/1000
+#define TO_US	/1
+
+#ifndef PARSER
+#define S	S_
+#define MS	MS_
+#define US	US_
+#endif
+
 #include "timer.h"
 #include "alloca.h"
 
@@ -68,6 +87,12 @@ struct align_probe { char x; long int y; };
 #define UNUSED __attribute__((unused))
 #define PACKED __attribute__((packed))
 
+#ifdef USE_PTHREADS
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
 #ifdef IPV6
 #define UNUSED4
 #define UNUSED6 UNUSED
@@ -76,24 +101,6 @@ struct align_probe { char x; long int y; };
 #define UNUSED6
 #endif
 
-/* Microsecond time */
-
-typedef s64 btime;
-
-#define S_	*1000000
-#define MS_	*1000
-#define US_	*1
-#define TO_S	/1000000
-#define TO_MS	/1000
-#define TO_US	/1
-
-#ifndef PARSER
-#define S	S_
-#define MS	MS_
-#define US	US_
-#endif
-
-
 /* Rate limiting */
 
 struct tbf {
@@ -38,8 +38,15 @@ struct linpool {
   struct lp_chunk *first, *current, **plast;	/* Normal (reusable) chunks */
   struct lp_chunk *first_large;			/* Large chunks */
   uint chunk_size, threshold, total, total_large;
+  uint num_chunks, num_large;
 };
 
+/* Normal chunks of this size are allocated as pages */
+#define LP_PAGE_DATA (MEM_PAGE_SIZE - sizeof(struct lp_chunk))
+
+static inline int lp_uses_pages(linpool *m)
+{ return m->chunk_size == LP_PAGE_DATA; }
+
 static void lp_free(resource *);
 static void lp_dump(resource *);
 static resource *lp_lookup(resource *, unsigned long);
@@ -61,13 +68,16 @@ static struct resclass lp_class = {
  *
  * lp_new() creates a new linear memory pool resource inside the pool @p.
  * The linear pool consists of a list of memory chunks of size at least
- * @blk.
+ * @blk. Chunk sizes close to the page size are rounded up to fill
+ * the whole page, such chunks are allocated from the page allocator.
  */
 linpool
 *lp_new(pool *p, uint blk)
 {
   linpool *m = ralloc(p, &lp_class);
   m->plast = &m->first;
+  if ((blk > LP_PAGE_DATA / 2) && (blk <= LP_PAGE_DATA))
+    blk = LP_PAGE_DATA;
   m->chunk_size = blk;
   m->threshold = 3*blk/4;
   return m;
@@ -106,6 +116,7 @@ lp_alloc(linpool *m, uint size)
 	  /* Too large => allocate large chunk */
 	  c = xmalloc(sizeof(struct lp_chunk) + size);
 	  m->total_large += size;
+	  m->num_large++;
 	  c->next = m->first_large;
 	  m->first_large = c;
 	  c->size = size;
@@ -121,8 +132,9 @@ lp_alloc(linpool *m, uint size)
 	  else
 	    {
 	      /* Need to allocate a new chunk */
-	      c = xmalloc(sizeof(struct lp_chunk) + m->chunk_size);
+	      c = lp_uses_pages(m) ? alloc_page() : xmalloc(sizeof(struct lp_chunk) + m->chunk_size);
 	      m->total += m->chunk_size;
+	      m->num_chunks++;
 	      *m->plast = c;
 	      m->plast = &c->next;
 	      c->next = NULL;
@@ -197,6 +209,7 @@ lp_flush(linpool *m)
       xfree(c);
     }
   m->total_large = 0;
+  m->num_large = 0;
 }
 
 static void
@@ -208,7 +221,10 @@ lp_free(resource *r)
   for(d=m->first; d; d = c)
     {
       c = d->next;
-      xfree(d);
+      if (lp_uses_pages(m))
+	free_page(d);
+      else
+	xfree(d);
     }
   for(d=m->first_large; d; d = c)
     {
@@ -241,16 +257,11 @@ static size_t
 lp_memsize(resource *r)
 {
   linpool *m = (linpool *) r;
-  struct lp_chunk *c;
-  int cnt = 0;
-
-  for(c=m->first; c; c=c->next)
-    cnt++;
-  for(c=m->first_large; c; c=c->next)
-    cnt++;
+  uint overhead = lp_uses_pages(m) ? 0 : ALLOC_OVERHEAD;
 
   return ALLOC_OVERHEAD + sizeof(struct linpool) +
-    cnt * (ALLOC_OVERHEAD + sizeof(struct lp_chunk)) +
+    m->num_chunks * (overhead + sizeof(struct lp_chunk)) +
+    m->num_large * (ALLOC_OVERHEAD + sizeof(struct lp_chunk)) +
     m->total + m->total_large;
 }
 
@@ -80,6 +80,17 @@ void sl_free(slab *, void *);
 
 void buffer_realloc(void **buf, unsigned *size, unsigned need, unsigned item_size);
 
+/* Pages, used by slabs and linpools */
+
+#define MEM_PAGE_SIZE		4096
+
+void page_init(void);
+void *alloc_page(void);
+void free_page(void *);
+size_t page_cache_size(void);
+size_t page_released_size(void);
+size_t page_arena_size(void);
+
 
 #ifdef HAVE_LIBDMALLOC
 /*
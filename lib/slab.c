@@ -139,12 +139,12 @@ slab_memsize(resource *r)
  *  Real efficient version.
  */
 
-#define SLAB_SIZE 4096
+#define SLAB_SIZE MEM_PAGE_SIZE
 #define MAX_EMPTY_HEADS 1
 
 struct slab {
   resource r;
-  uint obj_size, head_size, objs_per_slab, num_empty_heads, data_size;
+  uint obj_size, head_size, objs_per_slab, num_empty_heads, num_heads, data_size;
   list empty_heads, partial_heads, full_heads;
 };
 
@@ -163,14 +163,19 @@ struct sl_head {
   int num_full;
 };
 
+/*
+ * Slab heads are page-aligned pages, so the head of an object is found just
+ * by masking its address and objects need no back pointer to their head.
+ */
 struct sl_obj {
-  struct sl_head *slab;
   union {
     struct sl_obj *next;
     byte data[0];
   } u;
 };
 
+#define SL_GET_HEAD(o) ((struct sl_head *) (((uintptr_t) (o)) & ~((uintptr_t) SLAB_SIZE - 1)))
+
 struct sl_alignment {			/* Magic structure for testing of alignment */
   byte data;
   int x[0];
@@ -202,6 +207,7 @@ sl_new(pool *p, uint size)
   if (!s->objs_per_slab)
     bug("Slab: object too large");
   s->num_empty_heads = 0;
+  s->num_heads = 0;
   init_list(&s->empty_heads);
   init_list(&s->partial_heads);
   init_list(&s->full_heads);
@@ -211,16 +217,16 @@ sl_new(pool *p, uint size)
 static struct sl_head *
 sl_new_head(slab *s)
 {
-  struct sl_head *h = xmalloc(SLAB_SIZE);
+  struct sl_head *h = alloc_page();
   struct sl_obj *o = (struct sl_obj *)((byte *)h+s->head_size);
   struct sl_obj *no;
   uint n = s->objs_per_slab;
 
   h->first_free = o;
   h->num_full = 0;
+  s->num_heads++;
   while (n--)
     {
-      o->slab = h;
       no = (struct sl_obj *)((char *) o+s->obj_size);
       o->u.next = n ? no : NULL;
       o = no;
@@ -287,7 +293,7 @@ void
 sl_free(slab *s, void *oo)
 {
   struct sl_obj *o = SKIP_BACK(struct sl_obj, u.data, oo);
-  struct sl_head *h = o->slab;
+  struct sl_head *h = SL_GET_HEAD(o);
 
 #ifdef POISON
   memset(oo, 0xdb, s->data_size);
@@ -298,7 +304,10 @@ sl_free(slab *s, void *oo)
     {
       rem_node(&h->n);
       if (s->num_empty_heads >= MAX_EMPTY_HEADS)
-	xfree(h);
+	{
+	  free_page(h);
+	  s->num_heads--;
+	}
       else
 	{
 	  add_head(&s->empty_heads, &h->n);
@@ -319,11 +328,11 @@ slab_free(resource *r)
   struct sl_head *h, *g;
 
   WALK_LIST_DELSAFE(h, g, s->empty_heads)
-    xfree(h);
+    free_page(h);
   WALK_LIST_DELSAFE(h, g, s->partial_heads)
-    xfree(h);
+    free_page(h);
   WALK_LIST_DELSAFE(h, g, s->full_heads)
-    xfree(h);
+    free_page(h);
 }
 
 static void
@@ -346,17 +355,8 @@ static size_t
 slab_memsize(resource *r)
 {
   slab *s = (slab *) r;
-  size_t heads = 0;
-  struct sl_head *h;
-
-  WALK_LIST(h, s->empty_heads)
-    heads++;
-  WALK_LIST(h, s->partial_heads)
-    heads++;
-  WALK_LIST(h, s->full_heads)
-    heads++;
 
-  return ALLOC_OVERHEAD + sizeof(struct slab) + heads * (ALLOC_OVERHEAD + SLAB_SIZE);
+  return ALLOC_OVERHEAD + sizeof(struct slab) + (size_t) s->num_heads * SLAB_SIZE;
 }
 
 static resource *
@@ -366,10 +366,10 @@ slab_lookup(resource *r, unsigned long a)
   struct sl_head *h;
 
   WALK_LIST(h, s->partial_heads)
-    if ((unsigned long) h < a && (unsigned long) h + SLAB_SIZE < a)
+    if ((unsigned long) h <= a && (unsigned long) h + SLAB_SIZE > a)
       return r;
   WALK_LIST(h, s->full_heads)
-    if ((unsigned long) h < a && (unsigned long) h + SLAB_SIZE < a)
+    if ((unsigned long) h <= a && (unsigned long) h + SLAB_SIZE > a)
       return r;
   return NULL;
 }
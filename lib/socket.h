@@ -52,6 +52,8 @@ typedef struct birdsock {
   int rcv_ttl;				/* TTL of last received datagram */
   node n;
   void *rbuf_alloc, *tbuf_alloc;
+  struct sk_rx_batch *rx_batch;		/* Internal, for SKF_BATCH_RX */
+  struct sk_tx_batch *tx_batch;		/* Internal, for SKF_BATCH_TX */
   char *password;			/* Password for MD5 authentication */
   char *err;				/* Error message */
 } sock;
@@ -63,6 +65,7 @@ int sk_open(sock *);			/* Open socket */
 int sk_rx_ready(sock *s);
 int sk_send(sock *, uint len);		/* Send data, <0=err, >0=ok, 0=sleep */
 int sk_send_to(sock *, uint len, ip_addr to, uint port); /* sk_send to given destination */
+int sk_flush(sock *);			/* Send datagrams queued by SKF_BATCH_TX */
 void sk_reallocate(sock *);		/* Free and allocate tbuf & rbuf */
 void sk_set_rbsize(sock *s, uint val);	/* Resize RX buffer */
 void sk_set_tbsize(sock *s, uint val);	/* Resize TX buffer, keeping content */
@@ -106,6 +109,8 @@ extern int sk_priority_control;		/* Suggested priority for control traffic, shou
 #define SKF_TTL_RX	0x08	/* Report TTL / Hop Limit for RX packets */
 #define SKF_BIND	0x10	/* Bind datagram socket to given source address */
 #define SKF_HIGH_PORT	0x20	/* Choose port from high range if possible */
+#define SKF_BATCH_RX	0x40	/* Receive datagrams in batches, see below */
+#define SKF_BATCH_TX	0x80	/* Queue sent datagrams and send them in batches */
 
 #define SKF_THREAD	0x100	/* Socked used in thread, Do not add to main loop */
 #define SKF_TRUNCATED	0x200	/* Received packet was truncated, set by IO layer */
@@ -144,6 +149,17 @@ extern int sk_priority_control;		/* Suggested priority for control traffic, shou
  *  dependent options (but these are not available in some corner
  *  cases). The first way is used when SKF_BIND is specified, the
  *  second way is used otherwise.
+ *
+ *  For datagram sockets, SKF_BATCH_RX allows the IO layer to receive
+ *  several datagrams by one syscall (where supported). The rx_hook is still
+ *  called once per datagram, with per-datagram faddr, laddr, lifindex and
+ *  rcv_ttl, but rbuf points to the current datagram only during the hook.
+ *  The hook must not free the socket if it is used in a thread (SKF_THREAD).
+ *
+ *  With SKF_BATCH_TX, sk_send() and sk_send_to() just queue the datagram
+ *  (together with its destination) and return success, the queue is sent
+ *  by one syscall when full, when sk_flush() is called or at the latest
+ *  before the event loop goes to sleep.
  */
 
 #endif
@@ -60,7 +60,19 @@
  * the new one. When the consumer processes everything in the buffer
  * queue, it calls cli_written(), tha frees all buffers (except the
  * first one) and schedules cli.event .
- * 
+ *
+ * Continuation routines producing long outputs (e.g. rt_show_cont())
+ * may use cli_batch_size() to choose how much output they should produce
+ * in one call. The batch grows while the consumer manages to write all
+ * output immediately and shrinks when it has to wait for the socket, so
+ * fast clients get large batches with few rounds through the main loop,
+ * while slow clients do not make BIRD buffer too much output.
+ *
+ * Command handlers which finish asynchronously (e.g. reconfiguration, when
+ * the configuration is parsed in background) call cli_suspend() and later
+ * cli_resume() when the reply is complete. No other command is read from the
+ * session meanwhile. While a configuration is parsed in background, all
+ * sessions wait with their commands for the parser (see @config_parsing).
  */
 
 #include "nest/bird.h"
@@ -70,8 +82,8 @@
 
 pool *cli_pool;
 
-static byte *
-cli_alloc_out(cli *c, int size)
+static struct cli_out *
+cli_reserve_out(cli *c, int size)
 {
   struct cli_out *o;
 
@@ -81,19 +93,28 @@ cli_alloc_out(cli *c, int size)
 	o = c->tx_buf;
       else
 	{
-	  o = mb_alloc(c->pool, sizeof(struct cli_out) + CLI_TX_BUF_SIZE);
+	  uint bsize = MAX(size, CLI_TX_BUF_SIZE);
+	  o = mb_alloc(c->pool, sizeof(struct cli_out) + bsize);
 	  if (c->tx_write)
 	    c->tx_write->next = o;
 	  else
 	    c->tx_buf = o;
 	  o->wpos = o->outpos = o->buf;
-	  o->end = o->buf + CLI_TX_BUF_SIZE;
+	  o->end = o->buf + bsize;
 	}
       c->tx_write = o;
       if (!c->tx_pos)
 	c->tx_pos = o;
       o->next = NULL;
     }
+  return o;
+}
+
+static byte *
+cli_alloc_out(cli *c, int size)
+{
+  struct cli_out *o = cli_reserve_out(c, size);
+
   o->wpos += size;
   return o->wpos - size;
 }
@@ -108,8 +129,9 @@ cli_alloc_out(cli *c, int size)
  * In works in all aspects like bsprintf() except that it automatically
  * prepends the reply line prefix.
  *
- * Please note that if the connection can be already busy sending some
- * data in which case cli_printf() stores the output to a temporary buffer,
+ * The line is formatted directly to the TX buffer, there is no temporary
+ * copy. Please note that if the connection can be already busy sending some
+ * data in which case cli_printf() just appends the output to the TX buffers,
  * so please avoid sending a large batch of replies without waiting
  * for the buffers to be flushed.
  *
@@ -120,7 +142,8 @@ void
 cli_printf(cli *c, int code, char *msg, ...)
 {
   va_list args;
-  byte buf[CLI_LINE_SIZE];
+  struct cli_out *o = cli_reserve_out(c, CLI_LINE_SIZE);
+  byte *buf = o->wpos;
   int cd = code;
   int errcode;
   int size, cnt;
@@ -147,7 +170,7 @@ cli_printf(cli *c, int code, char *msg, ...)
 
   c->last_reply = cd;
   va_start(args, msg);
-  cnt = bvsnprintf(buf+size, sizeof(buf)-size-1, msg, args);
+  cnt = bvsnprintf(buf+size, CLI_LINE_SIZE-size-1, msg, args);
   va_end(args);
   if (cnt < 0)
     {
@@ -156,7 +179,33 @@ cli_printf(cli *c, int code, char *msg, ...)
     }
   size += cnt;
   buf[size++] = '\n';
-  memcpy(cli_alloc_out(c, size), buf, size);
+  o->wpos += size;
+}
+
+/**
+ * cli_alloc_line - allocate a reply line of given length
+ * @c: CLI connection
+ * @code: numeric code of the reply, negative for continuation lines
+ * @len: length of the line content
+ *
+ * This function allocates space for a reply line in the TX buffer, writes
+ * the reply code prefix and the terminating newline and returns a pointer
+ * to @len bytes of the line content, which are to be filled by the caller.
+ * Unlike cli_printf(), the line is not limited by %CLI_LINE_SIZE and the
+ * prefix is always written in full, even for continuation lines with the
+ * same code, so the lines may be easily recognized by the client.
+ */
+byte *
+cli_alloc_line(cli *c, int code, uint len)
+{
+  byte *buf = cli_alloc_out(c, len + 6);
+  int cd = (code < 0) ? -code : code;
+
+  bsprintf(buf, "%04d%c", cd, (code < 0) ? '-' : ' ');
+  buf[len + 5] = '\n';
+  c->last_reply = cd;
+
+  return buf + 5;
 }
 
 static void
@@ -228,6 +277,78 @@ cli_written(cli *c)
   ev_schedule(c->event);
 }
 
+/**
+ * cli_batch_size - adjust size of output batch
+ * @c: CLI connection
+ * @batch: size of the previous batch (in arbitrary units), 0 for the first one
+ * @min: minimal batch size
+ * @max: maximal batch size
+ *
+ * This function is called by continuation routines before they produce
+ * the next part of a long output. It returns the size of the next batch,
+ * which is doubled if the previous output was written to the socket without
+ * waiting, or halved if the socket was not writable.
+ */
+uint
+cli_batch_size(cli *c, uint batch, uint min, uint max)
+{
+  if (!batch)
+    batch = min;
+  else if (c->tx_blocked)
+    batch /= 2;
+  else
+    batch *= 2;
+
+  c->tx_blocked = 0;
+  return MIN(MAX(batch, min), max);
+}
+
+
+/**
+ * cli_suspend - suspend a CLI session
+ * @c: CLI connection
+ *
+ * This function is called by a command handler which completes the command
+ * later. Pending output is still written, but no other command is processed
+ * until cli_resume() is called.
+ */
+void
+cli_suspend(cli *c)
+{
+  c->suspended = 1;
+}
+
+/**
+ * cli_resume - resume a suspended CLI session
+ * @c: CLI connection
+ */
+void
+cli_resume(cli *c)
+{
+  c->suspended = 0;
+  ev_schedule(c->event);
+}
+
+static list cli_parser_waiters;
+
+/**
+ * cli_parser_done - wake up sessions waiting for the parser
+ *
+ * This function is called by the system dependent code when a background
+ * configuration parsing is finished and @config_parsing is cleared.
+ */
+void
+cli_parser_done(void)
+{
+  cli *c;
+
+  while (!EMPTY_LIST(cli_parser_waiters))
+    {
+      c = SKIP_BACK(cli, parser_n, HEAD(cli_parser_waiters));
+      rem_node(&c->parser_n);
+      ev_schedule(c->event);
+    }
+}
 
 static byte *cli_rh_pos;
 static uint cli_rh_len;
@@ -287,8 +408,17 @@ cli_event(void *data)
 
   if (c->tx_pos)
     ;
+  else if (c->suspended)
+    return;
   else if (c->cont)
     c->cont(c);
+  else if (config_parsing)
+    {
+      /* The parser is busy, wait for cli_parser_done() */
+      if (!NODE_VALID(&c->parser_n))
+	add_tail(&cli_parser_waiters, &c->parser_n);
+      return;
+    }
   else
     {
       err = cli_get_command(c);
@@ -408,6 +538,8 @@ cli_free(cli *c)
   cli_set_log_echo(c, 0, 0);
   if (c->cleanup)
     c->cleanup(c);
+  if (NODE_VALID(&c->parser_n))
+    rem_node(&c->parser_n);
   if (c == cmd_reconfig_stored_cli)
     cmd_reconfig_stored_cli = NULL;
   rfree(c->pool);
@@ -424,5 +556,6 @@ cli_init(void)
 {
   cli_pool = rp_new(&root_pool, "CLI");
   init_list(&cli_log_hooks);
+  init_list(&cli_parser_waiters);
   cli_log_inited = 1;
 }
@@ -13,7 +13,7 @@
 #include "lib/event.h"
 
 #define CLI_RX_BUF_SIZE 4096
-#define CLI_TX_BUF_SIZE 4096
+#define CLI_TX_BUF_SIZE 16384
 #define CLI_MAX_ASYNC_QUEUE 4096
 
 #define CLI_MSG_SIZE 500
@@ -27,6 +27,7 @@ struct cli_out {
 
 typedef struct cli {
   node n;				/* Node in list of all log hooks */
+  node parser_n;			/* Node in list of CLIs waiting for the parser */
   pool *pool;
   void *priv;				/* Private to sysdep layer */
   byte *rx_buf, *rx_pos, *rx_aux;	/* sysdep */
@@ -36,7 +37,9 @@ typedef struct cli {
   void (*cleanup)(struct cli *c);
   void *rover;				/* Private to continuation routine */
   int last_reply;
+  int tx_blocked;			/* Output had to wait for the socket, set by sysdep */
   int restricted;			/* CLI is restricted to read-only commands */
+  int suspended;			/* Command is running asynchronously, see cli_suspend() */
   struct linpool *parser_pool;		/* Pool used during parsing */
   byte *ring_buf;			/* Ring buffer for asynchronous messages */
   byte *ring_end, *ring_read, *ring_write;	/* Pointers to the ring buffer */
@@ -54,8 +57,12 @@ extern struct cli *this_cli;		/* Used during parsing */
 /* Functions to be called by command handlers */
 
 void cli_printf(cli *, int, char *, ...);
+byte *cli_alloc_line(cli *, int code, uint len);
 #define cli_msg(x...) cli_printf(this_cli, x)
 void cli_set_log_echo(cli *, uint mask, uint size);
+uint cli_batch_size(cli *, uint batch, uint min, uint max);
+void cli_suspend(cli *);
+void cli_resume(cli *);
 
 /* Functions provided to sysdep layer */
 
@@ -65,6 +72,7 @@ void cli_free(cli *);
 void cli_kick(cli *);
 void cli_written(cli *);
 void cli_echo(uint class, byte *msg);
+void cli_parser_done(void);
 
 static inline int cli_access_restricted(void)
 {
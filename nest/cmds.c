@@ -88,12 +88,24 @@ extern pool *proto_pool;
 void
 cmd_show_memory(void)
 {
+  struct rtable_config *tc;
+  char buf[32];
+
   cli_msg(-1018, "BIRD memory usage");
   print_size("Routing tables:", rmemsize(rt_table_pool));
+  WALK_LIST(tc, config->tables)
+    if (tc->table)
+    {
+      bsnprintf(buf, sizeof(buf), "  %s:", tc->name);
+      print_size(buf, rt_memsize(tc->table));
+    }
   print_size("Route attributes:", rmemsize(rta_pool));
   print_size("ROA tables:", rmemsize(roa_pool));
   print_size("Protocols:", rmemsize(proto_pool));
-  print_size("Total:", rmemsize(&root_pool));
+  print_size("Page arenas:", page_arena_size());
+  print_size("Standby memory:", page_cache_size());
+  print_size("Released memory:", page_released_size());
+  print_size("Total:", rmemsize(&root_pool) + page_cache_size());
   cli_msg(0, "");
 }
 
@@ -446,22 +446,41 @@ if_find_by_name(char *name)
   return NULL;
 }
 
-struct iface *
-if_get_by_name(char *name)
+struct if_get_request {
+  char *name;
+  struct iface *iface;
+};
+
+static void
+if_get_by_name_hook(void *data)
 {
+  struct if_get_request *req = data;
   struct iface *i;
 
-  if (i = if_find_by_name(name))
-    return i;
+  if (i = if_find_by_name(req->name))
+    {
+      req->iface = i;
+      return;
+    }
 
   /* No active iface, create a dummy */
   i = mb_allocz(if_pool, sizeof(struct iface));
-  strncpy(i->name, name, sizeof(i->name)-1);
+  strncpy(i->name, req->name, sizeof(i->name)-1);
   i->flags = IF_SHUTDOWN;
   init_list(&i->addrs);
   init_list(&i->neighbors);
   add_tail(&iface_list, &i->n);
-  return i;
+  req->iface = i;
+}
+
+struct iface *
+if_get_by_name(char *name)
+{
+  struct if_get_request req = { .name = name };
+
+  /* Called by the parser, which may run in background */
+  sysdep_main_call(if_get_by_name_hook, &req);
+  return req.iface;
 }
 
 struct ifa *kif_choose_primary(struct iface *i);
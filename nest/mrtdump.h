@@ -15,10 +15,16 @@
 
 /* MRTdump types */
 
+#define TABLE_DUMP_V2		13
 #define BGP4MP			16
+#define BGP4MP_ET		17
 
 /* MRTdump subtypes */
 
+#define TABLE_DUMP_V2_PEER_INDEX_TABLE	1
+#define TABLE_DUMP_V2_RIB_IPV4_UNICAST	2
+#define TABLE_DUMP_V2_RIB_IPV6_UNICAST	4
+
 #define BGP4MP_MESSAGE		1
 #define BGP4MP_MESSAGE_AS4	4
 #define BGP4MP_STATE_CHANGE_AS4	5
@@ -26,6 +32,8 @@
 
 /* implemented in sysdep */
 void mrt_dump_message(struct proto *p, u16 type, u16 subtype, byte *buf, u32 len);
+int mrt_dump_write(int fd, byte *buf, uint len);
+int mrt_dump_close(int fd);
 
 #endif
 
@@ -929,6 +929,13 @@ protos_build(void)
 #ifdef CONFIG_BABEL
   proto_build(&proto_babel);
 #endif
+#ifdef CONFIG_RPKI
+  proto_build(&proto_rpki);
+#endif
+#ifdef CONFIG_MRT
+  proto_build(&proto_mrt);
+  proto_build(&proto_mrt_replay);
+#endif
 
   proto_pool = rp_new(&root_pool, "Protocols");
   proto_flush_event = ev_new(proto_pool);
@@ -77,7 +77,8 @@ void protos_dump_all(void);
 
 extern struct protocol
   proto_device, proto_radv, proto_rip, proto_static,
-  proto_ospf, proto_pipe, proto_bgp, proto_bfd, proto_babel;
+  proto_ospf, proto_pipe, proto_bgp, proto_bfd, proto_babel, proto_rpki,
+  proto_mrt, proto_mrt_replay;
 
 /*
  *	Routing Protocol Instance
@@ -94,6 +95,7 @@ struct proto_config {
   u32 debug, mrtdump;			/* Debugging bitfields, both use D_* constants */
   unsigned preference, disabled;	/* Generic parameters */
   int in_keep_filtered;			/* Routes rejected in import filter are kept */
+  int roa_revalidate;			/* Routes are reimported when related ROAs change */
   u32 router_id;			/* Protocol specific router ID */
   struct iface *vrf;			/* Related VRF instance, NULL if global */
   struct rtable_config *table;		/* Table we're attached to */
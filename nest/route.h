@@ -71,6 +71,7 @@ void *fib_get(struct fib *, ip_addr *, int); 	/* Find or create new if nonexiste
 void *fib_route(struct fib *, ip_addr, int);	/* Longest-match routing lookup */
 void fib_delete(struct fib *, void *);	/* Remove fib entry */
 void fib_free(struct fib *);		/* Destroy the fib */
+size_t fib_memsize(struct fib *);	/* Memory used by the fib */
 void fib_check(struct fib *);		/* Consistency check for debugging */
 
 void fit_init(struct fib_iterator *, struct fib *); /* Internal functions, don't call */
@@ -135,6 +136,7 @@ struct rtable_config {
 typedef struct rtable {
   node n;				/* Node in list of all tables */
   struct fib fib;
+  struct fib index;			/* Prefix index of networks (struct rt_index_node) */
   char *name;				/* Name of this table */
   list hooks;				/* List of announcement hooks */
   int pipe_busy;			/* Pipe loop detection */
@@ -154,6 +156,7 @@ typedef struct rtable {
   byte nhu_state;			/* Next Hop Update state */
   struct fib_iterator prune_fit;	/* Rtable prune FIB iterator */
   struct fib_iterator nhu_fit;		/* Next Hop Update FIB iterator */
+  uint rt_count;			/* Number of routes in the table, for rt_memsize() */
 } rtable;
 
 #define RPS_NONE	0
@@ -163,8 +166,26 @@ typedef struct rtable {
 typedef struct network {
   struct fib_node n;			/* FIB flags reserved for kernel syncer */
   struct rte *routes;			/* Available routes for this network */
+  node index_n;				/* Node in bucket of the prefix index */
 } net;
 
+struct rt_index_node {			/* Bucket of the prefix index, see rt_index_add() */
+  struct fib_node n;
+  list nets;				/* Networks in the bucket (net->index_n) */
+};
+
+struct rt_reimport {			/* Reimport of covered networks, see rt_reimport_start() */
+  rtable *table;			/* Table being walked (locked), NULL when done */
+  struct prefix *prefixes;		/* Prefixes covering affected networks */
+  uint count;				/* Number of prefixes */
+  uint pos;				/* Prefix being processed */
+  uint len;				/* Next bucket length (when buckets are looked up) */
+  u32 idx;				/* Next bucket at that length */
+  int walk;				/* Walking the whole index instead of lookups */
+  struct fib_iterator fit;		/* Walk through the index (for short prefixes) */
+  int fit_linked;			/* Iterator is linked to the index */
+};
+
 struct hostcache {
   slab *slab;				/* Slab holding all hostentries */
   struct hostentry **hash_table;	/* Hash table for hostentries */
@@ -197,6 +218,7 @@ typedef struct rte {
   net *net;				/* Network this RTE belongs to */
   struct announce_hook *sender;		/* Announce hook used to send the route to the routing table */
   struct rta *attrs;			/* Attributes of this route */
+  struct rte *orig;			/* Route before the import filter, kept for reimport */
   byte flags;				/* Flags (REF_...) */
   byte pflags;				/* Protocol-specific flags */
   word pref;				/* Route preference */
@@ -270,10 +292,21 @@ void rt_lock_table(rtable *);
 void rt_unlock_table(rtable *);
 void rt_setup(pool *, rtable *, char *, struct rtable_config *);
 static inline net *net_find(rtable *tab, ip_addr addr, unsigned len) { return (net *) fib_find(&tab->fib, &addr, len); }
-static inline net *net_get(rtable *tab, ip_addr addr, unsigned len) { return (net *) fib_get(&tab->fib, &addr, len); }
+void rt_index_add(rtable *tab, net *n);
+static inline net *net_get(rtable *tab, ip_addr addr, unsigned len)
+{
+  net *n = fib_get(&tab->fib, &addr, len);
+  if (!n->index_n.next)		/* New network */
+    rt_index_add(tab, n);
+  return n;
+}
 rte *rte_find(net *net, struct rte_src *src);
 rte *rte_get_temp(struct rta *);
 void rte_update2(struct announce_hook *ah, net *net, rte *new, struct rte_src *src);
+size_t rt_memsize(rtable *t);
+void rt_reimport_start(struct rt_reimport *r, struct prefix *prefixes, uint count);
+int rt_reimport_step(struct rt_reimport *r, uint max);
+void rt_reimport_stop(struct rt_reimport *r);
 /* rte_update() moved to protocol.h to avoid dependency conflicts */
 int rt_examine(rtable *t, ip_addr prefix, int pxlen, struct proto *p, struct filter *filter);
 rte *rt_export_merged(struct announce_hook *ah, net *net, rte **rt_free, struct ea_list **tmpa, linpool *pool, int silent);
@@ -309,10 +342,12 @@ struct rt_show_data {
   struct fib_iterator fit;
   struct proto *show_protocol;
   struct proto *export_protocol;
+  struct announce_hook *export_ahook;	/* Announce hook of export_protocol, updated for each batch */
   int export_mode, primary_only, filtered;
   struct config *running_on_config;
   int net_counter, rt_counter, show_counter;
-  int stats, show_for;
+  int stats, show_for, compact, binary;
+  uint batch;				/* Number of networks in the last batch */
 };
 void rt_show(struct rt_show_data *);
 
@@ -522,6 +557,7 @@ static inline rta * rta_cow(rta *r, linpool *lp) { return rta_is_cached(r) ? rta
 void rta_dump(rta *);
 void rta_dump_all(void);
 void rta_show(struct cli *, rta *, ea_list *);
+void rt_show_rte_binary(struct cli *c, rte *e, ea_list *tmpa);
 void rta_set_recursive_next_hop(rtable *dep, rta *a, rtable *tab, ip_addr *gw, ip_addr *ll);
 
 /*
@@ -574,18 +610,27 @@ struct roa_item {
   u32 asn;
   byte maxlen;
   byte src;
+  byte flags;				/* Temporary marks used by roa_commit() */
   struct roa_item *next;
 };
 
 struct roa_node {
   struct fib_node n;
   struct roa_item *items;
+  struct roa_node *parent;		/* Parent node in the prefix trie */
+  struct roa_node *child[2];		/* Child nodes in the prefix trie */
   // u32 cached_asn;
 };
 
 struct roa_table {
   node n;				/* Node in roa_table_list */
   struct fib fib;
+  struct roa_node *root;		/* Root of the prefix trie of ROA nodes */
+  struct fib changed;			/* Prefixes of changed ROA entries (struct roa_node) */
+  struct roa_node *changed_root;	/* Root of the prefix trie of changed prefixes */
+  struct prefix *reval;			/* Changed prefixes being processed by roa_revalidate(), NULL if not running */
+  struct rt_reimport reimport;		/* Running reimport for prefixes in reval */
+  struct event *revalidate;		/* Event for processing changes (roa_revalidate()) */
   char *name;				/* Name of this ROA table */
   struct roa_table_config *cf;		/* Configuration of this ROA table */
 };
@@ -625,6 +670,7 @@ struct roa_show_data {
 #define ROA_SRC_ANY	0
 #define ROA_SRC_CONFIG	1
 #define ROA_SRC_DYNAMIC	2
+#define ROA_SRC_RPKI	3
 
 #define ROA_SHOW_ALL	0
 #define ROA_SHOW_PX	1
@@ -0,0 +1,239 @@
+/*
+ *	BIRD Internet Routing Daemon -- Binary Route Records
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: Binary route records
+ *
+ * The 'show route' command with the 'binary' option prints routes as binary
+ * records intended for monitoring tools, which would otherwise have to parse
+ * the textual output of 'show route all'. Routes are selected and filtered
+ * like for the textual output and they are sent incrementally by the same
+ * continuation routine (rt_show_cont()). To keep the CLI protocol intact,
+ * each record is Base64 encoded and sent as one reply line with code
+ * %RTB_REPLY_CODE, always with the full reply code prefix. The client (birdc)
+ * decodes these lines and prints their content.
+ *
+ * A record describes one route. All values are in network byte order,
+ * addresses are 4 or 16 bytes long according to the address length field,
+ * strings are encoded as one byte of length followed by the characters.
+ *
+ * 	u8	version (%RTB_VERSION)
+ * 	u8	flags (RTB_F_*)
+ * 	u8	address length (4 or 16)
+ * 	u8	prefix length
+ * 	addr	network prefix
+ * 	u8	route source (RTS_*)
+ * 	u8	scope
+ * 	u8	cast (RTC_*)
+ * 	u8	destination (RTD_*)
+ * 	u16	preference
+ * 	u16	reserved (zero)
+ * 	u32	last modification (UNIX time)
+ * 	addr	gateway
+ * 	addr	from
+ * 	string	interface name
+ * 	string	protocol name
+ * 	u16	number of next hops, followed by next hops:
+ * 		addr	gateway
+ * 		u8	weight
+ * 		string	interface name
+ * 	u16	number of attributes, followed by attributes:
+ * 		u16	attribute ID (EA_CODE() of protocol and attribute)
+ * 		u8	attribute flags (EAF_ORIGINATED, EAF_TEMP)
+ * 		u8	attribute type (RTB_A_*, the same as EAF_TYPE_*)
+ * 		u16	length of value
+ * 		value
+ *
+ * Values of integer, router ID and bitfield attributes are u32, values of
+ * IP address attributes are addresses. Community sets are sequences of u32
+ * (pairs of u32 for extended, triplets for large communities), AS paths are
+ * in BGP format with 4-byte AS numbers and opaque attributes are raw bytes.
+ * Attributes of unknown types are skipped. Records are limited to
+ * %RTB_MAX_LENGTH bytes, next hops and attributes which do not fit are
+ * skipped and the record is marked by %RTB_F_TRUNCATED flag.
+ */
+
+#include "nest/bird.h"
+#include "nest/route.h"
+#include "nest/protocol.h"
+#include "nest/cli.h"
+#include "nest/iface.h"
+#include "nest/rt-binary.h"
+#include "lib/base64.h"
+#include "lib/string.h"
+#include "lib/unaligned.h"
+#include "lib/alloca.h"
+
+#define RTB_ALEN	sizeof(ip_addr)
+#define RTB_MAX_STR	(1 + sizeof(((struct iface *) NULL)->name))
+
+static byte *
+rtb_put_str(byte *pos, const char *str)
+{
+  uint len = MIN(strlen(str), 255);
+
+  *pos++ = len;
+  memcpy(pos, str, len);
+  return pos + len;
+}
+
+static byte *
+rtb_put_attr(byte *pos, byte *end, eattr *e)
+{
+  struct adata *ad = (e->type & EAF_EMBEDDED) ? NULL : e->u.ptr;
+  uint type = e->type & EAF_TYPE_MASK;
+  uint len, i;
+  u32 *data;
+
+  switch (type)
+  {
+  case EAF_TYPE_INT:
+  case EAF_TYPE_ROUTER_ID:
+  case EAF_TYPE_BITFIELD:
+    len = 4;
+    break;
+
+  case EAF_TYPE_IP_ADDRESS:
+    len = RTB_ALEN;
+    break;
+
+  case EAF_TYPE_OPAQUE:
+  case EAF_TYPE_AS_PATH:
+  case EAF_TYPE_INT_SET:
+  case EAF_TYPE_EC_SET:
+  case EAF_TYPE_LC_SET:
+    len = ad->length;
+    break;
+
+  default:
+    return pos;
+  }
+
+  if ((len > 0xffff) || (pos + 6 + len > end))
+    return NULL;
+
+  put_u16(pos, e->id);
+  pos[2] = e->type & (EAF_ORIGINATED | EAF_TEMP);
+  pos[3] = type;
+  put_u16(pos + 4, len);
+  pos += 6;
+
+  switch (type)
+  {
+  case EAF_TYPE_INT:
+  case EAF_TYPE_ROUTER_ID:
+  case EAF_TYPE_BITFIELD:
+    put_u32(pos, e->u.data);
+    break;
+
+  case EAF_TYPE_IP_ADDRESS:
+    put_ipa(pos, *(ip_addr *) ad->data);
+    break;
+
+  case EAF_TYPE_INT_SET:
+  case EAF_TYPE_EC_SET:
+  case EAF_TYPE_LC_SET:
+    /* Community sets are stored in host byte order */
+    data = (u32 *) ad->data;
+    for (i = 0; i < len / 4; i++)
+      put_u32(pos + 4 * i, data[i]);
+    break;
+
+  default:
+    memcpy(pos, ad->data, len);
+  }
+
+  return pos + len;
+}
+
+/**
+ * rt_show_rte_binary - print a route as a binary record
+ * @c: destination CLI
+ * @e: route to be printed
+ * @tmpa: temporary attributes of the route
+ *
+ * This function encodes the route @e with its attributes (both from the
+ * &rta and temporary ones) to a binary record and prints it to the CLI
+ * as a Base64 encoded reply line.
+ */
+void
+rt_show_rte_binary(struct cli *c, rte *e, ea_list *tmpa)
+{
+  byte buf[RTB_MAX_LENGTH];
+  byte *pos = buf, *end = buf + sizeof(buf);
+  byte *cnt_pos, *line;
+  rta *a = e->attrs;
+  net *n = e->net;
+  struct mpnh *nh;
+  ea_list *eal;
+  uint cnt, i;
+
+  /* Need to normalize the extended attributes */
+  eal = ea_append(tmpa, a->eattrs);
+  if (eal)
+  {
+    ea_list *t = eal;
+    eal = alloca(ea_scan(t));
+    ea_merge(t, eal);
+    ea_sort(eal);
+  }
+
+  buf[0] = RTB_VERSION;
+  buf[1] = ((n->routes == e) ? RTB_F_PRIMARY : 0) | (rte_is_filtered(e) ? RTB_F_FILTERED : 0);
+  buf[2] = RTB_ALEN;
+  buf[3] = n->n.pxlen;
+  pos = put_ipa(buf + 4, n->n.prefix);
+
+  pos[0] = a->source;
+  pos[1] = a->scope;
+  pos[2] = a->cast;
+  pos[3] = a->dest;
+  put_u16(pos + 4, e->pref);
+  put_u16(pos + 6, 0);
+  put_u32(pos + 8, now_real - (now - e->lastmod));
+  pos += 12;
+
+  pos = put_ipa(pos, a->gw);
+  pos = put_ipa(pos, a->from);
+  pos = rtb_put_str(pos, a->iface ? a->iface->name : "");
+  pos = rtb_put_str(pos, a->src->proto->name);
+
+  cnt_pos = pos;
+  pos += 2;
+  for (nh = a->nexthops, cnt = 0; nh; nh = nh->next, cnt++)
+  {
+    if (pos + RTB_ALEN + 1 + RTB_MAX_STR + 2 > end)
+    {
+      buf[1] |= RTB_F_TRUNCATED;
+      break;
+    }
+
+    pos = put_ipa(pos, nh->gw);
+    *pos++ = nh->weight;
+    pos = rtb_put_str(pos, nh->iface->name);
+  }
+  put_u16(cnt_pos, cnt);
+
+  cnt_pos = pos;
+  pos += 2;
+  for (i = 0, cnt = 0; eal && (i < eal->count); i++)
+  {
+    byte *next = rtb_put_attr(pos, end, &eal->attrs[i]);
+
+    if (!next)
+    {
+      buf[1] |= RTB_F_TRUNCATED;
+      continue;
+    }
+
+    cnt += (next != pos);
+    pos = next;
+  }
+  put_u16(cnt_pos, cnt);
+
+  line = cli_alloc_line(c, -RTB_REPLY_CODE, BASE64_ENC_LENGTH(pos - buf));
+  base64_encode(line, buf, pos - buf);
+}
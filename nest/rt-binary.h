@@ -0,0 +1,37 @@
+/*
+ *	BIRD Internet Routing Daemon -- Binary Route Records
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_RT_BINARY_H_
+#define _BIRD_RT_BINARY_H_
+
+/*
+ * Binary route records are sent by 'show route ... binary' command, each of
+ * them Base64 encoded in one reply line with code RTB_REPLY_CODE. This file
+ * is shared with the client, which decodes the records. See nest/rt-binary.c
+ * for description of the record format.
+ */
+
+#define RTB_REPLY_CODE		1026
+#define RTB_VERSION		1
+#define RTB_MAX_LENGTH		8192	/* Max length of a record before encoding */
+
+/* Record flags */
+#define RTB_F_PRIMARY		0x01	/* Route is the selected one for its network */
+#define RTB_F_FILTERED		0x02	/* Route was rejected by import filter */
+#define RTB_F_TRUNCATED		0x04	/* Some next hops or attributes did not fit */
+
+/* Attribute types, the same values as EAF_TYPE_* */
+#define RTB_A_INT		0x01
+#define RTB_A_OPAQUE		0x02
+#define RTB_A_IP_ADDRESS	0x04
+#define RTB_A_ROUTER_ID		0x05
+#define RTB_A_AS_PATH		0x06
+#define RTB_A_BITFIELD		0x09
+#define RTB_A_INT_SET		0x0a
+#define RTB_A_EC_SET		0x0e
+#define RTB_A_LC_SET		0x12
+
+#endif
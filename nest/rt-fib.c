@@ -385,6 +385,19 @@ fib_free(struct fib *f)
   rfree(f->fib_slab);
 }
 
+/**
+ * fib_memsize - get memory usage of a FIB
+ * @f: FIB
+ *
+ * This function returns the amount of memory used by the FIB nodes
+ * and the hash table of the FIB.
+ */
+size_t
+fib_memsize(struct fib *f)
+{
+  return rmemsize(f->fib_slab) + f->hash_size * sizeof(struct fib_node *);
+}
+
 void
 fit_init(struct fib_iterator *i, struct fib *f)
 {
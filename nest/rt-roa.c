@@ -5,6 +5,39 @@
  *	Can be freely distributed and used under the terms of the GNU GPL.
  */
 
+/**
+ * DOC: ROA tables
+ *
+ * ROA entries (&roa_item) are attached to nodes of a FIB (&roa_node),
+ * one node for each ROA prefix. In addition to the FIB, all nodes are
+ * linked in a path-compressed binary prefix trie, where each node is
+ * an ancestor of all nodes with prefixes covered by its prefix. When
+ * two prefixes diverge and there is no node for their common prefix,
+ * an auxiliary node without ROA entries is added as their parent.
+ * Therefore, all ROAs covering a network may be found (by roa_check())
+ * in one downward walk from the root of the trie, instead of a FIB
+ * lookup for each shorter prefix length.
+ *
+ * Nodes without ROA entries and with at most one child are removed from
+ * the trie and from the FIB (by roa_cleanup_node()).
+ *
+ * Prefixes of added and removed ROA entries are also collected in a
+ * second prefix trie of the table (&changed). Changes are processed
+ * later from an event by roa_revalidate(), which asks the routing
+ * tables to reimport routes in networks covered by changed prefixes
+ * (see rt_reimport_start()), as their validation state may have
+ * changed. A caller doing a batch of changes (e.g. the RPKI protocol)
+ * therefore gets the whole batch processed at once.
+ *
+ * All networks covered by a changed prefix are affected, not only those up
+ * to the max length of the ROA, as a ROA also makes longer prefixes invalid.
+ * Only the topmost changed prefixes of the trie are passed to the routing
+ * tables (&reval), the others are covered by them. Networks are found by
+ * the prefix index of each table in steps of %ROA_REVALIDATE_STEP, one step
+ * per run of the event. Changes done during the walk are collected in the
+ * emptied trie for the next one.
+ */
+
 #undef LOCAL_DEBUG
 
 #include "nest/bird.h"
@@ -26,6 +59,109 @@ static inline int
 src_match(struct roa_item *it, byte src)
 { return !src || it->src == src; }
 
+static inline uint
+roa_bit(ip_addr a, uint pos)
+{ return !!ipa_getbit(a, pos); }
+
+#define ROA_NODE_CHANGED	1	/* Prefix is in the changed trie, not auxiliary node */
+
+#define ROA_ITEM_KEEP		1	/* Static entry is kept by the new config */
+
+#define ROA_REVALIDATE_STEP	4096	/* Networks and buckets examined in one run of roa_revalidate() */
+
+static struct roa_node *
+roa_get_node(struct fib *fib, struct roa_node **root, ip_addr prefix, byte pxlen)
+{
+  struct roa_node *n = fib_find(fib, &prefix, pxlen);
+
+  if (n)
+    return n;
+
+  n = fib_get(fib, &prefix, pxlen);
+
+  /* Find position of the new node in the trie */
+  struct roa_node **np = root;
+  struct roa_node *parent = NULL;
+  struct roa_node *x;
+
+  while ((x = *np) && net_in_net(prefix, pxlen, x->n.prefix, x->n.pxlen))
+  {
+    parent = x;
+    np = &x->child[roa_bit(prefix, x->n.pxlen)];
+  }
+
+  if (x && !net_in_net(x->n.prefix, x->n.pxlen, prefix, pxlen))
+  {
+    /* Prefixes diverge, add auxiliary node for their common prefix */
+    uint len = ipa_pxlen(prefix, x->n.prefix);
+    ip_addr px = ipa_and(prefix, ipa_mkmask(len));
+    struct roa_node *g = fib_get(fib, &px, len);
+
+    g->parent = parent;
+    g->child[roa_bit(x->n.prefix, len)] = x;
+    x->parent = g;
+    *np = g;
+
+    parent = g;
+    np = &g->child[roa_bit(prefix, len)];
+  }
+  else if (x)
+  {
+    /* Existing node is covered by the new node */
+    n->child[roa_bit(x->n.prefix, pxlen)] = x;
+    x->parent = n;
+  }
+
+  n->parent = parent;
+  *np = n;
+
+  return n;
+}
+
+/* Remove nodes without ROA entries which are not needed as branching points */
+static void
+roa_cleanup_node(struct fib *fib, struct roa_node **root, struct roa_node *n)
+{
+  while (n && !n->items && !(n->child[0] && n->child[1]))
+  {
+    struct roa_node *c = n->child[0] ?: n->child[1];
+    struct roa_node *parent = n->parent;
+
+    if (parent)
+      parent->child[parent->child[1] == n] = c;
+    else
+      *root = c;
+
+    if (c)
+      c->parent = parent;
+
+    fib_delete(fib, n);
+    n = parent;
+  }
+}
+
+static void
+roa_mark_changed(struct roa_table *t, ip_addr prefix, byte pxlen)
+{
+  struct roa_node *n = roa_get_node(&t->changed, &t->changed_root, prefix, pxlen);
+  n->n.flags |= ROA_NODE_CHANGED;
+
+  ev_schedule(t->revalidate);
+}
+
+static struct roa_item *
+roa_find_item(struct roa_table *t, ip_addr prefix, byte pxlen, byte maxlen, u32 asn, byte src)
+{
+  struct roa_node *n = fib_find(&t->fib, &prefix, pxlen);
+  struct roa_item *it;
+
+  for (it = n ? n->items : NULL; it; it = it->next)
+    if ((it->maxlen == maxlen) && (it->asn == asn) && src_match(it, src))
+      return it;
+
+  return NULL;
+}
+
 /**
  * roa_add_item - add a ROA entry
  * @t: ROA table
@@ -42,7 +178,7 @@ src_match(struct roa_item *it, byte src)
 void
 roa_add_item(struct roa_table *t, ip_addr prefix, byte pxlen, byte maxlen, u32 asn, byte src)
 {
-  struct roa_node *n = fib_get(&t->fib, &prefix, pxlen);
+  struct roa_node *n = roa_get_node(&t->fib, &t->root, prefix, pxlen);
 
   // if ((n->items == NULL) && (n->n.x0 != ROA_INVALID))
   // t->cached_items--;
@@ -56,8 +192,11 @@ roa_add_item(struct roa_table *t, ip_addr prefix, byte pxlen, byte maxlen, u32 a
   it->asn = asn;
   it->maxlen = maxlen;
   it->src = src;
+  it->flags = 0;
   it->next = n->items;
   n->items = it;
+
+  roa_mark_changed(t, prefix, pxlen);
 }
 
 /**
@@ -92,6 +231,9 @@ roa_delete_item(struct roa_table *t, ip_addr prefix, byte pxlen, byte maxlen, u3
   *itp = it->next;
   sl_free(roa_slab, it);
 
+  roa_cleanup_node(&t->fib, &t->root, n);
+  roa_mark_changed(t, prefix, pxlen);
+
   // if ((n->items == NULL) && (n->n.x0 != ROA_INVALID))
   // t->cached_items++;
 }
@@ -111,8 +253,12 @@ roa_flush(struct roa_table *t, byte src)
 {
   struct roa_item *it, **itp;
   struct roa_node *n;
+  struct fib_iterator fit;
+
+  FIB_ITERATE_INIT(&fit, &t->fib);
 
-  FIB_WALK(&t->fib, fn)
+ again:
+  FIB_ITERATE_START(&t->fib, &fit, fn)
     {
       n = (struct roa_node *) fn;
 
@@ -122,13 +268,20 @@ roa_flush(struct roa_table *t, byte src)
 	  {
 	    *itp = it->next;
 	    sl_free(roa_slab, it);
+	    roa_mark_changed(t, n->n.prefix, n->n.pxlen);
 	  }
 	else
 	  itp = &it->next;
-    }
-  FIB_WALK_END;
 
-  // TODO add cleanup of roa_nodes
+      /* Removal of nodes may invalidate hidden variables of the iteration */
+      if (!n->items && !(n->child[0] && n->child[1]))
+	{
+	  FIB_ITERATE_PUT(&fit, fn);
+	  roa_cleanup_node(&t->fib, &t->root, n);
+	  goto again;
+	}
+    }
+  FIB_ITERATE_END(fn);
 }
 
 
@@ -173,7 +326,8 @@ roa_check(struct roa_table *t, ip_addr prefix, byte pxlen, u32 asn)
  *
  * Implements RFC 6483 route validation for the given network
  * prefix. The procedure is to find all candidate ROAs - ROAs whose
- * prefixes cover the give network prefix. If there is no candidate
+ * prefixes cover the give network prefix. These are found in one walk
+ * down the prefix trie of the ROA table. If there is no candidate
  * ROA, return ROA_UNKNOWN. If there is a candidate ROA with matching
  * ASN and maxlen field greater than or equal to the given prefix
  * length, return ROA_VALID. Otherwise return ROA_INVALID. If caller
@@ -184,18 +338,11 @@ byte
 roa_check(struct roa_table *t, ip_addr prefix, byte pxlen, u32 asn)
 {
   struct roa_node *n;
-  ip_addr px;
   byte anything = 0;
 
-  int len;
-  for (len = pxlen; len >= 0; len--)
+  for (n = t->root; n && net_in_net(prefix, pxlen, n->n.prefix, n->n.pxlen);
+       n = (n->n.pxlen < pxlen) ? n->child[roa_bit(prefix, n->n.pxlen)] : NULL)
     {
-      px = ipa_and(prefix, ipa_mkmask(len));
-      n = fib_find(&t->fib, &px, len);
-
-      if (!n)
-	continue;
-
       struct roa_item *it;
       for (it = n->items; it; it = it->next)
 	{
@@ -213,6 +360,71 @@ roa_node_init(struct fib_node *fn)
 {
   struct roa_node *n = (struct roa_node *) fn;
   n->items = NULL;
+  n->parent = n->child[0] = n->child[1] = NULL;
+  n->n.flags = 0;
+}
+
+/* Collect topmost changed prefixes, the others are covered by them */
+static uint
+roa_collect_changed(struct roa_node *n, struct prefix *px)
+{
+  if (!n)
+    return 0;
+
+  if (n->n.flags & ROA_NODE_CHANGED)
+  {
+    px->addr = n->n.prefix;
+    px->len = n->n.pxlen;
+    return 1;
+  }
+
+  uint cnt = roa_collect_changed(n->child[0], px);
+  return cnt + roa_collect_changed(n->child[1], px + cnt);
+}
+
+/**
+ * roa_revalidate - process changes of a ROA table
+ * @data: ROA table
+ *
+ * This event hook asks the routing tables to reimport routes in networks
+ * covered by prefixes of ROA entries changed since the last run. The walk
+ * through routing tables is done in steps, the event is rescheduled until
+ * it is finished. Then the processed prefixes are forgotten.
+ */
+static void
+roa_revalidate(void *data)
+{
+  struct roa_table *t = data;
+
+  if (!t->reval)
+  {
+    if (!t->changed_root)
+      return;
+
+    DBG("ROA: Revalidating routes for table %s (%u changed prefixes)\n", t->name, t->changed.entries);
+
+    t->reval = mb_alloc(roa_pool, t->changed.entries * sizeof(struct prefix));
+    uint cnt = roa_collect_changed(t->changed_root, t->reval);
+
+    fib_free(&t->changed);
+    fib_init(&t->changed, roa_pool, sizeof(struct roa_node), 0, roa_node_init);
+    t->changed_root = NULL;
+
+    rt_reimport_start(&t->reimport, t->reval, cnt);
+  }
+
+  if (!rt_reimport_step(&t->reimport, ROA_REVALIDATE_STEP))
+  {
+    ev_schedule(t->revalidate);
+    return;
+  }
+
+  mb_free(t->reval);
+  t->reval = NULL;
+
+  /* Changes done during the walk */
+  if (t->changed_root)
+    ev_schedule(t->revalidate);
 }
 
 static inline void
@@ -223,6 +435,33 @@ roa_populate(struct roa_table *t)
     roa_add_item(t, ric->prefix, ric->pxlen, ric->maxlen, ric->asn, ROA_SRC_CONFIG);
 }
 
+/*
+ * Update static ROA entries from the old config to the new one. Entries present
+ * in both configs are kept as they are, so only real additions and removals are
+ * marked as changed and a reconfiguration does not revalidate everything.
+ */
+static void
+roa_reconfigure(struct roa_table *t, struct roa_item_config *old)
+{
+  struct roa_item_config *ric;
+  struct roa_item *it;
+
+  for (ric = t->cf->roa_items; ric; ric = ric->next)
+    if (it = roa_find_item(t, ric->prefix, ric->pxlen, ric->maxlen, ric->asn, ROA_SRC_CONFIG))
+      it->flags |= ROA_ITEM_KEEP;
+    else
+      roa_add_item(t, ric->prefix, ric->pxlen, ric->maxlen, ric->asn, ROA_SRC_CONFIG);
+
+  for (ric = old; ric; ric = ric->next)
+    if ((it = roa_find_item(t, ric->prefix, ric->pxlen, ric->maxlen, ric->asn, ROA_SRC_CONFIG)) &&
+	!(it->flags & ROA_ITEM_KEEP))
+      roa_delete_item(t, ric->prefix, ric->pxlen, ric->maxlen, ric->asn, ROA_SRC_CONFIG);
+
+  for (ric = t->cf->roa_items; ric; ric = ric->next)
+    if (it = roa_find_item(t, ric->prefix, ric->pxlen, ric->maxlen, ric->asn, ROA_SRC_CONFIG))
+      it->flags &= ~ROA_ITEM_KEEP;
+}
+
 static void
 roa_new_table(struct roa_table_config *cf)
 {
@@ -230,6 +469,10 @@ roa_new_table(struct roa_table_config *cf)
 
   t = mb_allocz(roa_pool, sizeof(struct roa_table));
   fib_init(&t->fib, roa_pool, sizeof(struct roa_node), 0, roa_node_init);
+  fib_init(&t->changed, roa_pool, sizeof(struct roa_node), 0, roa_node_init);
+  t->revalidate = ev_new(roa_pool);
+  t->revalidate->hook = roa_revalidate;
+  t->revalidate->data = t;
   t->name = cf->name;
   t->cf = cf;
 
@@ -315,14 +558,14 @@ roa_commit(struct config *new, struct config *old)
 	if (sym && sym->class == SYM_ROA)
 	  {
 	    /* Found old table in new config */
+	    struct roa_item_config *old_items = t->cf->roa_items;
 	    cf = sym->def;
 	    cf->table = t;
 	    t->name = cf->name;
 	    t->cf = cf;
 
 	    /* Reconfigure it */
-	    roa_flush(t, ROA_SRC_CONFIG);
-	    roa_populate(t);
+	    roa_reconfigure(t, old_items);
 	  }
 	else
 	  {
@@ -332,6 +575,13 @@ roa_commit(struct config *new, struct config *old)
 	    roa_flush(t, ROA_SRC_ANY);
 	    rem_node(&t->n);
 	    fib_free(&t->fib);
+	    fib_free(&t->changed);
+	    if (t->reval)
+	    {
+	      rt_reimport_stop(&t->reimport);
+	      mb_free(t->reval);
+	    }
+	    rfree(t->revalidate);
 	    mb_free(t);
 	  }
       }
@@ -399,8 +649,6 @@ void
 roa_show(struct roa_show_data *d)
 {
   struct roa_node *rn;
-  ip_addr px;
-  int len;
 
   switch (d->mode)
     {
@@ -424,16 +672,9 @@ roa_show(struct roa_show_data *d)
       break;
 
     case ROA_SHOW_FOR:
-      for (len = d->pxlen; len >= 0; len--)
-	{
-	  px = ipa_and(d->prefix, ipa_mkmask(len));
-	  rn = fib_find(&d->table->fib, &px, len);
-
-	  if (!rn)
-	    continue;
-
-	  roa_show_node(this_cli, rn, 0, d->asn);
-	}
+      for (rn = d->table->root; rn && net_in_net(d->prefix, d->pxlen, rn->n.prefix, rn->n.pxlen);
+	   rn = (rn->n.pxlen < d->pxlen) ? rn->child[roa_bit(d->prefix, rn->n.pxlen)] : NULL)
+	roa_show_node(this_cli, rn, 0, d->asn);
       cli_msg(0, "");
       break;
     }
@@ -85,6 +85,73 @@ rte_init(struct fib_node *N)
 
   N->flags = 0;
   n->routes = NULL;
+  n->index_n.next = n->index_n.prev = NULL;
+}
+
+#ifdef IPV6
+#define RT_INDEX_LEN	32		/* Maximal prefix length of index buckets */
+#else
+#define RT_INDEX_LEN	16
+#endif
+
+static void
+rt_index_init(struct fib_node *N)
+{
+  struct rt_index_node *b = (struct rt_index_node *) N;
+
+  N->flags = 0;
+  init_list(&b->nets);
+}
+
+/**
+ * rt_index_add - add a network to the prefix index
+ * @tab: routing table
+ * @n: new network
+ *
+ * Networks are hashed in the FIB of a table, so networks covered by a prefix
+ * cannot be found without walking the whole table. Therefore, each table also
+ * keeps a prefix index: a second FIB (&index) of buckets (&rt_index_node),
+ * where each network is linked in the bucket for its prefix truncated to at
+ * most %RT_INDEX_LEN bits. Networks covered by a prefix are then found in the
+ * few buckets under the prefix (see rt_reimport_step()).
+ *
+ * The function is called from net_get() for new networks, they are removed
+ * from the index by rt_index_remove() before they are deleted.
+ */
+void
+rt_index_add(rtable *tab, net *n)
+{
+  uint len = MIN(n->n.pxlen, RT_INDEX_LEN);
+  ip_addr px = ipa_and(n->n.prefix, ipa_mkmask(len));
+  struct rt_index_node *b = fib_get(&tab->index, &px, len);
+
+  add_tail(&b->nets, &n->index_n);
+}
+
+static void
+rt_index_remove(rtable *tab, net *n)
+{
+  uint len = MIN(n->n.pxlen, RT_INDEX_LEN);
+  ip_addr px = ipa_and(n->n.prefix, ipa_mkmask(len));
+  struct rt_index_node *b = fib_find(&tab->index, &px, len);
+
+  rem_node(&n->index_n);
+  if (EMPTY_LIST(b->nets))
+    fib_delete(&tab->index, b);
+}
+
+/* Key of bucket @i of length @len under prefix @px, all within the first word */
+static inline ip_addr
+rt_index_key(ip_addr px, uint len, u32 i)
+{
+  if (i)
+#ifdef IPV6
+    _I0(px) |= i << (32 - len);
+#else
+    _I(px) |= i << (32 - len);
+#endif
+
+  return px;
 }
 
 /**
@@ -120,6 +187,7 @@ rte_get_temp(rta *a)
   rte *e = sl_alloc(rte_slab);
 
   e->attrs = a;
+  e->orig = NULL;
   e->flags = 0;
   e->pref = a->src->proto->preference;
   return e;
@@ -132,6 +200,7 @@ rte_do_cow(rte *r)
 
   memcpy(e, r, sizeof(rte));
   e->attrs = rta_clone(r->attrs);
+  e->orig = NULL;
   e->flags = 0;
   return e;
 }
@@ -834,6 +903,8 @@ rte_validate(rte *e)
 void
 rte_free(rte *e)
 {
+  if (e->orig)
+    rte_free(e->orig);
   if (rta_is_cached(e->attrs))
     rta_free(e->attrs);
   sl_free(rte_slab, e);
@@ -842,6 +913,8 @@ rte_free(rte *e)
 static inline void
 rte_free_quick(rte *e)
 {
+  if (e->orig)
+    rte_free_quick(e->orig);
   rta_free(e->attrs);
   sl_free(rte_slab, e);
 }
@@ -898,7 +971,10 @@ rte_recalculate(struct announce_hook *ah, net *net, rte *new, struct rte_src *sr
 
 	  if (new && rte_same(old, new))
 	    {
-	      /* No changes, ignore the new route */
+	      /* No changes, ignore the new route but keep its unfiltered copy */
+	      rte *orig = old->orig;
+	      old->orig = new->orig;
+	      new->orig = orig;
 
 	      if (!rte_is_filtered(new))
 		{
@@ -996,6 +1072,8 @@ rte_recalculate(struct announce_hook *ah, net *net, rte *new, struct rte_src *sr
   if (old)
     rte_is_filtered(old) ? stats->filt_routes-- : stats->imp_routes--;
 
+  table->rt_count += !!new - !!old;
+
   if (table->config->sorted)
     {
       /* If routes are sorted, just insert new route to appropriate position */
@@ -1201,6 +1279,7 @@ rte_update2(struct announce_hook *ah, net *net, rte *new, struct rte_src *src)
   struct filter *filter = ah->in_filter;
   ea_list *tmpa = NULL;
   rte *dummy = NULL;
+  rte *orig = NULL;
 
   rte_update_lock();
   if (new)
@@ -1232,6 +1311,15 @@ rte_update2(struct announce_hook *ah, net *net, rte *new, struct rte_src *src)
 	  if (filter && (filter != FILTER_REJECT))
 	    {
 	      ea_list *old_tmpa = tmpa;
+
+	      /* Keep a copy before the filter for later reimport, see rt_reimport_start() */
+	      if (p->cf->roa_revalidate)
+		{
+		  if (!rta_is_cached(new->attrs))
+		    new->attrs = rta_lookup(new->attrs);
+		  orig = rte_do_cow(new);
+		}
+
 	      int fr = f_run(filter, &new, &tmpa, rte_update_pool, 0);
 	      if (fr > F_ACCEPT)
 		{
@@ -1250,6 +1338,7 @@ rte_update2(struct announce_hook *ah, net *net, rte *new, struct rte_src *src)
       if (!rta_is_cached(new->attrs)) /* Need to copy attributes */
 	new->attrs = rta_lookup(new->attrs);
       new->flags |= REF_COW;
+      new->orig = orig;
     }
   else
     {
@@ -1271,6 +1360,8 @@ rte_update2(struct announce_hook *ah, net *net, rte *new, struct rte_src *src)
   return;
 
  drop:
+  if (orig)
+    rte_free(orig);
   rte_free(new);
   new = NULL;
   goto recalc;
@@ -1385,6 +1476,237 @@ rt_refresh_end(rtable *t, struct announce_hook *ah)
     rt_schedule_prune(t);
 }
 
+static inline int
+rte_reimportable(rte *e)
+{
+  struct announce_hook *ah = e->sender;
+
+  return e->orig && ah && ah->proto->cf->roa_revalidate && (ah->proto->core_state == FS_HAPPY) &&
+    !(e->flags & (REF_STALE | REF_DISCARD));
+}
+
+static void
+rt_reimport_net(net *n)
+{
+  struct announce_hook **ahs;
+  rte *e, **copies;
+  int i, cnt = 0;
+
+  for (e = n->routes; e; e = e->next)
+    if (rte_reimportable(e))
+      cnt++;
+
+  if (!cnt)
+    return;
+
+  /* Routes are updated only after all copies are made, as updates change the list */
+  ahs = alloca(cnt * sizeof(struct announce_hook *));
+  copies = alloca(cnt * sizeof(rte *));
+
+  for (e = n->routes, i = 0; e; e = e->next)
+    if (rte_reimportable(e))
+    {
+      ahs[i] = e->sender;
+      copies[i] = rte_do_cow(e->orig);
+      i++;
+    }
+
+  for (i = 0; i < cnt; i++)
+    rte_update2(ahs[i], n, copies[i], copies[i]->attrs->src);
+}
+
+static void
+rt_reimport_init_prefix(struct rt_reimport *r)
+{
+  uint len = MIN(r->prefixes[r->pos].len, RT_INDEX_LEN);
+
+  /* Lookups of all buckets under a short prefix may cost more than a walk */
+  r->walk = ((u64) 2 << (RT_INDEX_LEN - len)) > r->table->index.entries;
+  r->len = len;
+  r->idx = 0;
+
+  if (r->walk)
+  {
+    FIB_ITERATE_INIT(&r->fit, &r->table->index);
+    r->fit_linked = 1;
+  }
+}
+
+static void
+rt_reimport_next_table(struct rt_reimport *r, node *n)
+{
+  rtable *old = r->table;
+
+  r->table = NODE_VALID(n) ? SKIP_BACK(rtable, n, n) : NULL;
+  r->fit_linked = 0;
+  r->pos = 0;
+
+  if (r->table)
+  {
+    rt_lock_table(r->table);
+
+    if (r->count)
+      rt_reimport_init_prefix(r);
+  }
+
+  /* May free the old table, but not the next one */
+  if (old)
+    rt_unlock_table(old);
+}
+
+static void
+rt_reimport_bucket(struct rt_index_node *b, struct prefix *px, uint *cnt)
+{
+  node *nn;
+
+  /* Networks are removed only by pruning of the table, new ones are appended */
+  WALK_LIST(nn, b->nets)
+  {
+    net *n = SKIP_BACK(net, index_n, nn);
+
+    if (n->routes && net_in_net(n->n.prefix, n->n.pxlen, px->addr, px->len))
+      rt_reimport_net(n);
+
+    (*cnt)++;
+  }
+}
+
+/**
+ * rt_reimport_start - start reimport of routes in covered networks
+ * @r: reimport state
+ * @prefixes: array of prefixes
+ * @count: number of prefixes in @prefixes
+ *
+ * This function starts a walk through all routing tables, which is done in
+ * steps by rt_reimport_step(). For each network covered by any of @prefixes
+ * (including the prefixes themselves), routes stored in the network are passed
+ * through their import filters again, as if they were received again from
+ * their protocols. It is used to revalidate routes after a change of data used
+ * by filters (e.g. ROA tables). Covered networks are found through the prefix
+ * index of each table (see rt_index_add()), so only their buckets are examined.
+ * The caller keeps @prefixes until the walk is finished or stopped. Networks
+ * covered by more prefixes may be reimported more times, so @prefixes should
+ * not overlap.
+ *
+ * Only routes from protocols with enabled &roa_revalidate option are
+ * reimported. For these protocols, rte_update2() keeps a copy of each route as
+ * it was before the import filter (&orig field of &rte) and the reimport
+ * starts from that copy, so the filter is never applied to its own output.
+ * Routes rejected by a filter earlier are available only when they are kept
+ * (&in_keep_filtered option).
+ *
+ * The table being walked is locked, so tables may be removed by
+ * reconfiguration between steps. Tables added during the walk may be skipped.
+ */
+void
+rt_reimport_start(struct rt_reimport *r, struct prefix *prefixes, uint count)
+{
+  r->table = NULL;
+  r->prefixes = prefixes;
+  r->count = count;
+  rt_reimport_next_table(r, HEAD(routing_tables));
+}
+
+/**
+ * rt_reimport_step - do next step of a reimport
+ * @r: reimport state
+ * @max: maximal number of networks and buckets to be examined
+ *
+ * This function continues the walk started by rt_reimport_start(). Examined
+ * networks, lookups of index buckets and reimported networks are counted to
+ * @max, a bucket is always finished. Returns 1 when all tables are done,
+ * 0 when it should be called again (e.g. from the next run of an event),
+ * so the main loop is not blocked by large tables.
+ */
+int
+rt_reimport_step(struct rt_reimport *r, uint max)
+{
+  uint cnt = 0;
+
+  while (r->table)
+  {
+    struct fib *index = &r->table->index;
+
+    while (r->pos < r->count)
+    {
+      struct prefix *px = &r->prefixes[r->pos];
+      uint len = MIN(px->len, RT_INDEX_LEN);
+      ip_addr base = ipa_and(px->addr, ipa_mkmask(len));
+
+      if (r->walk)
+      {
+      again:
+	r->fit_linked = 0;
+	FIB_ITERATE_START(index, &r->fit, fn)
+	  {
+	    if (cnt >= max)
+	    {
+	      FIB_ITERATE_PUT(&r->fit, fn);
+	      r->fit_linked = 1;
+	      return 0;
+	    }
+
+	    cnt++;
+	    if (net_in_net(fn->prefix, fn->pxlen, base, len))
+	    {
+	      /* Reimport may add buckets (e.g. through pipes), so we restart the iteration */
+	      FIB_ITERATE_PUT_NEXT(&r->fit, index, fn);
+	      r->fit_linked = 1;
+	      rt_reimport_bucket((struct rt_index_node *) fn, px, &cnt);
+	      goto again;
+	    }
+	  }
+	FIB_ITERATE_END(fn);
+      }
+      else
+      {
+	/* Buckets under the prefix, for each length up to RT_INDEX_LEN */
+	for (; r->len <= RT_INDEX_LEN; r->len++, r->idx = 0)
+	  for (; r->idx < (1U << (r->len - len)); r->idx++)
+	  {
+	    if (cnt >= max)
+	      return 0;
+
+	    ip_addr key = rt_index_key(base, r->len, r->idx);
+	    struct rt_index_node *b = fib_find(index, &key, r->len);
+
+	    cnt++;
+	    if (b)
+	      rt_reimport_bucket(b, px, &cnt);
+	  }
+      }
+
+      if (++r->pos < r->count)
+	rt_reimport_init_prefix(r);
+    }
+
+    rt_reimport_next_table(r, r->table->n.next);
+  }
+
+  return 1;
+}
+
+/**
+ * rt_reimport_stop - abort a reimport
+ * @r: reimport state
+ *
+ * This function stops an unfinished walk started by rt_reimport_start() and
+ * unlocks the table being walked. It does nothing if the walk is done.
+ */
+void
+rt_reimport_stop(struct rt_reimport *r)
+{
+  if (!r->table)
+    return;
+
+  if (r->fit_linked)
+    FIB_ITERATE_UNLINK(&r->fit, &r->table->index);
+
+  rt_unlock_table(r->table);
+  r->table = NULL;
+  r->fit_linked = 0;
+}
+
 
 /**
  * rte_dump - dump a route
@@ -1504,6 +1826,7 @@ again:
       if (!n->routes)		/* Orphaned FIB entry */
 	{
 	  FIB_ITERATE_PUT(&fit, f);
+	  rt_index_remove(tab, n);
 	  fib_delete(&tab->fib, f);
 	  ndel++;
 	  goto again;
@@ -1548,6 +1871,7 @@ rt_setup(pool *p, rtable *t, char *name, struct rtable_config *cf)
 {
   bzero(t, sizeof(*t));
   fib_init(&t->fib, p, sizeof(net), 0, rte_init);
+  fib_init(&t->index, p, sizeof(struct rt_index_node), 0, rt_index_init);
   t->name = name;
   t->config = cf;
   init_list(&t->hooks);
@@ -1620,6 +1944,7 @@ again:
       if (!n->routes)		/* Orphaned FIB entry */
 	{
 	  FIB_ITERATE_PUT(fit, fn);
+	  rt_index_remove(tab, n);
 	  fib_delete(&tab->fib, fn);
 	  goto again;
 	}
@@ -1718,7 +2043,7 @@ rta_apply_hostentry(rta *a, struct hostentry *he)
 }
 
 static inline rte *
-rt_next_hop_update_rte(rtable *tab UNUSED, rte *old)
+rt_next_hop_update_rte(rtable *tab, rte *old)
 {
   rta a;
   memcpy(&a, old->attrs, sizeof(rta));
@@ -1729,6 +2054,12 @@ rt_next_hop_update_rte(rtable *tab UNUSED, rte *old)
   memcpy(e, old, sizeof(rte));
   e->attrs = rta_lookup(&a);
 
+  /* The unfiltered copy is either updated too, or passed to the new rte */
+  if (old->orig && rta_next_hop_outdated(old->orig->attrs))
+    e->orig = rt_next_hop_update_rte(tab, old->orig);
+  else
+    old->orig = NULL;
+
   return e;
 }
 
@@ -1854,6 +2185,21 @@ rt_new_table(struct symbol *s)
   return c;
 }
 
+/**
+ * rt_memsize - get memory usage of a routing table
+ * @t: routing table
+ *
+ * This function returns the amount of memory used by networks and routes
+ * of the table. Routes of all tables share one slab, so their memory is
+ * accounted by the number of routes. Route attributes are shared between
+ * tables and they are not included.
+ */
+size_t
+rt_memsize(rtable *t)
+{
+  return fib_memsize(&t->fib) + fib_memsize(&t->index) + (size_t) t->rt_count * sizeof(rte);
+}
+
 /**
  * rt_lock_table - lock a routing table
  * @r: routing table to be locked
@@ -1888,6 +2234,7 @@ rt_unlock_table(rtable *r)
 	rt_free_hostcache(r);
       rem_node(&r->n);
       fib_free(&r->fib);
+      fib_free(&r->index);
       rfree(r->rt_event);
       mb_free(r);
       config_del_obstacle(conf);
@@ -2440,6 +2787,50 @@ rt_show_rte(struct cli *c, byte *ia, rte *e, struct rt_show_data *d, ea_list *tm
     rta_show(c, a, tmpa);
 }
 
+static const char *
+rt_dest_name(uint dest)
+{
+  switch (dest)
+    {
+    case RTD_ROUTER:	return "router";
+    case RTD_DEVICE:	return "device";
+    case RTD_BLACKHOLE:	return "blackhole";
+    case RTD_UNREACHABLE:	return "unreachable";
+    case RTD_PROHIBIT:	return "prohibited";
+    case RTD_MULTIPATH:	return "multipath";
+    default:		return "???";
+    }
+}
+
+/*
+ * Compact output is intended for scripts. There is one line for each route
+ * (or for each next hop of a multipath route) with tab-separated fields:
+ * network, destination type, gateway, interface, protocol, preference and
+ * a primary flag. Missing values are shown as '-'.
+ */
+static void
+rt_show_rte_compact(struct cli *c, rte *e)
+{
+  rta *a = e->attrs;
+  net *n = e->net;
+  int primary = (n->routes == e);
+  struct mpnh *nh;
+
+  if (a->dest == RTD_MULTIPATH)
+    for (nh = a->nexthops; nh; nh = nh->next)
+      cli_printf(c, -1007, "%I/%d\t%s\t%I\t%s\t%s\t%d\t%d", n->n.prefix, n->n.pxlen,
+		 rt_dest_name(a->dest), nh->gw, nh->iface->name, a->src->proto->name,
+		 e->pref, primary);
+  else if (a->dest == RTD_ROUTER)
+    cli_printf(c, -1007, "%I/%d\t%s\t%I\t%s\t%s\t%d\t%d", n->n.prefix, n->n.pxlen,
+	       rt_dest_name(a->dest), a->gw, a->iface->name, a->src->proto->name,
+	       e->pref, primary);
+  else
+    cli_printf(c, -1007, "%I/%d\t%s\t-\t%s\t%s\t%d\t%d", n->n.prefix, n->n.pxlen,
+	       rt_dest_name(a->dest), a->iface ? a->iface->name : "-", a->src->proto->name,
+	       e->pref, primary);
+}
+
 static void
 rt_show_net(struct cli *c, net *n, struct rt_show_data *d)
 {
@@ -2450,18 +2841,19 @@ rt_show_net(struct cli *c, net *n, struct rt_show_data *d)
   int first = 1;
   int pass = 0;
 
-  bsprintf(ia, "%I/%d", n->n.prefix, n->n.pxlen);
-
   if (d->export_mode)
     {
       if (! d->export_protocol->rt_notify)
 	return;
 
-      a = proto_find_announce_hook(d->export_protocol, d->table);
+      a = d->export_ahook;
       if (!a)
 	return;
     }
 
+  if (!d->compact)
+    bsprintf(ia, "%I/%d", n->n.prefix, n->n.pxlen);
+
   for (e = n->routes; e; e = e->next)
     {
       if (rte_is_filtered(e) != d->filtered)
@@ -2525,7 +2917,13 @@ rt_show_net(struct cli *c, net *n, struct rt_show_data *d)
 	goto skip;
 
       d->show_counter++;
-      if (d->stats < 2)
+      if (d->stats == 2)
+	;
+      else if (d->binary)
+	rt_show_rte_binary(c, e, tmpa);
+      else if (d->compact)
+	rt_show_rte_compact(c, e);
+      else
 	rt_show_rte(c, ia, e, d, tmpa);
       ia[0] = 0;
 
@@ -2542,17 +2940,34 @@ rt_show_net(struct cli *c, net *n, struct rt_show_data *d)
     }
 }
 
+#ifdef DEBUGGING
+#define RT_SHOW_BATCH_MIN	4
+#else
+#define RT_SHOW_BATCH_MIN	64
+#endif
+#define RT_SHOW_BATCH_MAX	4096
+
+static inline void
+rt_show_get_ahook(struct rt_show_data *d)
+{
+  /* Announce hook may change between batches if the protocol is restarted */
+  if (d->export_mode)
+    d->export_ahook = proto_find_announce_hook(d->export_protocol, d->table);
+}
+
 static void
 rt_show_cont(struct cli *c)
 {
   struct rt_show_data *d = c->rover;
-#ifdef DEBUGGING
-  unsigned max = 4;
-#else
-  unsigned max = 64;
-#endif
   struct fib *fib = &d->table->fib;
   struct fib_iterator *it = &d->fit;
+  uint max;
+
+  /* Number of networks in one batch depends on how fast the client reads */
+  d->batch = cli_batch_size(c, d->batch, RT_SHOW_BATCH_MIN, RT_SHOW_BATCH_MAX);
+  max = d->batch;
+
+  rt_show_get_ahook(d);
 
   FIB_ITERATE_START(fib, it, f)
     {
@@ -2621,7 +3036,10 @@ rt_show(struct rt_show_data *d)
 	n = net_find(d->table, d->prefix, d->pxlen);
 
       if (n)
-	rt_show_net(this_cli, n, d);
+	{
+	  rt_show_get_ahook(d);
+	  rt_show_net(this_cli, n, d);
+	}
 
       if (d->rt_counter)
 	cli_msg(0, "");
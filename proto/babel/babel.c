@@ -66,6 +66,105 @@ static inline void babel_iface_kick_timer(struct babel_iface *ifa);
  *	Functions to maintain data structures
  */
 
+/*
+ * Routes and sources of all entries are indexed by protocol-wide hash tables,
+ * so they can be found without walking per-entry lists, which may be long with
+ * many neighbors. Their expiration is driven by timer wheels (see
+ * babel_wheel_put()), so the periodic timer does not have to walk all entries.
+ */
+
+static inline u32
+babel_ptr_hash(const void *ptr)
+{
+  u64 v = (uintptr_t) ptr;
+  return u32_hash((u32) (v ^ (v >> 32)));
+}
+
+#define RTH_KEY(r)		r->e, r->neigh
+#define RTH_NEXT(r)		r->next_hash
+#define RTH_EQ(e1,n1,e2,n2)	e1 == e2 && n1 == n2
+#define RTH_FN(e,n)		babel_ptr_hash(e) ^ u32_hash(babel_ptr_hash(n))
+
+#define RTH_REHASH		babel_rth_rehash
+#define RTH_PARAMS		/8, *2, 2, 2, 8, 20
+
+HASH_DEFINE_REHASH_FN(RTH, struct babel_route)
+
+#define SRH_KEY(s)		s->e, s->router_id
+#define SRH_NEXT(s)		s->next_hash
+#define SRH_EQ(e1,i1,e2,i2)	e1 == e2 && i1 == i2
+#define SRH_FN(e,i)		babel_ptr_hash(e) ^ u32_hash((u32) ((i) ^ ((i) >> 32)))
+
+#define SRH_REHASH		babel_srh_rehash
+#define SRH_PARAMS		/8, *2, 2, 2, 8, 20
+
+HASH_DEFINE_REHASH_FN(SRH, struct babel_source)
+
+
+static void
+babel_wheel_init(struct babel_wheel *w)
+{
+  int i;
+
+  for (i = 0; i < BABEL_WHEEL_SIZE; i++)
+    init_list(&w->slots[i]);
+
+  w->time = now;
+}
+
+/*
+ * Nodes are scheduled lazily - when the time of a scheduled node is
+ * postponed, the node stays in its slot and it is rescheduled by its owner
+ * after the slot is processed. Only when the time is advanced, the node is
+ * moved. Times more than %BABEL_WHEEL_SIZE seconds ahead are just checked
+ * again after each turn of the wheel.
+ */
+static void
+babel_wheel_put(struct babel_wheel *w, struct babel_wheel_node *wn, bird_clock_t time)
+{
+  if (wn->time && (wn->time <= time))
+    return;
+
+  if (wn->time)
+    rem_node(&wn->n);
+
+  wn->time = MAX(time, w->time + 1);
+  add_tail(&w->slots[wn->time % BABEL_WHEEL_SIZE], &wn->n);
+}
+
+static inline void
+babel_wheel_remove(struct babel_wheel_node *wn)
+{
+  if (!wn->time)
+    return;
+
+  rem_node(&wn->n);
+  wn->time = 0;
+}
+
+/*
+ * Move nodes scheduled up to now to the list @due. They stay scheduled, so
+ * they may be removed from it by babel_wheel_remove() while it is processed.
+ */
+static void
+babel_wheel_collect(struct babel_wheel *w, list *due)
+{
+  struct babel_wheel_node *wn, *wnx;
+  bird_clock_t t;
+
+  init_list(due);
+
+  for (t = w->time + 1; (t <= now) && (t <= w->time + BABEL_WHEEL_SIZE); t++)
+    WALK_LIST_DELSAFE(wn, wnx, w->slots[t % BABEL_WHEEL_SIZE])
+      if (wn->time <= now)
+      {
+	rem_node(&wn->n);
+	add_tail(due, &wn->n);
+      }
+
+  w->time = now;
+}
+
 static void
 babel_init_entry(struct fib_node *n)
 {
@@ -92,16 +191,31 @@ babel_get_entry(struct babel_proto *p, ip_addr prefix, u8 plen)
   return e;
 }
 
+/* Remove entry without routes and sources */
+static void
+babel_check_entry(struct babel_entry *e)
+{
+  struct babel_proto *p = e->proto;
+
+  if (EMPTY_LIST(e->sources) && EMPTY_LIST(e->routes))
+    fib_delete(&p->rtable, e);
+}
+
 static struct babel_source *
 babel_find_source(struct babel_entry *e, u64 router_id)
 {
-  struct babel_source *s;
+  struct babel_proto *p = e->proto;
 
-  WALK_LIST(s, e->sources)
-    if (s->router_id == router_id)
-      return s;
+  return HASH_FIND(p->source_hash, SRH, e, router_id);
+}
 
-  return NULL;
+static inline void
+babel_schedule_source(struct babel_source *s)
+{
+  struct babel_proto *p = s->e->proto;
+
+  if (s->expires)
+    babel_wheel_put(&p->source_wheel, &s->wheel, s->expires);
 }
 
 static struct babel_source *
@@ -114,41 +228,68 @@ babel_get_source(struct babel_entry *e, u64 router_id)
     return s;
 
   s = sl_alloc(p->source_slab);
+  memset(s, 0, sizeof(*s));
+  s->e = e;
   s->router_id = router_id;
   s->expires = now + BABEL_GARBAGE_INTERVAL;
   s->seqno = 0;
   s->metric = BABEL_INFINITY;
   add_tail(&e->sources, NODE s);
+  HASH_INSERT2(p->source_hash, SRH, p->p.pool, s);
+  babel_schedule_source(s);
 
   return s;
 }
 
 static void
-babel_expire_sources(struct babel_entry *e)
+babel_expire_sources(struct babel_proto *p)
 {
-  struct babel_proto *p = e->proto;
-  struct babel_source *n, *nx;
+  struct babel_source *s;
+  struct babel_entry *e;
+  list due;
+  node *n;
+
+  babel_wheel_collect(&p->source_wheel, &due);
 
-  WALK_LIST_DELSAFE(n, nx, e->sources)
+  WALK_LIST_FIRST(n, due)
   {
-    if (n->expires && n->expires <= now)
+    s = SKIP_BACK(struct babel_source, wheel.n, n);
+    babel_wheel_remove(&s->wheel);
+
+    if (!s->expires || (s->expires > now))
     {
-      rem_node(NODE n);
-      sl_free(p->source_slab, n);
+      babel_schedule_source(s);
+      continue;
     }
+
+    e = s->e;
+    rem_node(NODE s);
+    HASH_REMOVE2(p->source_hash, SRH, p->p.pool, s);
+    sl_free(p->source_slab, s);
+
+    babel_check_entry(e);
   }
 }
 
 static struct babel_route *
 babel_find_route(struct babel_entry *e, struct babel_neighbor *n)
 {
-  struct babel_route *r;
+  struct babel_proto *p = e->proto;
 
-  WALK_LIST(r, e->routes)
-    if (r->neigh == n)
-      return r;
+  return HASH_FIND(p->route_hash, RTH, e, n);
+}
 
-  return NULL;
+static inline void
+babel_schedule_route(struct babel_route *r)
+{
+  struct babel_proto *p = r->e->proto;
+  bird_clock_t time = r->expires;
+
+  if (r->refresh_time && (!time || (r->refresh_time < time)))
+    time = r->refresh_time;
+
+  if (time)
+    babel_wheel_put(&p->route_wheel, &r->wheel, time);
 }
 
 static struct babel_route *
@@ -172,6 +313,9 @@ babel_get_route(struct babel_entry *e, struct babel_neighbor *nbr)
     add_tail(&nbr->routes, NODE &r->neigh_route);
   }
 
+  HASH_INSERT2(p->route_hash, RTH, p->p.pool, r);
+  babel_schedule_route(r);
+
   return r;
 }
 
@@ -184,6 +328,8 @@ babel_flush_route(struct babel_route *r)
       r->e->n.prefix, r->e->n.pxlen, r->router_id, r->neigh ? r->neigh->addr : IPA_NONE);
 
   rem_node(NODE r);
+  HASH_REMOVE2(p->route_hash, RTH, p->p.pool, r);
+  babel_wheel_remove(&r->wheel);
 
   if (r->neigh)
     rem_node(&r->neigh_route);
@@ -210,6 +356,7 @@ babel_expire_route(struct babel_route *r)
   {
     r->metric = BABEL_INFINITY;
     r->expires = now + r->expiry_interval;
+    babel_schedule_route(r);
   }
   else
   {
@@ -229,54 +376,37 @@ babel_refresh_route(struct babel_route *r)
 static void
 babel_expire_routes(struct babel_proto *p)
 {
+  struct babel_route *r;
   struct babel_entry *e;
-  struct babel_route *r, *rx;
-  struct fib_iterator fit;
+  list due;
+  node *n;
 
-  FIB_ITERATE_INIT(&fit, &p->rtable);
+  babel_wheel_collect(&p->route_wheel, &due);
 
-loop:
-  FIB_ITERATE_START(&p->rtable, &fit, n)
+  /*
+   * Routes in the due list may be flushed or rescheduled during processing of
+   * other routes, because of a cascade of synchronous events
+   * babel_select_route() -> nest table change -> babel_rt_notify(). That is
+   * safe as flushed routes are removed from the list by babel_flush_route().
+   */
+  WALK_LIST_FIRST(n, due)
   {
-    e = (struct babel_entry *) n;
-    int changed = 0;
+    r = SKIP_BACK(struct babel_route, wheel.n, n);
+    babel_wheel_remove(&r->wheel);
+    e = r->e;
 
-    WALK_LIST_DELSAFE(r, rx, e->routes)
-    {
-      if (r->refresh_time && r->refresh_time <= now)
-	babel_refresh_route(r);
+    if (r->refresh_time && r->refresh_time <= now)
+      babel_refresh_route(r);
 
-      if (r->expires && r->expires <= now)
-      {
-	babel_expire_route(r);
-	changed = 1;
-      }
-    }
-
-    if (changed)
+    if (r->expires && r->expires <= now)
     {
-      /*
-       * We have to restart the iteration because there may be a cascade of
-       * synchronous events babel_select_route() -> nest table change ->
-       * babel_rt_notify() -> p->rtable change, invalidating hidden variables.
-       */
-
-      FIB_ITERATE_PUT(&fit, n);
+      babel_expire_route(r);
       babel_select_route(e);
-      goto loop;
-    }
-
-    babel_expire_sources(e);
-
-    /* Remove empty entries */
-    if (EMPTY_LIST(e->sources) && EMPTY_LIST(e->routes))
-    {
-      FIB_ITERATE_PUT(&fit, n);
-      fib_delete(&p->rtable, e);
-      goto loop;
+      babel_check_entry(e);
     }
+    else
+      babel_schedule_route(r);
   }
-  FIB_ITERATE_END(n);
 }
 
 static struct babel_neighbor *
@@ -327,6 +457,8 @@ babel_flush_neighbor(struct babel_neighbor *nbr)
 
     if (selected)
       babel_select_route(e);
+
+    babel_check_entry(e);
   }
 
   rem_node(NODE nbr);
@@ -795,6 +927,7 @@ babel_send_update(struct babel_iface *ifa, bird_clock_t changed)
     {
       struct babel_source *s = babel_get_source(e, r->router_id);
       s->expires = now + BABEL_GARBAGE_INTERVAL;
+      babel_schedule_source(s);
 
       if ((msg.update.seqno > s->seqno) ||
 	  ((msg.update.seqno == s->seqno) && (msg.update.metric < s->metric)))
@@ -1167,7 +1300,10 @@ babel_handle_update(union babel_msg *m, struct babel_iface *ifa)
   if (!r)
   {
     if (!feasible)
+    {
+      babel_check_entry(e);
       return;
+    }
 
     r = babel_get_route(e, nbr);
     r->advert_metric = msg->metric;
@@ -1204,6 +1340,7 @@ babel_handle_update(union babel_msg *m, struct babel_iface *ifa)
     r->expires = now + r->expiry_interval;
     if (r->expiry_interval > BABEL_ROUTE_REFRESH_INTERVAL)
       r->refresh_time = now + r->expiry_interval - BABEL_ROUTE_REFRESH_INTERVAL;
+    babel_schedule_route(r);
 
     /* If the route is not feasible at this point, it means it is from another
        neighbour than the one currently selected; so send a unicast seqno
@@ -1400,6 +1537,7 @@ babel_iface_stop(struct babel_iface *ifa)
       r = SKIP_BACK(struct babel_route, neigh_route, n);
       r->metric = BABEL_INFINITY;
       r->expires = now + r->expiry_interval;
+      babel_schedule_route(r);
       babel_select_route(r->e);
     }
   }
@@ -1897,6 +2035,7 @@ babel_timer(timer *t)
   struct babel_proto *p = t->data;
 
   babel_expire_routes(p);
+  babel_expire_sources(p);
   babel_expire_seqno_requests(p);
   babel_expire_neighbors(p);
 }
@@ -2009,6 +2148,7 @@ babel_rt_notify(struct proto *P, struct rtable *table UNUSED, struct network *ne
        */
       e->selected_out->metric = BABEL_INFINITY;
       e->selected_out->expires = now + BABEL_HOLD_TIME;
+      babel_schedule_route(e->selected_out);
       e->updated = now;
       babel_trigger_update(p);
     }
@@ -2077,6 +2217,10 @@ babel_start(struct proto *P)
 
   p->route_slab = sl_new(P->pool, sizeof(struct babel_route));
   p->source_slab = sl_new(P->pool, sizeof(struct babel_source));
+  HASH_INIT(p->route_hash, P->pool, 8);
+  HASH_INIT(p->source_hash, P->pool, 8);
+  babel_wheel_init(&p->route_wheel);
+  babel_wheel_init(&p->source_wheel);
   p->msg_slab = sl_new(P->pool, sizeof(struct babel_msg_node));
   p->seqno_slab = sl_new(P->pool, sizeof(struct babel_seqno_request));
   init_list(&p->seqno_cache);
@@ -19,6 +19,7 @@
 #include "nest/locks.h"
 #include "lib/resource.h"
 #include "lib/lists.h"
+#include "lib/hash.h"
 #include "lib/socket.h"
 #include "lib/string.h"
 #include "lib/timer.h"
@@ -52,6 +53,7 @@
 #define BABEL_TIME_UNITS		100	/* On-wire times are counted in centiseconds */
 #define BABEL_SEQNO_REQUEST_EXPIRY	60
 #define BABEL_GARBAGE_INTERVAL		300
+#define BABEL_WHEEL_SIZE		64	/* Slots (seconds) of expiry timer wheels */
 
 /* Max interval that will not overflow when carried as 16-bit centiseconds */
 #define BABEL_MAX_INTERVAL		(0xFFFF/BABEL_TIME_UNITS)
@@ -122,10 +124,28 @@ struct babel_iface_config {
   int tx_priority;
 };
 
+/*
+ * Timer wheel used for expiration of routes and sources. Nodes are kept in
+ * slots by their scheduled time modulo %BABEL_WHEEL_SIZE, see babel_wheel_put().
+ */
+struct babel_wheel_node {
+  node n;
+  bird_clock_t time;			/* Scheduled time, 0 if not scheduled */
+};
+
+struct babel_wheel {
+  list slots[BABEL_WHEEL_SIZE];
+  bird_clock_t time;			/* All slots up to this time were processed */
+};
+
 struct babel_proto {
   struct proto p;
   timer *timer;
   struct fib rtable;
+  HASH(struct babel_route) route_hash;	/* Routes indexed by (entry, neighbor) */
+  HASH(struct babel_source) source_hash; /* Sources indexed by (entry, router ID) */
+  struct babel_wheel route_wheel;	/* Expiry and refresh of routes */
+  struct babel_wheel source_wheel;	/* Expiry of sources */
   list interfaces;			/* Interfaces we really know about (struct babel_iface) */
   u64 router_id;
   u16 update_seqno;			/* To be increased on request */
@@ -188,6 +208,9 @@ struct babel_neighbor {
 
 struct babel_source {
   node n;
+  struct babel_entry *e;
+  struct babel_source *next_hash;
+  struct babel_wheel_node wheel;
 
   u64 router_id;
   u16 seqno;
@@ -200,6 +223,8 @@ struct babel_route {
   node neigh_route;
   struct babel_entry    *e;
   struct babel_neighbor *neigh;
+  struct babel_route *next_hash;
+  struct babel_wheel_node wheel;
 
   u16 seqno;
   u16 advert_metric;
@@ -23,6 +23,7 @@
 #include "lib/resource.h"
 #include "lib/event.h"
 #include "lib/socket.h"
+#include "lib/unix.h"
 
 
 struct birdloop
@@ -173,58 +174,6 @@ current_time(void)
  *	Wakeup code for birdloop
  */
 
-static void
-pipe_new(int *pfds)
-{
-  int rv = pipe(pfds);
-  if (rv < 0)
-    die("pipe: %m");
-
-  if (fcntl(pfds[0], F_SETFL, O_NONBLOCK) < 0)
-    die("fcntl(O_NONBLOCK): %m");
-
-  if (fcntl(pfds[1], F_SETFL, O_NONBLOCK) < 0)
-    die("fcntl(O_NONBLOCK): %m");
-}
-
-void
-pipe_drain(int fd)
-{
-  char buf[64];
-  int rv;
-  
- try:
-  rv = read(fd, buf, 64);
-  if (rv < 0)
-  {
-    if (errno == EINTR)
-      goto try;
-    if (errno == EAGAIN)
-      return;
-    die("wakeup read: %m");
-  }
-  if (rv == 64)
-    goto try;
-}
-
-void
-pipe_kick(int fd)
-{
-  u64 v = 1;
-  int rv;
-
- try:
-  rv = write(fd, &v, sizeof(u64));
-  if (rv < 0)
-  {
-    if (errno == EINTR)
-      goto try;
-    if (errno == EAGAIN)
-      return;
-    die("wakeup write: %m");
-  }
-}
-
 static inline void
 wakeup_init(struct birdloop *loop)
 {
@@ -579,6 +528,15 @@ sockets_close_fds(struct birdloop *loop)
 int sk_read(sock *s, int revents);
 int sk_write(sock *s);
 
+static void
+sockets_flush(struct birdloop *loop)
+{
+  node *n;
+
+  WALK_LIST(n, loop->sock_list)
+    sk_flush(SKIP_BACK(sock, n, n));
+}
+
 static void
 sockets_fire(struct birdloop *loop)
 {
@@ -729,6 +687,8 @@ birdloop_main(void *arg)
     else
       timeout = -1;
 
+    sockets_flush(loop);
+
     if (loop->poll_changed)
       sockets_prepare(loop);
 
@@ -419,7 +419,7 @@ bfd_open_rx_sk(struct bfd_proto *p, int multihop)
   /* TODO: configurable ToS and priority */
   sk->tos = IP_PREC_INTERNET_CONTROL;
   sk->priority = sk_priority_control;
-  sk->flags = SKF_THREAD | SKF_LADDR_RX | (!multihop ? SKF_TTL_RX : 0);
+  sk->flags = SKF_THREAD | SKF_LADDR_RX | SKF_BATCH_RX | (!multihop ? SKF_TTL_RX : 0);
 
 #ifdef IPV6
   sk->flags |= SKF_V6ONLY;
@@ -454,7 +454,7 @@ bfd_open_tx_sk(struct bfd_proto *p, ip_addr local, struct iface *ifa)
   sk->tos = IP_PREC_INTERNET_CONTROL;
   sk->priority = sk_priority_control;
   sk->ttl = ifa ? 255 : -1;
-  sk->flags = SKF_THREAD | SKF_BIND | SKF_HIGH_PORT;
+  sk->flags = SKF_THREAD | SKF_BIND | SKF_HIGH_PORT | SKF_BATCH_TX;
 
 #ifdef IPV6
   sk->flags |= SKF_V6ONLY;
@@ -61,10 +61,27 @@
  * point of view and therefore maintaining received routes. Routing table
  * refresh cycle (rt_refresh_begin(), rt_refresh_end()) is used for removing
  * stale routes after reestablishment of BGP session during graceful restart.
+ *
+ * When POSIX threads are available, connections in OpenConfirm and Established
+ * states are also registered to a small keepalive thread. If the main loop is
+ * stalled (e.g. by a slow table or filter) and no message was sent for more
+ * than the keepalive time, the thread writes a KEEPALIVE directly to the socket,
+ * so the neighbor does not drop the session due to hold timer expiration. All
+ * writes to BGP sockets go through bgp_sk_send() and are serialized with the
+ * keepalive thread by a per-connection mutex. The thread writes only on message
+ * boundaries, when no partially sent data are pending in the socket buffer
+ * (these are finished by the main loop without the mutex, see bgp_sk_sent()),
+ * and it never blocks: a connection busy in the main loop is skipped.
  */
 
 #undef LOCAL_DEBUG
 
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "nest/bird.h"
 #include "nest/iface.h"
 #include "nest/protocol.h"
@@ -88,6 +105,9 @@ static void bgp_connect(struct bgp_proto *p);
 static void bgp_active(struct bgp_proto *p);
 static sock *bgp_setup_listen_sk(ip_addr addr, unsigned port, u32 flags);
 static void bgp_update_bfd(struct bgp_proto *p, int use_bfd);
+static void bgp_ka_init_conn(struct bgp_conn *conn);
+static void bgp_ka_register(struct bgp_conn *conn);
+static void bgp_ka_unregister(struct bgp_conn *conn);
 
 
 /**
@@ -240,6 +260,7 @@ bgp_close_conn(struct bgp_conn *conn)
   // struct bgp_proto *p = conn->bgp;
 
   DBG("BGP: Closing connection\n");
+  bgp_ka_unregister(conn);
   conn->packets_to_send = 0;
   rfree(conn->connect_retry_timer);
   conn->connect_retry_timer = NULL;
@@ -254,6 +275,255 @@ bgp_close_conn(struct bgp_conn *conn)
 }
 
 
+/*
+ *	Keepalive thread
+ */
+
+#ifdef USE_PTHREADS
+
+#define BGP_KA_PERIOD	(250 MS)	/* How often the keepalive thread checks connections */
+#define BGP_KA_SLACK	(1 S)		/* Grace period for the main loop to send keepalive itself */
+
+static pthread_mutex_t bgp_ka_lock;	/* Protects bgp_ka_list, never held while blocking */
+static pthread_t bgp_ka_thread;
+static list bgp_ka_list;		/* Registered connections (bgp_conn->ka_node) */
+static int bgp_ka_running;
+
+static const byte bgp_ka_packet[BGP_HEADER_LENGTH] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0, BGP_HEADER_LENGTH, PKT_KEEPALIVE
+};
+
+static inline btime
+bgp_ka_time(void)
+{
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+    return 0;
+
+  return ((s64) ts.tv_sec S) + (ts.tv_nsec / 1000);
+}
+
+/*
+ * Write the rest of a keepalive started by the keepalive thread, without
+ * blocking. Returns 1 when the keepalive is complete, 0 if the socket is full
+ * and -1 on error. Called with conn->tx_lock held.
+ */
+static int
+bgp_ka_write(struct bgp_conn *conn)
+{
+  while (conn->ka_left)
+  {
+    const byte *pos = bgp_ka_packet + BGP_HEADER_LENGTH - conn->ka_left;
+    int e = write(conn->sk->fd, pos, conn->ka_left);
+
+    if (e < 0)
+    {
+      if (errno == EINTR)
+	continue;
+
+      return (errno == EAGAIN) ? 0 : -1;
+    }
+
+    conn->ka_left -= e;
+  }
+
+  return 1;
+}
+
+static void
+bgp_ka_send(struct bgp_conn *conn, btime now)
+{
+  struct pollfd pfd = { .fd = conn->sk->fd, .events = POLLOUT };
+
+  /* The main loop has partially sent data in the socket, it will finish them */
+  if (conn->tx_pending)
+    return;
+
+  if (!conn->ka_left)
+  {
+    if ((poll(&pfd, 1, 0) <= 0) || !(pfd.revents & POLLOUT))
+      return;
+
+    conn->ka_left = BGP_HEADER_LENGTH;
+  }
+
+  /*
+   * An unfinished keepalive is kept in conn->ka_left and completed on the next
+   * run, or passed by bgp_sk_send() to the main loop in front of the next
+   * message. Errors are left to the main loop.
+   */
+  if (bgp_ka_write(conn) > 0)
+    conn->last_tx = now;
+}
+
+static void *
+bgp_ka_main(void *arg UNUSED)
+{
+  struct bgp_conn *conn;
+  node *n;
+  btime now;
+
+  for (;;)
+  {
+    usleep(BGP_KA_PERIOD);
+    now = bgp_ka_time();
+
+    pthread_mutex_lock(&bgp_ka_lock);
+    WALK_LIST(n, bgp_ka_list)
+    {
+      conn = SKIP_BACK(struct bgp_conn, ka_node, n);
+
+      /* Connection busy in the main loop is not stalled, skip it */
+      if (pthread_mutex_trylock(&conn->tx_lock))
+	continue;
+
+      if (conn->ka_left || (conn->keepalive_time &&
+	  (now - conn->last_tx) >= (((btime) conn->keepalive_time S) + BGP_KA_SLACK)))
+	bgp_ka_send(conn, now);
+
+      pthread_mutex_unlock(&conn->tx_lock);
+    }
+    pthread_mutex_unlock(&bgp_ka_lock);
+  }
+
+  return NULL;
+}
+
+static void
+bgp_ka_start(void)
+{
+  int rv;
+
+  pthread_mutex_init(&bgp_ka_lock, NULL);
+  init_list(&bgp_ka_list);
+  bgp_ka_running = 1;
+
+  rv = pthread_create(&bgp_ka_thread, NULL, bgp_ka_main, NULL);
+  if (rv)
+    die("pthread_create(): %M", rv);
+}
+
+static void
+bgp_ka_init_conn(struct bgp_conn *conn)
+{
+  pthread_mutexattr_t attr;
+
+  /* Recursive, as socket error hooks may close the connection from bgp_sk_send() */
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&conn->tx_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+static void
+bgp_ka_register(struct bgp_conn *conn)
+{
+  if (!bgp_ka_running)
+    bgp_ka_start();
+
+  pthread_mutex_lock(&conn->tx_lock);
+  conn->last_tx = bgp_ka_time();
+  pthread_mutex_unlock(&conn->tx_lock);
+
+  pthread_mutex_lock(&bgp_ka_lock);
+  if (!conn->ka_node.next)
+    add_tail(&bgp_ka_list, &conn->ka_node);
+  pthread_mutex_unlock(&bgp_ka_lock);
+}
+
+static void
+bgp_ka_unregister(struct bgp_conn *conn)
+{
+  if (!conn->ka_node.next)
+    return;
+
+  pthread_mutex_lock(&bgp_ka_lock);
+  rem_node(&conn->ka_node);
+  conn->ka_node.next = conn->ka_node.prev = NULL;
+  pthread_mutex_unlock(&bgp_ka_lock);
+}
+
+/**
+ * bgp_sk_send - send a message on BGP connection
+ * @conn: connection
+ * @len: message length
+ *
+ * This function sends @len bytes from the socket transmit buffer,
+ * serialized with the keepalive thread. See sk_send() for the
+ * meaning of return values.
+ */
+int
+bgp_sk_send(struct bgp_conn *conn, uint len)
+{
+  sock *sk = conn->sk;
+  int rv;
+
+  pthread_mutex_lock(&conn->tx_lock);
+
+  /*
+   * The keepalive thread could not finish its keepalive. The rest must be sent
+   * before the message to keep the stream consistent, so when the socket is
+   * still full, it is put in front of the message in the TX buffer (there is
+   * room for it, see BGP_TX_BUFFER_SIZE) and sent by the main loop with it.
+   * Write errors are reported by sk_send() below.
+   */
+  if (conn->ka_left && !bgp_ka_write(conn))
+  {
+    uint left = conn->ka_left;
+
+    memmove(sk->tbuf + left, sk->tbuf, len);
+    memcpy(sk->tbuf, bgp_ka_packet + BGP_HEADER_LENGTH - left, left);
+    len += left;
+  }
+  conn->ka_left = 0;
+
+  conn->last_tx = bgp_ka_time();
+  rv = sk_send(sk, len);
+  conn->tx_pending = (rv == 0);
+  pthread_mutex_unlock(&conn->tx_lock);
+
+  return rv;
+}
+
+/**
+ * bgp_sk_sent - notify that pending data were sent
+ * @conn: connection
+ *
+ * This function is called from the socket TX hook when data left in the socket
+ * buffer by bgp_sk_send() were sent by the main loop. Until then, the keepalive
+ * thread must not write to the socket.
+ */
+void
+bgp_sk_sent(struct bgp_conn *conn)
+{
+  pthread_mutex_lock(&conn->tx_lock);
+  conn->tx_pending = 0;
+  pthread_mutex_unlock(&conn->tx_lock);
+}
+
+#else
+
+static inline void bgp_ka_init_conn(struct bgp_conn *conn UNUSED) { }
+static inline void bgp_ka_register(struct bgp_conn *conn UNUSED) { }
+static inline void bgp_ka_unregister(struct bgp_conn *conn UNUSED) { }
+
+void
+bgp_sk_sent(struct bgp_conn *conn UNUSED)
+{
+}
+
+int
+bgp_sk_send(struct bgp_conn *conn, uint len)
+{
+  return sk_send(conn->sk, len);
+}
+
+#endif
+
+
 /**
  * bgp_update_startup_delay - update a startup delay
  * @p: BGP instance
@@ -362,6 +632,7 @@ bgp_conn_enter_openconfirm_state(struct bgp_conn *conn)
 {
   /* Really, most of the work is done in bgp_rx_open(). */
   bgp_conn_set_state(conn, BS_OPENCONFIRM);
+  bgp_ka_register(conn);
 }
 
 void
@@ -430,6 +701,7 @@ bgp_conn_enter_close_state(struct bgp_conn *conn)
   int os = conn->state;
 
   bgp_conn_set_state(conn, BS_CLOSE);
+  bgp_ka_unregister(conn);
   tm_stop(conn->keepalive_timer);
   conn->sk->rx_hook = NULL;
 
@@ -687,6 +959,8 @@ bgp_setup_conn(struct bgp_proto *p, struct bgp_conn *conn)
   conn->sk = NULL;
   conn->bgp = p;
   conn->packets_to_send = 0;
+  conn->tx_pending = 0;
+  conn->ka_left = 0;
 
   t = conn->connect_retry_timer = tm_new(p->p.pool);
   t->hook = bgp_connect_timeout;
@@ -1305,6 +1579,8 @@ bgp_init(struct proto_config *C)
   p->rs_client = c->rs_client;
   p->rr_client = c->rr_client;
   p->igp_table = get_igp_table(c);
+  bgp_ka_init_conn(&p->outgoing_conn);
+  bgp_ka_init_conn(&p->incoming_conn);
 
   return P;
 }
@@ -10,6 +10,9 @@
 #define _BIRD_BGP_H_
 
 #include <stdint.h>
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
 #include "nest/route.h"
 #include "nest/bfd.h"
 #include "lib/hash.h"
@@ -115,6 +118,13 @@ struct bgp_conn {
   u8 peer_gr_aflags;
   u8 peer_ext_messages_support;		/* Peer supports extended message length [draft] */
   unsigned hold_time, keepalive_time;	/* Times calculated from my and neighbor's requirements */
+#ifdef USE_PTHREADS
+  pthread_mutex_t tx_lock;		/* Serializes socket writes with the keepalive thread */
+#endif
+  node ka_node;				/* Node in keepalive thread list, protected by bgp_ka_lock */
+  btime last_tx;			/* Monotonic time of last sent message, protected by tx_lock */
+  u8 tx_pending;			/* Main loop has unsent data in socket buffer, protected by tx_lock */
+  u8 ka_left;				/* Unsent bytes of keepalive from the thread, protected by tx_lock */
 };
 
 struct bgp_proto {
@@ -189,9 +199,9 @@ struct bgp_bucket {
 #define BGP_MAX_MESSAGE_LENGTH	4096
 #define BGP_MAX_EXT_MSG_LENGTH	65535
 #define BGP_RX_BUFFER_SIZE	4096
-#define BGP_TX_BUFFER_SIZE	4096
+#define BGP_TX_BUFFER_SIZE	(4096 + BGP_HEADER_LENGTH)	/* Room for the rest of a keepalive, see bgp_sk_send() */
 #define BGP_RX_BUFFER_EXT_SIZE	65535
-#define BGP_TX_BUFFER_EXT_SIZE	65535
+#define BGP_TX_BUFFER_EXT_SIZE	(65535 + BGP_HEADER_LENGTH)
 
 static inline uint bgp_max_packet_length(struct bgp_proto *p)
 { return p->ext_messages ? BGP_MAX_EXT_MSG_LENGTH : BGP_MAX_MESSAGE_LENGTH; }
@@ -203,6 +213,8 @@ void bgp_start_timer(struct timer *t, int value);
 void bgp_check_config(struct bgp_config *c);
 void bgp_error(struct bgp_conn *c, unsigned code, unsigned subcode, byte *data, int len);
 void bgp_close_conn(struct bgp_conn *c);
+int bgp_sk_send(struct bgp_conn *conn, uint len);
+void bgp_sk_sent(struct bgp_conn *conn);
 void bgp_update_startup_delay(struct bgp_proto *p);
 void bgp_conn_enter_openconfirm_state(struct bgp_conn *conn);
 void bgp_conn_enter_established_state(struct bgp_conn *conn);
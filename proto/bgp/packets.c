@@ -764,7 +764,7 @@ bgp_fire_tx(struct bgp_conn *conn)
 
   conn->packets_to_send = s;
   bgp_create_header(buf, end - buf, type);
-  return sk_send(sk, end - buf);
+  return bgp_sk_send(conn, end - buf);
 }
 
 /**
@@ -799,6 +799,7 @@ bgp_tx(sock *sk)
   struct bgp_conn *conn = sk->data;
 
   DBG("BGP: TX hook\n");
+  bgp_sk_sent(conn);
   while (bgp_fire_tx(conn) > 0)
     ;
 }
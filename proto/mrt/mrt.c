@@ -0,0 +1,721 @@
+/*
+ *	BIRD -- Multi-Threaded Routing Toolkit (MRT) Table Dumps
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: MRT table dumps
+ *
+ * The MRT protocol saves snapshots of a routing table to files in the MRT
+ * TABLE_DUMP_V2 format (RFC 6396), which is understood by common tools for
+ * offline analysis of routing data. Dumps are made periodically by MRT
+ * protocol instances, or on demand by the 'mrt dump table' CLI command.
+ *
+ * A dump (&mrt_table_dump_state) walks the table by a &fib_iterator in
+ * bounded steps (see mrt_table_dump_step()), so large tables do not block
+ * the main loop for long. Steps of periodic dumps are run from an event,
+ * steps of CLI dumps from the CLI continuation routine. The table is locked
+ * during the dump, so it stays available even if it is removed by
+ * reconfiguration. Records are encoded to a memory buffer, which is passed
+ * in large chunks to mrt_dump_write(), so with the asynchronous writer
+ * enabled, the main loop does not wait for the disk at all.
+ *
+ * The dump starts with a PEER_INDEX_TABLE record. Each BGP protocol which is
+ * up is represented by a peer, routes from other protocols (and from BGP
+ * protocols started during the dump) use the local peer with index 0. Then
+ * one RIB_IPV4_UNICAST or RIB_IPV6_UNICAST record is written for each network
+ * with at least one route accepted by the filter. Routes are described by
+ * their BGP attributes, encoded by bgp_encode_attrs(). ORIGIN, AS_PATH and
+ * next hop attributes are added for routes without them, the next hop is
+ * encoded as an abbreviated MP_REACH_NLRI attribute in IPv6 dumps.
+ */
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mrt.h"
+#include "nest/mrtdump.h"
+#include "proto/bgp/bgp.h"
+#include "filter/filter.h"
+#include "conf/conf.h"
+#include "lib/string.h"
+#include "lib/unaligned.h"
+#include "lib/alloca.h"
+
+
+#define MRT_PEER_KEY(n)		n->proto
+#define MRT_PEER_NEXT(n)	n->next
+#define MRT_PEER_EQ(p1,p2)	p1 == p2
+#define MRT_PEER_FN(p)		p->hash_key
+
+#define MRT_PEER_REHASH		mrt_peer_rehash
+#define MRT_PEER_PARAMS		/8, *2, 2, 2, 4, 20
+
+HASH_DEFINE_REHASH_FN(MRT_PEER, struct mrt_peer)
+
+/* Instance for bgp_encode_attrs(), which uses just its as4_session flag */
+static struct bgp_proto mrt_bgp_encoder = { .as4_session = 1 };
+
+
+/*
+ *	Output buffer
+ */
+
+static void
+mrt_buffer_need(struct mrt_table_dump_state *s, uint len)
+{
+  uint used, size;
+
+  if (s->pos + len <= s->end)
+    return;
+
+  used = s->pos - s->buf;
+  size = MAX(2 * (uint) (s->end - s->buf), used + len);
+
+  s->buf = mb_realloc(s->buf, size);
+  s->pos = s->buf + used;
+  s->end = s->buf + size;
+}
+
+static void
+mrt_flush(struct mrt_table_dump_state *s)
+{
+  if (!s->error && (mrt_dump_write(s->fd, s->buf, s->pos - s->buf) < 0))
+  {
+    log(L_ERR "MRT: Cannot write to %s: %m", s->filename);
+    s->error = 1;
+  }
+
+  s->pos = s->buf;
+}
+
+static uint
+mrt_record_start(struct mrt_table_dump_state *s)
+{
+  mrt_buffer_need(s, MRTDUMP_HDR_LENGTH);
+  s->pos += MRTDUMP_HDR_LENGTH;
+  return s->pos - s->buf;
+}
+
+static void
+mrt_record_end(struct mrt_table_dump_state *s, uint offset, uint subtype)
+{
+  byte *hdr = s->buf + offset - MRTDUMP_HDR_LENGTH;
+
+  put_u32(hdr + 0, now_real);
+  put_u16(hdr + 4, TABLE_DUMP_V2);
+  put_u16(hdr + 6, subtype);
+  put_u32(hdr + 8, s->pos - (s->buf + offset));
+
+  if (s->pos - s->buf >= MRT_BUFFER_SIZE)
+    mrt_flush(s);
+}
+
+
+/*
+ *	Records
+ */
+
+static void
+mrt_put_peer(struct mrt_table_dump_state *s, u32 id, ip_addr addr, u32 as)
+{
+  mrt_buffer_need(s, 9 + sizeof(ip_addr));
+
+  s->pos[0] = MRT_PEER_TYPE;
+  put_u32(s->pos + 1, id);
+  s->pos = put_ipa(s->pos + 5, addr);
+  put_u32(s->pos, as);
+  s->pos += 4;
+}
+
+static void
+mrt_peer_index_table(struct mrt_table_dump_state *s)
+{
+  char *name = s->table->name;
+  uint len = MIN(strlen(name), 0xffff);
+  uint offset, count_pos;
+  struct mrt_peer *pe;
+  struct proto *P;
+
+  offset = mrt_record_start(s);
+
+  mrt_buffer_need(s, 8 + len);
+  put_u32(s->pos, config->router_id);
+  put_u16(s->pos + 4, len);
+  memcpy(s->pos + 6, name, len);
+  s->pos += 6 + len;
+
+  count_pos = s->pos - s->buf;
+  s->pos += 2;
+
+  /* Local peer for routes from other protocols */
+  mrt_put_peer(s, config->router_id, IPA_NONE, 0);
+  s->peer_count = 1;
+
+  WALK_LIST(P, active_proto_list)
+  {
+    if ((P->proto != &proto_bgp) || (s->peer_count >= 0xffff))
+      continue;
+
+    struct bgp_proto *bp = (void *) P;
+    mrt_put_peer(s, bp->remote_id, bp->cf->remote_ip, bp->remote_as);
+
+    pe = mb_alloc(s->pool, sizeof(struct mrt_peer));
+    pe->proto = P;
+    pe->index = s->peer_count++;
+    HASH_INSERT2(s->peer_hash, MRT_PEER, s->pool, pe);
+  }
+
+  put_u16(s->buf + count_pos, s->peer_count);
+  mrt_record_end(s, offset, TABLE_DUMP_V2_PEER_INDEX_TABLE);
+}
+
+static inline uint
+mrt_peer_index(struct mrt_table_dump_state *s, struct proto *P)
+{
+  struct mrt_peer *pe = HASH_FIND(s->peer_hash, MRT_PEER, P);
+  return pe ? pe->index : 0;
+}
+
+static int
+mrt_rib_entry(struct mrt_table_dump_state *s, rte *e)
+{
+  rta *a = e->attrs;
+  ea_list *eal = a->eattrs, *bgp;
+  eattr *nh = NULL;
+  byte *pos, *attrs;
+  uint i, len, origin = 0, path = 0;
+
+  /* Need to normalize the extended attributes */
+  if (eal && eal->next)
+  {
+    ea_list *t = eal;
+    eal = alloca(ea_scan(t));
+    ea_merge(t, eal);
+    ea_sort(eal);
+  }
+
+  /* Only BGP attributes are dumped */
+  bgp = alloca(sizeof(ea_list) + (eal ? eal->count : 0) * sizeof(eattr));
+  bgp->next = NULL;
+  bgp->flags = EALF_SORTED;
+  bgp->count = 0;
+
+  for (i = 0; eal && (i < eal->count); i++)
+  {
+    eattr *ea = &eal->attrs[i];
+
+    if ((EA_PROTO(ea->id) != EAP_BGP) || (ea->type & EAF_TEMP))
+      continue;
+
+    switch (EA_ID(ea->id))
+    {
+    case BA_ORIGIN:	origin = 1; break;
+    case BA_AS_PATH:	path = 1; break;
+    case BA_NEXT_HOP:	nh = ea; break;
+    }
+
+    bgp->attrs[bgp->count++] = *ea;
+  }
+
+  mrt_buffer_need(s, 8 + MRT_ATTR_BUFFER_SIZE + 16 + 2 * sizeof(ip_addr));
+  pos = s->pos;
+  attrs = pos + 8;
+
+  len = bgp->count ? bgp_encode_attrs(&mrt_bgp_encoder, attrs, bgp, MRT_ATTR_BUFFER_SIZE) : 0;
+  if (len == (uint) -1)
+  {
+    s->skip_count++;
+    return 0;
+  }
+
+  put_u16(pos, mrt_peer_index(s, a->src->proto));
+  put_u32(pos + 2, now_real - (now - e->lastmod));
+  pos = attrs + len;
+
+  if (!origin)
+  {
+    pos[0] = BAF_TRANSITIVE;
+    pos[1] = BA_ORIGIN;
+    pos[2] = 1;
+    pos[3] = ORIGIN_INCOMPLETE;
+    pos += 4;
+  }
+
+  if (!path)
+  {
+    pos[0] = BAF_TRANSITIVE;
+    pos[1] = BA_AS_PATH;
+    pos[2] = 0;
+    pos += 3;
+  }
+
+#ifndef IPV6
+  if (!nh && (a->dest == RTD_ROUTER))
+  {
+    pos[0] = BAF_TRANSITIVE;
+    pos[1] = BA_NEXT_HOP;
+    pos[2] = sizeof(ip_addr);
+    pos = put_ipa(pos + 3, a->gw);
+  }
+#else
+  /* Abbreviated MP_REACH_NLRI, with just the next hop (RFC 6396 4.3.4) */
+  ip_addr *gw = nh ? (ip_addr *) nh->u.ptr->data : &a->gw;
+  uint cnt = nh ? (nh->u.ptr->length / sizeof(ip_addr)) : 1;
+
+  if (nh && (cnt == 2) && ipa_zero(gw[1]))
+    cnt = 1;
+
+  if (nh || (a->dest == RTD_ROUTER))
+  {
+    pos[0] = BAF_OPTIONAL;
+    pos[1] = BA_MP_REACH_NLRI;
+    pos[2] = 1 + cnt * sizeof(ip_addr);
+    pos[3] = cnt * sizeof(ip_addr);
+    pos += 4;
+
+    for (i = 0; i < cnt; i++)
+      pos = put_ipa(pos, gw[i]);
+  }
+#endif
+
+  put_u16(s->pos + 6, pos - attrs);
+  s->pos = pos;
+  return 1;
+}
+
+static void
+mrt_rib_table(struct mrt_table_dump_state *s, net *n)
+{
+  uint offset, count_pos, count = 0;
+  rte *e, *ee;
+  ea_list *tmpa;
+
+  offset = mrt_record_start(s);
+
+  mrt_buffer_need(s, 7 + sizeof(ip_addr));
+  put_u32(s->pos, s->seqnum);
+  s->pos[4] = n->n.pxlen;
+
+  byte prefix[sizeof(ip_addr)];
+  put_ipa(prefix, n->n.prefix);
+  memcpy(s->pos + 5, prefix, BYTES(n->n.pxlen));
+  s->pos += 5 + BYTES(n->n.pxlen);
+
+  count_pos = s->pos - s->buf;
+  s->pos += 2;
+
+  for (ee = n->routes; ee; ee = ee->next)
+  {
+    if (!rte_is_valid(ee))
+      continue;
+
+    e = ee;
+    if (s->filter)
+    {
+      tmpa = rte_make_tmp_attrs(e, s->linpool);
+      if (f_run(s->filter, &e, &tmpa, s->linpool, FF_FORCE_TMPATTR) > F_ACCEPT)
+	goto skip;
+    }
+
+    if (count < 0xffff)
+      count += mrt_rib_entry(s, e);
+
+  skip:
+    if (e != ee)
+      rte_free(e);
+  }
+
+  lp_flush(s->linpool);
+
+  /* Networks without routes are not dumped */
+  if (!count)
+  {
+    s->pos = s->buf + offset - MRTDUMP_HDR_LENGTH;
+    return;
+  }
+
+  put_u16(s->buf + count_pos, count);
+  mrt_record_end(s, offset, MRT_RIB_SUBTYPE);
+
+  s->seqnum++;
+  s->net_count++;
+  s->route_count += count;
+}
+
+
+/*
+ *	Table dumps
+ */
+
+/**
+ * mrt_table_dump_start - start a table dump
+ * @pp: parent pool
+ * @tab: table to be dumped
+ * @filter: filter for dumped routes
+ * @filename: name of the output file
+ * @owner: MRT protocol, or NULL for dumps from CLI
+ *
+ * This function opens the output file and writes the PEER_INDEX_TABLE
+ * record. The dump is then done by repeated calls of mrt_table_dump_step().
+ * Returns NULL and logs the error if the file cannot be opened.
+ */
+struct mrt_table_dump_state *
+mrt_table_dump_start(pool *pp, rtable *tab, struct filter *filter, char *filename, struct proto *owner)
+{
+  struct mrt_table_dump_state *s;
+  pool *pool;
+  int fd;
+
+  fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    log(L_ERR "%s: Cannot open MRT dump file %s: %m", owner ? owner->name : "MRT", filename);
+    return NULL;
+  }
+
+  pool = rp_new(pp, "MRT table dump");
+  s = mb_allocz(pool, sizeof(struct mrt_table_dump_state));
+  s->pool = pool;
+  s->table = tab;
+  s->filter = filter;
+  s->proto = owner;
+  s->linpool = lp_new(pool, 4080);
+  s->filename = mb_alloc(pool, strlen(filename) + 1);
+  strcpy(s->filename, filename);
+  s->fd = fd;
+
+  s->buf = s->pos = mb_alloc(pool, MRT_BUFFER_SIZE + MRT_ATTR_BUFFER_SIZE);
+  s->end = s->buf + MRT_BUFFER_SIZE + MRT_ATTR_BUFFER_SIZE;
+  HASH_INIT(s->peer_hash, pool, 4);
+
+  rt_lock_table(tab);
+  FIB_ITERATE_INIT(&s->fit, &tab->fib);
+  s->fit_linked = 1;
+
+  mrt_peer_index_table(s);
+
+  return s;
+}
+
+/**
+ * mrt_table_dump_step - do next step of a table dump
+ * @s: table dump
+ *
+ * This function dumps next %MRT_STEP_NETS networks. When the whole table is
+ * dumped, it writes the rest of the buffer and closes the file. Returns 1
+ * when the dump is finished (successfully or not, see @s->error), 0 when
+ * it should be called again.
+ */
+int
+mrt_table_dump_step(struct mrt_table_dump_state *s)
+{
+  struct fib *fib = &s->table->fib;
+  uint max = MRT_STEP_NETS;
+
+  if (s->done)
+    return 1;
+
+  s->fit_linked = 0;
+  FIB_ITERATE_START(fib, &s->fit, f)
+    {
+      if (s->error)
+	goto done;
+
+      if (!max--)
+	{
+	  FIB_ITERATE_PUT(&s->fit, f);
+	  s->fit_linked = 1;
+	  return 0;
+	}
+
+      mrt_rib_table(s, (net *) f);
+    }
+  FIB_ITERATE_END(f);
+
+  mrt_flush(s);
+
+  if ((mrt_dump_close(s->fd) < 0) && !s->error)
+  {
+    log(L_ERR "MRT: Cannot write to %s: %m", s->filename);
+    s->error = 1;
+  }
+  s->fd = -1;
+
+done:
+  s->done = 1;
+  return 1;
+}
+
+/**
+ * mrt_table_dump_free - free a table dump
+ * @s: table dump
+ *
+ * This function frees all resources of the dump and unlocks the table. If
+ * the dump was not finished successfully, the incomplete file is removed.
+ */
+void
+mrt_table_dump_free(struct mrt_table_dump_state *s)
+{
+  if (s->fit_linked)
+    FIB_ITERATE_UNLINK(&s->fit, &s->table->fib);
+
+  if (s->fd >= 0)
+    mrt_dump_close(s->fd);
+
+  if (!s->done || s->error)
+    unlink(s->filename);
+
+  rt_unlock_table(s->table);
+  rfree(s->pool);
+}
+
+
+/*
+ *	CLI dumps
+ */
+
+static void
+mrt_dump_cont(struct cli *c)
+{
+  struct mrt_table_dump_state *s = c->rover;
+
+  if (!mrt_table_dump_step(s))
+  {
+    /* Nothing is written to the CLI, the next step has to be requested */
+    ev_schedule(c->event);
+    return;
+  }
+
+  if (s->error)
+    cli_printf(c, 8009, "Dump of table %s to %s failed", s->table->name, s->filename);
+  else
+    cli_printf(c, 0, "Dumped %u routes for %u networks from table %s to %s",
+	       s->route_count, s->net_count, s->table->name, s->filename);
+
+  mrt_table_dump_free(s);
+  c->cont = c->cleanup = NULL;
+  c->rover = NULL;
+}
+
+static void
+mrt_dump_cleanup(struct cli *c)
+{
+  mrt_table_dump_free(c->rover);
+}
+
+void
+mrt_dump_cmd(struct rtable_config *tab, char *filename, struct filter *filter)
+{
+  struct mrt_table_dump_state *s;
+
+  if (cli_access_restricted())
+    return;
+
+  s = mrt_table_dump_start(this_cli->pool, tab->table, filter, filename, NULL);
+  if (!s)
+  {
+    cli_msg(8009, "Cannot open %s", filename);
+    return;
+  }
+
+  this_cli->cont = mrt_dump_cont;
+  this_cli->cleanup = mrt_dump_cleanup;
+  this_cli->rover = s;
+}
+
+
+/*
+ *	Periodic dumps
+ */
+
+static void
+mrt_dump_done(struct mrt_proto *p)
+{
+  struct mrt_table_dump_state *s = p->table_dump;
+
+  if (!s->error)
+  {
+    TRACE(D_EVENTS, "Dumped %u routes for %u networks to %s",
+	  s->route_count, s->net_count, s->filename);
+
+    if (s->skip_count)
+      log(L_WARN "%s: %u routes with too long attributes skipped in %s",
+	  p->p.name, s->skip_count, s->filename);
+
+    p->last_dump = now;
+    p->dump_count++;
+  }
+
+  mrt_table_dump_free(s);
+  p->table_dump = NULL;
+}
+
+static void
+mrt_dump_event(void *data)
+{
+  struct mrt_proto *p = data;
+
+  if (!p->table_dump)
+    return;
+
+  if (mrt_table_dump_step(p->table_dump))
+    mrt_dump_done(p);
+  else
+    ev_schedule(p->dump_event);
+}
+
+static void
+mrt_period_timer(timer *t)
+{
+  struct mrt_proto *p = t->data;
+  char filename[1024];
+  time_t tt = now_real;
+
+  if (p->table_dump)
+  {
+    log(L_WARN "%s: Previous dump not finished, skipping", p->p.name);
+    return;
+  }
+
+  if (!strftime(filename, sizeof(filename), p->cf->filename, localtime(&tt)))
+  {
+    log(L_ERR "%s: Invalid file name pattern", p->p.name);
+    return;
+  }
+
+  TRACE(D_EVENTS, "Dumping table %s to %s", p->p.table->name, filename);
+
+  p->table_dump = mrt_table_dump_start(p->p.pool, p->p.table, p->cf->filter, filename, &p->p);
+  if (!p->table_dump)
+    return;
+
+  ev_schedule(p->dump_event);
+}
+
+
+/*
+ *	Protocol glue
+ */
+
+static struct proto *
+mrt_init(struct proto_config *c)
+{
+  struct proto *P = proto_new(c, sizeof(struct mrt_proto));
+  struct mrt_proto *p = (void *) P;
+
+  p->cf = (void *) c;
+
+  return P;
+}
+
+static int
+mrt_start(struct proto *P)
+{
+  struct mrt_proto *p = (void *) P;
+
+  p->period_timer = tm_new_set(P->pool, mrt_period_timer, p, 0, p->cf->period);
+  p->dump_event = ev_new(P->pool);
+  p->dump_event->hook = mrt_dump_event;
+  p->dump_event->data = p;
+  p->table_dump = NULL;
+
+  tm_start(p->period_timer, p->cf->period);
+
+  return PS_UP;
+}
+
+static int
+mrt_shutdown(struct proto *P)
+{
+  struct mrt_proto *p = (void *) P;
+
+  /* Unfinished dump is discarded */
+  if (p->table_dump)
+  {
+    log(L_WARN "%s: Dump to %s aborted", P->name, p->table_dump->filename);
+    mrt_table_dump_free(p->table_dump);
+    p->table_dump = NULL;
+  }
+
+  return PS_DOWN;
+}
+
+static int
+mrt_reconfigure(struct proto *P, struct proto_config *c)
+{
+  struct mrt_proto *p = (void *) P;
+  struct mrt_config *old = p->cf;
+  struct mrt_config *new = (void *) c;
+
+  if (strcmp(old->c.table->name, new->c.table->name))
+    return 0;
+
+  p->cf = new;
+
+  /* Filter of the old config would be freed with it */
+  if (p->table_dump)
+    p->table_dump->filter = new->filter;
+
+  if (new->period != old->period)
+  {
+    p->period_timer->recurrent = new->period;
+    tm_start(p->period_timer, new->period);
+  }
+
+  return 1;
+}
+
+static void
+mrt_copy_config(struct proto_config *dest, struct proto_config *src)
+{
+  /* Just a shallow copy */
+  proto_copy_rest(dest, src, sizeof(struct mrt_config));
+}
+
+static void
+mrt_get_status(struct proto *P, byte *buf)
+{
+  struct mrt_proto *p = (void *) P;
+
+  if (p->table_dump)
+    bsprintf(buf, "Dumping");
+}
+
+static void
+mrt_show_proto_info(struct proto *P)
+{
+  struct mrt_proto *p = (void *) P;
+  byte tbuf[TM_DATETIME_BUFFER_SIZE];
+
+  cli_msg(-1006, "  Table:            %s", P->table->name);
+  cli_msg(-1006, "  File name:        %s", p->cf->filename);
+  cli_msg(-1006, "  Period:           %u", p->cf->period);
+  cli_msg(-1006, "  Dumps:            %u", p->dump_count);
+
+  if (p->dump_count)
+  {
+    tm_format_datetime(tbuf, &config->tf_base, p->last_dump);
+    cli_msg(-1006, "  Last dump:        %s", tbuf);
+  }
+
+  if (p->table_dump)
+    cli_msg(-1006, "  Running dump:     %s (%u networks)",
+	    p->table_dump->filename, p->table_dump->net_count);
+}
+
+
+struct protocol proto_mrt = {
+  .name =		"MRT",
+  .template =		"mrt%d",
+  .config_size =	sizeof(struct mrt_config),
+  .init =		mrt_init,
+  .start =		mrt_start,
+  .shutdown =		mrt_shutdown,
+  .reconfigure =	mrt_reconfigure,
+  .copy_config =	mrt_copy_config,
+  .get_status =		mrt_get_status,
+  .show_proto_info =	mrt_show_proto_info
+};
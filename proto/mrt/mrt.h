@@ -0,0 +1,135 @@
+/*
+ *	BIRD -- Multi-Threaded Routing Toolkit (MRT) Table Dumps
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_MRT_H_
+#define _BIRD_MRT_H_
+
+#include "nest/bird.h"
+#include "nest/cli.h"
+#include "nest/protocol.h"
+#include "nest/route.h"
+#include "lib/event.h"
+#include "lib/hash.h"
+#include "lib/resource.h"
+#include "lib/timer.h"
+
+
+#define MRT_STEP_NETS		512	/* Networks processed in one step of a dump */
+#define MRT_BUFFER_SIZE		65536	/* Output is written in chunks of this size */
+#define MRT_ATTR_BUFFER_SIZE	4096	/* Maximal length of attributes of one route */
+
+/* Peer types in PEER_INDEX_TABLE */
+#define MRT_PEER_TYPE_IPV6	0x01
+#define MRT_PEER_TYPE_AS4	0x02
+
+#ifdef IPV6
+#define MRT_RIB_SUBTYPE		TABLE_DUMP_V2_RIB_IPV6_UNICAST
+#define MRT_PEER_TYPE		(MRT_PEER_TYPE_IPV6 | MRT_PEER_TYPE_AS4)
+#else
+#define MRT_RIB_SUBTYPE		TABLE_DUMP_V2_RIB_IPV4_UNICAST
+#define MRT_PEER_TYPE		MRT_PEER_TYPE_AS4
+#endif
+
+#define MRT_REPLAY_STEP		1024	/* Routes imported in one step of a replay */
+#define MRT_REPLAY_BURST	(100 MS) /* Rate limit allows routes this time ahead */
+
+struct mrt_config {
+  struct proto_config c;
+  struct filter *filter;		/* Routes to be dumped */
+  char *filename;			/* File name pattern, expanded by strftime() */
+  u32 period;				/* Interval between periodic dumps */
+};
+
+struct mrt_proto {
+  struct proto p;
+  struct mrt_config *cf;
+  timer *period_timer;			/* Periodic dumps */
+  event *dump_event;			/* Next step of the running dump */
+  struct mrt_table_dump_state *table_dump; /* Running dump, if any */
+  bird_clock_t last_dump;		/* Finish of the last successful dump */
+  uint dump_count;			/* Number of successful dumps */
+};
+
+struct mrt_peer {
+  struct proto *proto;			/* Source protocol of routes */
+  struct mrt_peer *next;		/* Hash chain */
+  uint index;				/* Index in PEER_INDEX_TABLE */
+};
+
+struct mrt_table_dump_state {
+  pool *pool;
+  rtable *table;			/* Dumped table, locked during the dump */
+  struct filter *filter;
+  struct proto *proto;			/* Owner of the dump, NULL for CLI dumps */
+  linpool *linpool;			/* Temporary data of one network */
+  struct fib_iterator fit;
+  char *filename;
+  int fd;
+
+  byte *buf, *pos, *end;		/* Output buffer */
+  HASH(struct mrt_peer) peer_hash;	/* BGP peers (protocols) by source protocol */
+  uint peer_count;			/* Peers in PEER_INDEX_TABLE, including local one */
+  u32 seqnum;				/* Sequence number of the next RIB record */
+
+  u8 fit_linked;			/* Iterator is linked to the table */
+  u8 done;				/* Dump was finished */
+  u8 error;				/* Dump failed */
+  uint net_count, route_count;
+  uint skip_count;			/* Routes with too long attributes */
+};
+
+struct mrt_replay_config {
+  struct proto_config c;
+  char *filename;			/* Replayed MRT file */
+  u32 rate;				/* Routes per second, 0 for no limit */
+  struct rtable_config *igp_table;	/* Table used for recursive next hop lookups */
+};
+
+struct mrt_replay_peer {
+  ip_addr addr;				/* Peer address and ASN identify the peer */
+  u32 as;
+  u32 id;				/* ID of the route source */
+  struct mrt_replay_peer *next;		/* Hash chain */
+};
+
+#define MRT_REPLAY_LOADING	1	/* Records are read from the file */
+#define MRT_REPLAY_CONVERGING	2	/* Waiting for the table to finish updates */
+#define MRT_REPLAY_DONE		3
+#define MRT_REPLAY_FAILED	4
+
+struct mrt_replay_proto {
+  struct proto p;
+  struct mrt_replay_config *cf;
+  rtable *igp_table;
+  event *event;				/* Next step of the replay */
+  timer *rate_timer;			/* Wakeup when the rate limit allows more routes */
+  linpool *linpool;			/* Decoded attributes of one record */
+
+  byte *data, *pos, *end;		/* Mapped file and the next record */
+  HASH(struct mrt_replay_peer) peer_hash;
+  struct mrt_replay_peer **peer_index;	/* Peers of the last PEER_INDEX_TABLE */
+  uint peer_index_count;
+  uint peer_count;
+
+  struct bgp_proto *bgp;		/* Fake BGP instance for bgp_decode_attrs() */
+  struct bgp_conn *bgp_conn;
+
+  u8 state;				/* MRT_REPLAY_* */
+  btime start_time, load_time, converge_time;
+  uint record_count;			/* Processed MRT records */
+  uint skip_count;			/* Records of unsupported types */
+  uint route_count;			/* Processed routes, compared with the rate limit */
+  uint update_count, withdraw_count;
+  uint invalid_count;			/* Routes with invalid attributes or peer */
+};
+
+
+struct mrt_table_dump_state *mrt_table_dump_start(pool *pp, rtable *tab, struct filter *filter, char *filename, struct proto *owner);
+int mrt_table_dump_step(struct mrt_table_dump_state *s);
+void mrt_table_dump_free(struct mrt_table_dump_state *s);
+void mrt_dump_cmd(struct rtable_config *tab, char *filename, struct filter *filter);
+
+#endif
@@ -0,0 +1,877 @@
+/*
+ *	BIRD -- Replay of MRT Files
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: MRT replay
+ *
+ * The MRT replay protocol imports routes from an MRT file to its table. It is
+ * intended for load testing of the routing table and filters and for fast
+ * bulk import of saved tables, without a BGP session feeding the routes. Both
+ * TABLE_DUMP_V2 table dumps (e.g. from the MRT protocol) and UPDATE messages in
+ * BGP4MP records (e.g. from 'mrtdump messages' or route collectors) are
+ * understood, other records are skipped.
+ *
+ * The file is mapped to memory and processed by an event in steps of about
+ * %MRT_REPLAY_STEP routes. With a rate limit, the number of routes processed
+ * so far is compared with the time since the start, and when the replay is
+ * ahead, it waits for the rate timer.
+ *
+ * Attributes are decoded by bgp_decode_attrs() of the BGP protocol, which is
+ * given a fake internal BGP instance, so all attributes are kept and LOCAL_PREF
+ * is added where missing. The fake connection is in %BS_CLOSE state, so
+ * bgp_error() ignores errors and routes with malformed attributes are just
+ * counted as invalid. Routes are imported by rte_update2() through the regular
+ * import filters. Each peer in the file (identified by its address and ASN)
+ * has its own route source, so routes of different peers for the same network
+ * coexist in the table like routes from different BGP sessions. Next hops
+ * are resolved recursively in the IGP table, like in BGP with recursive
+ * gateway mode.
+ *
+ * When the whole file is processed, the replay waits until the tables finish
+ * pending hostcache and next hop updates, then the time of the load and the
+ * time to the converged table are logged.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mrt.h"
+#include "nest/mrtdump.h"
+#include "proto/bgp/bgp.h"
+#include "conf/conf.h"
+#include "lib/string.h"
+#include "lib/unaligned.h"
+
+
+#define MRT_RP_KEY(n)		n->addr, n->as
+#define MRT_RP_NEXT(n)		n->next
+#define MRT_RP_EQ(a1,as1,a2,as2) (ipa_equal(a1, a2) && (as1 == as2))
+#define MRT_RP_FN(a,as)		(ipa_hash32(a) ^ u32_hash(as))
+
+#define MRT_RP_REHASH		mrt_rp_rehash
+#define MRT_RP_PARAMS		/8, *2, 2, 2, 4, 20
+
+HASH_DEFINE_REHASH_FN(MRT_RP, struct mrt_replay_peer)
+
+static void mrt_replay_loaded(struct mrt_replay_proto *p);
+
+
+/*
+ *	Peers and decoding
+ */
+
+static struct mrt_replay_peer *
+mrt_replay_get_peer(struct mrt_replay_proto *p, ip_addr addr, u32 as)
+{
+  struct mrt_replay_peer *n = HASH_FIND(p->peer_hash, MRT_RP, addr, as);
+
+  if (n)
+    return n;
+
+  n = mb_allocz(p->p.pool, sizeof(struct mrt_replay_peer));
+  n->addr = addr;
+  n->as = as;
+  n->id = ++p->peer_count;
+  HASH_INSERT2(p->peer_hash, MRT_RP, p->p.pool, n);
+
+  return n;
+}
+
+static inline ip_addr
+mrt_get_addr(byte *pos, int ipv6)
+{
+#ifdef IPV6
+  return ipv6 ? get_ip6(pos) : ipa_from_u32(get_u32(pos));
+#else
+  /* IPv6 peers cannot be represented, they differ just by ASN */
+  return ipv6 ? IPA_NONE : ipa_from_u32(get_u32(pos));
+#endif
+}
+
+static int
+mrt_get_prefix(byte **pos, uint *len, ip_addr *prefix, int *pxlen)
+{
+  ip_addr px = IPA_NONE;
+  uint b, q;
+
+  if (*len < 1)
+    return 0;
+
+  b = **pos;
+  q = (b + 7) / 8;
+  if ((b > BITS_PER_IP_ADDRESS) || (*len < 1 + q))
+    return 0;
+
+  memcpy(&px, *pos + 1, q);
+  ipa_ntoh(px);
+  *prefix = ipa_and(px, ipa_mkmask(b));
+  *pxlen = b;
+
+  *pos += 1 + q;
+  *len -= 1 + q;
+  return 1;
+}
+
+static rta *
+mrt_replay_decode(struct mrt_replay_proto *p, struct mrt_replay_peer *peer,
+		  byte *attrs, uint len, int as4, int mandatory)
+{
+  struct bgp_proto *bgp = p->bgp;
+
+  bgp->as4_session = as4;
+  bgp->cf->remote_ip = peer->addr;
+#ifdef IPV6
+  bgp->mp_reach_len = 0;
+  bgp->mp_unreach_len = 0;
+#endif
+
+  return bgp_decode_attrs(p->bgp_conn, attrs, len, p->linpool, mandatory);
+}
+
+#ifdef IPV6
+/* MP_(UN)REACH_NLRI in the full form for IPv6 unicast */
+static inline int
+mrt_mp_ipv6(byte *x, uint len)
+{
+  return (len >= 3) && (get_u16(x) == BGP_AF_IPV6) && (x[2] == 1);
+}
+#endif
+
+/*
+ * Resolve the next hop of decoded attributes @a. In IPv6, the next hop is
+ * taken from MP_REACH_NLRI, which is either abbreviated (TABLE_DUMP_V2) or
+ * full (BGP4MP), in the latter case also its NLRI are returned.
+ */
+static int
+mrt_replay_next_hop(struct mrt_replay_proto *p, rta *a, byte **nlri UNUSED4, uint *nlri_len UNUSED4)
+{
+  ip_addr *nh;
+  int second = 0;
+
+#ifdef IPV6
+  struct bgp_proto *bgp = p->bgp;
+  byte *x = bgp->mp_reach_start;
+  uint len = bgp->mp_reach_len;
+  uint full = len && !x[0];	/* Abbreviated form starts with next hop length */
+
+  if (full)
+  {
+    if (!mrt_mp_ipv6(x, len))
+      return 0;
+
+    x += 3;
+    len -= 3;
+  }
+
+  /* Full form has also one reserved byte */
+  if ((len < 1) || ((x[0] != 16) && (x[0] != 32)) || (len < 1 + x[0] + full))
+    return 0;
+
+  nh = (ip_addr *) bgp_attach_attr_wa(&a->eattrs, p->linpool, BA_NEXT_HOP, NEXT_HOP_LENGTH);
+  nh[0] = get_ip6(x + 1);
+  nh[1] = (x[0] == 32) ? get_ip6(x + 17) : IPA_NONE;
+  second = ipa_nonzero(nh[1]);
+
+  if (ipa_is_link_local(nh[0]))
+    nh[0] = IPA_NONE;
+
+  *nlri = x + 1 + x[0] + full;
+  *nlri_len = len - 1 - x[0] - full;
+#else
+  eattr *e = ea_find(a->eattrs, EA_CODE(EAP_BGP, BA_NEXT_HOP));
+
+  if (!e)
+    return 0;
+
+  nh = (ip_addr *) e->u.ptr->data;
+#endif
+
+  if (ipa_zero(*nh))
+    return 0;
+
+  rta_set_recursive_next_hop(p->p.table, a, p->igp_table, nh, nh + second);
+  return 1;
+}
+
+static void
+mrt_replay_announce(struct mrt_replay_proto *p, struct rte_src *src,
+		    ip_addr prefix, int pxlen, rta *a0, rta **a)
+{
+  net *n;
+  rte *e;
+
+  /* Cached attributes are shared by all routes of the record */
+  if (!*a)
+  {
+    /* Workaround for rta_lookup() breaking eattrs */
+    ea_list *ea = a0->eattrs;
+    a0->src = src;
+    *a = rta_lookup(a0);
+    a0->eattrs = ea;
+  }
+
+  n = net_get(p->p.table, prefix, pxlen);
+  e = rte_get_temp(rta_clone(*a));
+  e->net = n;
+  e->pflags = 0;
+  rte_update2(p->p.main_ahook, n, e, src);
+  p->update_count++;
+}
+
+static void
+mrt_replay_withdraw(struct mrt_replay_proto *p, struct rte_src *src, ip_addr prefix, int pxlen)
+{
+  net *n = net_find(p->p.table, prefix, pxlen);
+
+  rte_update2(p->p.main_ahook, n, NULL, src);
+  p->withdraw_count++;
+}
+
+
+/*
+ *	Records
+ *
+ * Record handlers return the number of processed routes, or -1 for
+ * malformed records.
+ */
+
+static int
+mrt_replay_peer_index(struct mrt_replay_proto *p, byte *pos, uint len)
+{
+  uint nlen, cnt, alen, aslen, i;
+  ip_addr addr;
+  u32 as;
+
+  if (len < 6)
+    return -1;
+
+  /* Collector BGP ID and view name */
+  nlen = get_u16(pos + 4);
+  if (len < 8 + nlen)
+    return -1;
+
+  cnt = get_u16(pos + 6 + nlen);
+  pos += 8 + nlen;
+  len -= 8 + nlen;
+
+  mb_free(p->peer_index);
+  p->peer_index = cnt ? mb_alloc(p->p.pool, cnt * sizeof(struct mrt_replay_peer *)) : NULL;
+  p->peer_index_count = 0;
+
+  for (i = 0; i < cnt; i++)
+  {
+    if (len < 1)
+      return -1;
+
+    alen = (pos[0] & MRT_PEER_TYPE_IPV6) ? 16 : 4;
+    aslen = (pos[0] & MRT_PEER_TYPE_AS4) ? 4 : 2;
+    if (len < 5 + alen + aslen)
+      return -1;
+
+    addr = mrt_get_addr(pos + 5, alen == 16);
+    as = (aslen == 4) ? get_u32(pos + 5 + alen) : get_u16(pos + 5 + alen);
+    p->peer_index[p->peer_index_count++] = mrt_replay_get_peer(p, addr, as);
+
+    pos += 5 + alen + aslen;
+    len -= 5 + alen + aslen;
+  }
+
+  return 0;
+}
+
+static int
+mrt_replay_rib(struct mrt_replay_proto *p, byte *pos, uint len)
+{
+  struct mrt_replay_peer *peer;
+  ip_addr prefix;
+  int pxlen;
+  uint cnt, idx, alen, i;
+  byte *attrs, *nlri;
+  uint nlri_len;
+  rta *a0, *a;
+
+  /* Sequence number */
+  if (len < 4)
+    return -1;
+
+  pos += 4;
+  len -= 4;
+
+  if (!mrt_get_prefix(&pos, &len, &prefix, &pxlen) || (len < 2))
+    return -1;
+
+  cnt = get_u16(pos);
+  pos += 2;
+  len -= 2;
+
+  for (i = 0; i < cnt; i++)
+  {
+    /* Peer index, originated time and attributes */
+    if (len < 8)
+      return -1;
+
+    idx = get_u16(pos);
+    alen = get_u16(pos + 6);
+    attrs = pos + 8;
+    if (len < 8 + alen)
+      return -1;
+
+    pos += 8 + alen;
+    len -= 8 + alen;
+
+    peer = (idx < p->peer_index_count) ? p->peer_index[idx] : NULL;
+    a0 = peer ? mrt_replay_decode(p, peer, attrs, alen, 1, 1) : NULL;
+
+    if (!a0 || !mrt_replay_next_hop(p, a0, &nlri, &nlri_len))
+    {
+      p->invalid_count++;
+      continue;
+    }
+
+    a = NULL;
+    mrt_replay_announce(p, rt_get_source(&p->p, peer->id), prefix, pxlen, a0, &a);
+    rta_free(a);
+  }
+
+  return cnt;
+}
+
+static int
+mrt_replay_bgp4mp(struct mrt_replay_proto *p, uint subtype, byte *pos, uint len)
+{
+  struct mrt_replay_peer *peer;
+  struct rte_src *src;
+  int as4 = (subtype == BGP4MP_MESSAGE_AS4);
+  uint aslen = as4 ? 4 : 2;
+  uint alen, afi, mlen, withdrawn_len, attr_len, nlri_len;
+  byte *withdrawn, *attrs, *nlri;
+  ip_addr addr, prefix;
+  int pxlen, cnt = 0;
+  rta *a0 = NULL, *a = NULL;
+  u32 as;
+
+  /* Peer and local ASN, interface index and address family */
+  if (len < 2 * aslen + 4)
+    return -1;
+
+  as = as4 ? get_u32(pos) : get_u16(pos);
+  afi = get_u16(pos + 2 * aslen + 2);
+  if ((afi != BGP_AF_IPV4) && (afi != BGP_AF_IPV6))
+    return -1;
+
+  pos += 2 * aslen + 4;
+  len -= 2 * aslen + 4;
+
+  /* Peer and local address, BGP message header */
+  alen = (afi == BGP_AF_IPV6) ? 16 : 4;
+  if (len < 2 * alen + 19)
+    return -1;
+
+  addr = mrt_get_addr(pos, alen == 16);
+  pos += 2 * alen;
+  len -= 2 * alen;
+
+  mlen = get_u16(pos + 16);
+  if ((mlen < 19) || (mlen > len))
+    return -1;
+
+  if (pos[18] != PKT_UPDATE)
+    return 0;
+
+  pos += 19;
+  len = mlen - 19;
+
+  /* The same checks as in bgp_rx_update() */
+  if (len < 4)
+    return -1;
+
+  withdrawn = pos + 2;
+  withdrawn_len = get_u16(pos);
+  if (withdrawn_len + 4 > len)
+    return -1;
+
+  attrs = withdrawn + withdrawn_len + 2;
+  attr_len = get_u16(attrs - 2);
+  if (withdrawn_len + attr_len + 4 > len)
+    return -1;
+
+  nlri = attrs + attr_len;
+  nlri_len = len - withdrawn_len - attr_len - 4;
+
+  peer = mrt_replay_get_peer(p, addr, as);
+  src = rt_get_source(&p->p, peer->id);
+
+#ifndef IPV6
+  while (withdrawn_len)
+  {
+    if (!mrt_get_prefix(&withdrawn, &withdrawn_len, &prefix, &pxlen))
+      goto malformed;
+
+    mrt_replay_withdraw(p, src, prefix, pxlen);
+    cnt++;
+  }
+
+  if (attr_len)
+    a0 = mrt_replay_decode(p, peer, attrs, attr_len, as4, nlri_len);
+
+  if (a0 && nlri_len && !mrt_replay_next_hop(p, a0, &nlri, &nlri_len))
+    a0 = NULL;
+#else
+  struct bgp_proto *bgp = p->bgp;
+  byte *x;
+  uint xlen;
+
+  /* IPv4 NLRI and routes of other address families are ignored */
+  nlri_len = 0;
+
+  if (attr_len)
+    a0 = mrt_replay_decode(p, peer, attrs, attr_len, as4, 0);
+
+  x = bgp->mp_unreach_start;
+  xlen = bgp->mp_unreach_len;
+  if (mrt_mp_ipv6(x, xlen))
+  {
+    x += 3;
+    xlen -= 3;
+
+    while (xlen)
+    {
+      if (!mrt_get_prefix(&x, &xlen, &prefix, &pxlen))
+	goto malformed;
+
+      mrt_replay_withdraw(p, src, prefix, pxlen);
+      cnt++;
+    }
+  }
+
+  if (mrt_mp_ipv6(bgp->mp_reach_start, bgp->mp_reach_len) &&
+      (!a0 || !mrt_replay_next_hop(p, a0, &nlri, &nlri_len)))
+  {
+    /* NLRI cannot be found without the next hop */
+    p->invalid_count++;
+    a0 = NULL;
+  }
+#endif
+
+  while (nlri_len)
+  {
+    if (!mrt_get_prefix(&nlri, &nlri_len, &prefix, &pxlen))
+      goto malformed;
+
+    /* Like BGP, withdraw routes with invalid attributes */
+    if (a0)
+      mrt_replay_announce(p, src, prefix, pxlen, a0, &a);
+    else
+    {
+      mrt_replay_withdraw(p, src, prefix, pxlen);
+      p->invalid_count++;
+    }
+
+    cnt++;
+  }
+
+  if (a)
+    rta_free(a);
+
+  return cnt;
+
+malformed:
+  if (a)
+    rta_free(a);
+
+  return -1;
+}
+
+static int
+mrt_replay_record(struct mrt_replay_proto *p, uint type, uint subtype, byte *data, uint len)
+{
+  switch (type)
+  {
+  case TABLE_DUMP_V2:
+    if (subtype == TABLE_DUMP_V2_PEER_INDEX_TABLE)
+      return mrt_replay_peer_index(p, data, len);
+
+    if (subtype == MRT_RIB_SUBTYPE)
+      return mrt_replay_rib(p, data, len);
+
+    break;
+
+  case BGP4MP_ET:
+    /* Microsecond timestamp */
+    if (len < 4)
+      return -1;
+
+    data += 4;
+    len -= 4;
+    /* fall through */
+
+  case BGP4MP:
+    if ((subtype == BGP4MP_MESSAGE) || (subtype == BGP4MP_MESSAGE_AS4))
+      return mrt_replay_bgp4mp(p, subtype, data, len);
+
+    break;
+  }
+
+  p->skip_count++;
+  return 0;
+}
+
+
+/*
+ *	Replay
+ */
+
+static int
+mrt_replay_open(struct mrt_replay_proto *p)
+{
+  struct stat st;
+  void *data;
+  int fd;
+
+  fd = open(p->cf->filename, O_RDONLY);
+  if (fd < 0)
+  {
+    log(L_ERR "%s: Cannot open %s: %m", p->p.name, p->cf->filename);
+    return 0;
+  }
+
+  if (fstat(fd, &st) < 0)
+  {
+    log(L_ERR "%s: Cannot stat %s: %m", p->p.name, p->cf->filename);
+    close(fd);
+    return 0;
+  }
+
+  /* Empty file cannot be mapped */
+  if (!st.st_size)
+  {
+    close(fd);
+    return 1;
+  }
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+  {
+    log(L_ERR "%s: Cannot map %s: %m", p->p.name, p->cf->filename);
+    return 0;
+  }
+
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  p->data = p->pos = data;
+  p->end = p->data + st.st_size;
+  return 1;
+}
+
+static void
+mrt_replay_close(struct mrt_replay_proto *p)
+{
+  if (p->data)
+    munmap(p->data, p->end - p->data);
+
+  p->data = p->pos = p->end = NULL;
+}
+
+static void
+mrt_replay_load(struct mrt_replay_proto *p)
+{
+  uint limit = MRT_REPLAY_STEP;
+  uint done = 0;
+  uint type, subtype, len;
+  byte *data;
+  int n;
+
+  if (p->cf->rate)
+  {
+    u64 rate = p->cf->rate;
+    btime elapsed = now_btime - p->start_time;
+    s64 allowed = (s64) (rate * (elapsed + MRT_REPLAY_BURST) / (1 S)) - p->route_count;
+
+    if (allowed <= 0)
+    {
+      /* Wait until the next route is allowed */
+      btime next = (btime) ((p->route_count + 1) * (1 S) / rate) - MRT_REPLAY_BURST;
+      tm_start_btime(p->rate_timer, MAX(next - elapsed, 1 MS));
+      return;
+    }
+
+    limit = MIN(limit, (uint) allowed);
+  }
+
+  while (done < limit)
+  {
+    if (p->pos == p->end)
+    {
+      mrt_replay_loaded(p);
+      return;
+    }
+
+    if (p->end - p->pos < MRTDUMP_HDR_LENGTH)
+      goto malformed;
+
+    type = get_u16(p->pos + 4);
+    subtype = get_u16(p->pos + 6);
+    len = get_u32(p->pos + 8);
+    data = p->pos + MRTDUMP_HDR_LENGTH;
+
+    if (len > (uint) (p->end - data))
+      goto malformed;
+
+    lp_flush(p->linpool);
+    n = mrt_replay_record(p, type, subtype, data, len);
+    if (n < 0)
+      goto malformed;
+
+    p->pos = data + len;
+    p->record_count++;
+    p->route_count += n;
+    done += n;
+  }
+
+  ev_schedule(p->event);
+  return;
+
+malformed:
+  log(L_ERR "%s: Malformed record at offset %u of %s", p->p.name,
+      (uint) (p->pos - p->data), p->cf->filename);
+
+  p->state = MRT_REPLAY_FAILED;
+  mrt_replay_close(p);
+}
+
+static void
+mrt_replay_loaded(struct mrt_replay_proto *p)
+{
+  TRACE(D_EVENTS, "Processed %u records from %s", p->record_count, p->cf->filename);
+
+  p->load_time = now_btime - p->start_time;
+  p->state = MRT_REPLAY_CONVERGING;
+  mrt_replay_close(p);
+
+  ev_schedule(p->event);
+}
+
+static inline int
+mrt_replay_table_busy(rtable *t)
+{
+  return t->hcu_scheduled || t->nhu_state;
+}
+
+static inline uint
+mrt_replay_rate(uint count, btime time)
+{
+  return (u64) count * (1 S) / MAX(time, 1);
+}
+
+static void
+mrt_replay_converge(struct mrt_replay_proto *p)
+{
+  /* Table updates are done by table events, we check again after them */
+  if (mrt_replay_table_busy(p->p.table) || mrt_replay_table_busy(p->igp_table))
+  {
+    ev_schedule(p->event);
+    return;
+  }
+
+  p->converge_time = now_btime - p->start_time;
+  p->state = MRT_REPLAY_DONE;
+
+  log(L_INFO "%s: Replayed %u routes from %s in %u.%03u s (%u routes/s), converged in %u.%03u s",
+      p->p.name, p->route_count, p->cf->filename,
+      (uint) (p->load_time TO_S), (uint) ((p->load_time TO_MS) % 1000),
+      mrt_replay_rate(p->route_count, p->load_time),
+      (uint) (p->converge_time TO_S), (uint) ((p->converge_time TO_MS) % 1000));
+}
+
+static void
+mrt_replay_event(void *data)
+{
+  struct mrt_replay_proto *p = data;
+
+  switch (p->state)
+  {
+  case MRT_REPLAY_LOADING:
+    mrt_replay_load(p);
+    break;
+
+  case MRT_REPLAY_CONVERGING:
+    mrt_replay_converge(p);
+    break;
+  }
+}
+
+static void
+mrt_replay_timer(timer *t)
+{
+  struct mrt_replay_proto *p = t->data;
+
+  ev_schedule(p->event);
+}
+
+
+/*
+ *	Protocol glue
+ */
+
+static inline rtable *
+mrt_replay_igp_table(struct mrt_replay_config *cf)
+{
+  return cf->igp_table ? cf->igp_table->table : cf->c.table->table;
+}
+
+static struct proto *
+mrt_replay_init(struct proto_config *c)
+{
+  struct proto *P = proto_new(c, sizeof(struct mrt_replay_proto));
+  struct mrt_replay_proto *p = (void *) P;
+
+  p->cf = (void *) c;
+
+  return P;
+}
+
+static int
+mrt_replay_start(struct proto *P)
+{
+  struct mrt_replay_proto *p = (void *) P;
+  struct bgp_proto *bgp;
+
+  p->igp_table = mrt_replay_igp_table(p->cf);
+  rt_lock_table(p->igp_table);
+
+  p->event = ev_new(P->pool);
+  p->event->hook = mrt_replay_event;
+  p->event->data = p;
+  p->rate_timer = tm_new_set(P->pool, mrt_replay_timer, p, 0, 0);
+  p->linpool = lp_new(P->pool, 4080);
+
+  HASH_INIT(p->peer_hash, P->pool, 6);
+  p->peer_index = NULL;
+  p->peer_index_count = p->peer_count = 0;
+
+  /* Internal session keeps all attributes, AS path loop check is disabled */
+  bgp = p->bgp = mb_allocz(P->pool, sizeof(struct bgp_proto));
+  bgp->p.name = P->name;
+  bgp->is_internal = 1;
+  bgp->cf = mb_allocz(P->pool, sizeof(struct bgp_config));
+  bgp->cf->default_local_pref = 100;
+  bgp->cf->allow_local_as = -1;
+
+  p->bgp_conn = mb_allocz(P->pool, sizeof(struct bgp_conn));
+  p->bgp_conn->bgp = bgp;
+  p->bgp_conn->state = BS_CLOSE;
+
+  p->start_time = now_btime;
+  p->load_time = p->converge_time = 0;
+  p->record_count = p->skip_count = p->route_count = 0;
+  p->update_count = p->withdraw_count = p->invalid_count = 0;
+
+  p->data = p->pos = p->end = NULL;
+  p->state = mrt_replay_open(p) ? MRT_REPLAY_LOADING : MRT_REPLAY_FAILED;
+
+  if (p->state == MRT_REPLAY_LOADING)
+    ev_schedule(p->event);
+
+  return PS_UP;
+}
+
+static int
+mrt_replay_shutdown(struct proto *P)
+{
+  struct mrt_replay_proto *p = (void *) P;
+
+  if (p->state == MRT_REPLAY_LOADING)
+    log(L_WARN "%s: Replay of %s aborted", P->name, p->cf->filename);
+
+  mrt_replay_close(p);
+  rt_unlock_table(p->igp_table);
+
+  return PS_DOWN;
+}
+
+static int
+mrt_replay_reconfigure(struct proto *P, struct proto_config *c)
+{
+  struct mrt_replay_proto *p = (void *) P;
+  struct mrt_replay_config *old = p->cf;
+  struct mrt_replay_config *new = (void *) c;
+
+  /* Changed file or tables mean a new replay */
+  if (strcmp(old->c.table->name, new->c.table->name) ||
+      strcmp(old->filename, new->filename) ||
+      (mrt_replay_igp_table(old) != mrt_replay_igp_table(new)))
+    return 0;
+
+  /* The rate limit is used by the next step */
+  p->cf = new;
+
+  return 1;
+}
+
+static void
+mrt_replay_copy_config(struct proto_config *dest, struct proto_config *src)
+{
+  /* Just a shallow copy */
+  proto_copy_rest(dest, src, sizeof(struct mrt_replay_config));
+}
+
+static void
+mrt_replay_get_status(struct proto *P, byte *buf)
+{
+  struct mrt_replay_proto *p = (void *) P;
+
+  switch (p->state)
+  {
+  case MRT_REPLAY_LOADING:	bsprintf(buf, "Loading"); break;
+  case MRT_REPLAY_CONVERGING:	bsprintf(buf, "Converging"); break;
+  case MRT_REPLAY_DONE:		bsprintf(buf, "Done"); break;
+  case MRT_REPLAY_FAILED:	bsprintf(buf, "Failed"); break;
+  }
+}
+
+static void
+mrt_replay_show_proto_info(struct proto *P)
+{
+  struct mrt_replay_proto *p = (void *) P;
+
+  cli_msg(-1006, "  Table:            %s", P->table->name);
+  cli_msg(-1006, "  File name:        %s", p->cf->filename);
+
+  if (p->cf->rate)
+    cli_msg(-1006, "  Rate limit:       %u routes/s", p->cf->rate);
+
+  cli_msg(-1006, "  Records:          %u (%u skipped)", p->record_count, p->skip_count);
+  cli_msg(-1006, "  Routes:           %u updates, %u withdraws, %u invalid",
+	  p->update_count, p->withdraw_count, p->invalid_count);
+
+  if (p->load_time)
+    cli_msg(-1006, "  Load time:        %u.%03u s (%u routes/s)",
+	    (uint) (p->load_time TO_S), (uint) ((p->load_time TO_MS) % 1000),
+	    mrt_replay_rate(p->route_count, p->load_time));
+
+  if (p->converge_time)
+    cli_msg(-1006, "  Convergence time: %u.%03u s",
+	    (uint) (p->converge_time TO_S), (uint) ((p->converge_time TO_MS) % 1000));
+}
+
+
+struct protocol proto_mrt_replay = {
+  .name =		"Replay",
+  .template =		"replay%d",
+  .preference =		DEF_PREF_BGP,
+  .config_size =	sizeof(struct mrt_replay_config),
+  .init =		mrt_replay_init,
+  .start =		mrt_replay_start,
+  .shutdown =		mrt_replay_shutdown,
+  .reconfigure =	mrt_replay_reconfigure,
+  .copy_config =	mrt_replay_copy_config,
+  .get_status =		mrt_replay_get_status,
+  .show_proto_info =	mrt_replay_show_proto_info
+};
@@ -71,12 +71,6 @@ ifa_bufsize(struct ospf_iface *ifa)
   return MAX(bsize, ifa->tx_length);
 }
 
-static inline uint
-ifa_flood_queue_size(struct ospf_iface *ifa)
-{
-  return ifa->tx_length / 24;
-}
-
 int
 ospf_iface_assure_bufsize(struct ospf_iface *ifa, uint plen)
 {
@@ -292,7 +286,7 @@ void
 ospf_iface_remove(struct ospf_iface *ifa)
 {
   struct ospf_proto *p = ifa->oa->po;
-  int i;
+  uint i;
 
   if (ifa->type == OSPF_IT_VLINK)
     OSPF_TRACE(D_EVENTS, "Removing vlink to %R via area %R", ifa->vid, ifa->voa->areaid);
@@ -586,6 +580,7 @@ ospf_iface_new(struct ospf_area *oa, struct ifa *addr, struct ospf_iface_patt *i
   ifa->ioprob = OSPF_I_OK;
   ifa->tx_length = ifa_tx_length(ifa);
   ifa->tx_hdrlen = ifa_tx_hdrlen(ifa);
+  ifa->flood_tbf.rate = ifa->flood_tbf.burst = ip->flood_rate;
   ifa->check_link = ip->check_link;
   ifa->ecmp_weight = ip->ecmp_weight;
   ifa->check_ttl = (ip->ttl_security == 1);
@@ -697,6 +692,7 @@ ospf_iface_new_vlink(struct ospf_proto *p, struct ospf_iface_patt *ip)
   ifa->inftransdelay = ip->inftransdelay;
   ifa->tx_length = ospf_is_v2(p) ? IP4_MIN_MTU : IP6_MIN_MTU;
   ifa->tx_hdrlen = ifa_tx_hdrlen(ifa);
+  ifa->flood_tbf.rate = ifa->flood_tbf.burst = ip->flood_rate;
   ifa->autype = ip->autype;
   ifa->passwords = ip->passwords;
   ifa->instance_id = ip->instance_id;
@@ -790,6 +786,15 @@ ospf_iface_reconfigure(struct ospf_iface *ifa, struct ospf_iface_patt *new)
     /* FIXME: Update neighbors' timers */
   }
 
+  /* FLOOD RATE */
+  if (ifa->flood_tbf.rate != new->flood_rate)
+  {
+    OSPF_TRACE(D_EVENTS, "Changing flood rate of %s from %d to %d",
+	       ifname, ifa->flood_tbf.rate, new->flood_rate);
+
+    ifa->flood_tbf.rate = ifa->flood_tbf.burst = new->flood_rate;
+  }
+
   /* POLL TIMER */
   if (ifa->pollint != new->pollint)
   {
@@ -1361,6 +1366,8 @@ ospf_iface_info(struct ospf_iface *ifa)
   cli_msg(-1015, "\tWait timer: %u", ifa->waitint);
   cli_msg(-1015, "\tDead timer: %u", ifa->deadint);
   cli_msg(-1015, "\tRetransmit timer: %u", ifa->rxmtint);
+  if (ifa->flood_tbf.rate)
+    cli_msg(-1015, "\tFlood rate: %u (limited %u times)", ifa->flood_tbf.rate, ifa->flood_limited);
   if ((ifa->type == OSPF_IT_BCAST) || (ifa->type == OSPF_IT_NBMA))
   {
     cli_msg(-1015, "\tDesignated router (ID): %R", ifa->drid);
@@ -159,8 +159,9 @@ lsa_generate_checksum(struct ospf_lsa_header *lsa, const u8 *body)
   u16 len = lsa->length;
 
   /*
-   * lsa and body are in the host order, we need to compute Fletcher-16 checksum
-   * for data in the network order. We also skip the initial age field.
+   * lsa is in the host order and body in the network order, we need to compute
+   * Fletcher-16 checksum for data in the network order. We also skip the
+   * initial age field.
    */
 
   lsa_hton_hdr(lsa, &hdr);
@@ -168,7 +169,7 @@ lsa_generate_checksum(struct ospf_lsa_header *lsa, const u8 *body)
 
   fletcher16_init(&ctx);
   fletcher16_update(&ctx, (u8 *) &hdr + 2, sizeof(struct ospf_lsa_header) - 2);
-  fletcher16_update_n32(&ctx, body, len - sizeof(struct ospf_lsa_header));
+  fletcher16_update(&ctx, body, len - sizeof(struct ospf_lsa_header));
   lsa->checksum = fletcher16_final(&ctx, len, OFFSETOF(struct ospf_lsa_header, checksum));
 }
 
@@ -221,13 +222,14 @@ lsa_walk_rt2(struct ospf_lsa_rt_walk *rt)
   if (rt->buf >= rt->bufend)
     return 0;
 
-  struct ospf_lsa_rt2_link *l = rt->buf;
-  rt->buf += sizeof(struct ospf_lsa_rt2_link) + l->no_tos * sizeof(struct ospf_lsa_rt2_tos);
+  struct ospf_lsa_rt2_link l;
+  lsa_ntoh_body(rt->buf, &l, sizeof(struct ospf_lsa_rt2_link));
+  rt->buf += sizeof(struct ospf_lsa_rt2_link) + l.no_tos * sizeof(struct ospf_lsa_rt2_tos);
 
-  rt->type = l->type;
-  rt->metric = l->metric;
-  rt->id = l->id;
-  rt->data = l->data;
+  rt->type = l.type;
+  rt->metric = l.metric;
+  rt->id = l.id;
+  rt->data = l.data;
   return 1;
 }
 
@@ -245,14 +247,15 @@ lsa_walk_rt3(struct ospf_lsa_rt_walk *rt)
     rt->buf += sizeof(struct ospf_lsa_rt);
   }
 
-  struct ospf_lsa_rt3_link *l = rt->buf;
+  struct ospf_lsa_rt3_link l;
+  lsa_ntoh_body(rt->buf, &l, sizeof(struct ospf_lsa_rt3_link));
   rt->buf += sizeof(struct ospf_lsa_rt3_link);
 
-  rt->type = l->type;
-  rt->metric = l->metric;
-  rt->lif = l->lif;
-  rt->nif = l->nif;
-  rt->id = l->id;
+  rt->type = l.type;
+  rt->metric = l.metric;
+  rt->lif = l.lif;
+  rt->nif = l.nif;
+  rt->id = l.id;
   return 1;
 }
 
@@ -285,17 +288,18 @@ lsa_parse_sum_net(struct top_hash_entry *en, int ospf2, ip_addr *ip, int *pxlen,
   if (ospf2)
   {
     struct ospf_lsa_sum2 *ls = en->lsa_body;
-    *ip = ipa_from_u32(en->lsa.id & ls->netmask);
-    *pxlen = u32_masklen(ls->netmask);
+    u32 netmask = get_u32(&ls->netmask);
+    *ip = ipa_from_u32(en->lsa.id & netmask);
+    *pxlen = u32_masklen(netmask);
     *pxopts = 0;
-    *metric = ls->metric & LSA_METRIC_MASK;
+    *metric = get_u32(&ls->metric) & LSA_METRIC_MASK;
   }
   else
   {
     struct ospf_lsa_sum3_net *ls = en->lsa_body;
     u16 rest;
     lsa_get_ipv6_prefix(ls->prefix, ip, pxlen, pxopts, &rest);
-    *metric = ls->metric & LSA_METRIC_MASK;
+    *metric = get_u32(&ls->metric) & LSA_METRIC_MASK;
   }
 }
 
@@ -306,15 +310,15 @@ lsa_parse_sum_rt(struct top_hash_entry *en, int ospf2, u32 *drid, u32 *metric, u
   {
     struct ospf_lsa_sum2 *ls = en->lsa_body;
     *drid = en->lsa.id;
-    *metric = ls->metric & LSA_METRIC_MASK;
+    *metric = get_u32(&ls->metric) & LSA_METRIC_MASK;
     *options = 0;
   }
   else
   {
     struct ospf_lsa_sum3_rt *ls = en->lsa_body;
-    *drid = ls->drid;
-    *metric = ls->metric & LSA_METRIC_MASK;
-    *options = ls->options & LSA_OPTIONS_MASK;
+    *drid = get_u32(&ls->drid);
+    *metric = get_u32(&ls->metric) & LSA_METRIC_MASK;
+    *options = get_u32(&ls->options) & LSA_OPTIONS_MASK;
   }
 }
 
@@ -323,34 +327,36 @@ lsa_parse_ext(struct top_hash_entry *en, int ospf2, struct ospf_lsa_ext_local *r
 {
   if (ospf2)
   {
-    struct ospf_lsa_ext2 *ext = en->lsa_body;
-    rt->ip = ipa_from_u32(en->lsa.id & ext->netmask);
-    rt->pxlen = u32_masklen(ext->netmask);
+    struct ospf_lsa_ext2 ext;
+    lsa_ntoh_body(en->lsa_body, &ext, sizeof(struct ospf_lsa_ext2));
+    rt->ip = ipa_from_u32(en->lsa.id & ext.netmask);
+    rt->pxlen = u32_masklen(ext.netmask);
     rt->pxopts = 0;
-    rt->metric = ext->metric & LSA_METRIC_MASK;
-    rt->ebit = ext->metric & LSA_EXT2_EBIT;
+    rt->metric = ext.metric & LSA_METRIC_MASK;
+    rt->ebit = ext.metric & LSA_EXT2_EBIT;
 
-    rt->fbit = ext->fwaddr;
-    rt->fwaddr = ipa_from_u32(ext->fwaddr);
+    rt->fbit = ext.fwaddr;
+    rt->fwaddr = ipa_from_u32(ext.fwaddr);
 
-    rt->tag = ext->tag;
+    rt->tag = ext.tag;
     rt->propagate = lsa_get_options(&en->lsa) & OPT_P;
   }
   else
   {
     struct ospf_lsa_ext3 *ext = en->lsa_body;
+    u32 metric = get_u32(&ext->metric);
     u16 rest;
     u32 *buf = lsa_get_ipv6_prefix(ext->rest, &rt->ip, &rt->pxlen, &rt->pxopts, &rest);
-    rt->metric = ext->metric & LSA_METRIC_MASK;
-    rt->ebit = ext->metric & LSA_EXT3_EBIT;
+    rt->metric = metric & LSA_METRIC_MASK;
+    rt->ebit = metric & LSA_EXT3_EBIT;
 
-    rt->fbit = ext->metric & LSA_EXT3_FBIT;
+    rt->fbit = metric & LSA_EXT3_FBIT;
     if (rt->fbit)
       buf = lsa_get_ipv6_addr(buf, &rt->fwaddr);
     else
       rt->fwaddr = IPA_NONE;
 
-    rt->tag = (ext->metric & LSA_EXT3_TBIT) ? *buf++ : 0;
+    rt->tag = (metric & LSA_EXT3_TBIT) ? get_u32(buf++) : 0;
     rt->propagate = rt->pxopts & OPT_PX_P;
   }
 }
@@ -370,21 +376,26 @@ lsa_validate_rt2(struct ospf_lsa_header *lsa, struct ospf_lsa_rt *body)
 
   while (buf < bufend)
   {
-    struct ospf_lsa_rt2_link *l = buf;
-    buf += sizeof(struct ospf_lsa_rt2_link) + l->no_tos * sizeof(struct ospf_lsa_rt2_tos);
+    struct ospf_lsa_rt2_link l;
+
+    if (buf + sizeof(struct ospf_lsa_rt2_link) > bufend)
+      return 0;
+
+    lsa_ntoh_body(buf, &l, sizeof(struct ospf_lsa_rt2_link));
+    buf += sizeof(struct ospf_lsa_rt2_link) + l.no_tos * sizeof(struct ospf_lsa_rt2_tos);
     i++;
 
     if (buf > bufend)
       return 0;
 
-    if (!((l->type == LSART_PTP) ||
-	  (l->type == LSART_NET) ||
-	  (l->type == LSART_STUB) ||
-	  (l->type == LSART_VLNK)))
+    if (!((l.type == LSART_PTP) ||
+	  (l.type == LSART_NET) ||
+	  (l.type == LSART_STUB) ||
+	  (l.type == LSART_VLNK)))
       return 0;
   }
 
-  if ((body->options & LSA_RT2_LINKS) != i)
+  if ((lsa_get_rt_options(body) & LSA_RT2_LINKS) != i)
     return 0;
 
   return 1;
@@ -403,15 +414,17 @@ lsa_validate_rt3(struct ospf_lsa_header *lsa, struct ospf_lsa_rt *body)
 
   while (buf < bufend)
   {
-    struct ospf_lsa_rt3_link *l = buf;
-    buf += sizeof(struct ospf_lsa_rt3_link);
+    struct ospf_lsa_rt3_link l;
 
-    if (buf > bufend)
+    if (buf + sizeof(struct ospf_lsa_rt3_link) > bufend)
       return 0;
 
-    if (!((l->type == LSART_PTP) ||
-	  (l->type == LSART_NET) ||
-	  (l->type == LSART_VLNK)))
+    lsa_ntoh_body(buf, &l, sizeof(struct ospf_lsa_rt3_link));
+    buf += sizeof(struct ospf_lsa_rt3_link);
+
+    if (!((l.type == LSART_PTP) ||
+	  (l.type == LSART_NET) ||
+	  (l.type == LSART_VLNK)))
       return 0;
   }
   return 1;
@@ -433,7 +446,7 @@ lsa_validate_sum2(struct ospf_lsa_header *lsa, struct ospf_lsa_sum2 *body)
     return 0;
 
   /* First field should have TOS = 0, we ignore other TOS fields */
-  if ((body->metric & LSA_SUM2_TOS) != 0)
+  if ((get_u32(&body->metric) & LSA_SUM2_TOS) != 0)
     return 0;
 
   return 1;
@@ -442,7 +455,7 @@ lsa_validate_sum2(struct ospf_lsa_header *lsa, struct ospf_lsa_sum2 *body)
 static inline int
 pxlen(u32 *buf)
 {
-  return *buf >> 24;
+  return get_u32(buf) >> 24;
 }
 
 static int
@@ -478,7 +491,7 @@ lsa_validate_ext2(struct ospf_lsa_header *lsa, struct ospf_lsa_ext2 *body)
     return 0;
 
   /* First field should have TOS = 0, we ignore other TOS fields */
-  if ((body->metric & LSA_EXT2_TOS) != 0)
+  if ((get_u32(&body->metric) & LSA_EXT2_TOS) != 0)
     return 0;
 
   return 1;
@@ -494,12 +507,13 @@ lsa_validate_ext3(struct ospf_lsa_header *lsa, struct ospf_lsa_ext3 *body)
   if (pxl > MAX_PREFIX_LENGTH)
     return 0;
 
+  u32 metric = get_u32(&body->metric);
   int len = IPV6_PREFIX_SPACE(pxl);
-  if (body->metric & LSA_EXT3_FBIT) // forwardinf address
+  if (metric & LSA_EXT3_FBIT) // forwardinf address
     len += 16;
-  if (body->metric & LSA_EXT3_TBIT) // route tag
+  if (metric & LSA_EXT3_TBIT) // route tag
     len += 4;
-  if (*body->rest & 0xFFFF) // referenced LS type field
+  if (get_u32(body->rest) & 0xFFFF) // referenced LS type field
     len += 4;
 
   if (lsa->length != (HDRLEN + sizeof(struct ospf_lsa_ext3) + len))
@@ -538,16 +552,19 @@ lsa_validate_link(struct ospf_lsa_header *lsa, struct ospf_lsa_link *body)
   if (lsa->length < (HDRLEN + sizeof(struct ospf_lsa_link)))
     return 0;
 
-  return lsa_validate_pxlist(lsa, body->pxcount, sizeof(struct ospf_lsa_link), (u8 *) body);
+  return lsa_validate_pxlist(lsa, get_u32(&body->pxcount), sizeof(struct ospf_lsa_link), (u8 *) body);
 }
 
 static int
 lsa_validate_prefix(struct ospf_lsa_header *lsa, struct ospf_lsa_prefix *body)
 {
+  struct ospf_lsa_prefix px;
+
   if (lsa->length < (HDRLEN + sizeof(struct ospf_lsa_prefix)))
     return 0;
 
-  return lsa_validate_pxlist(lsa, body->pxcount, sizeof(struct ospf_lsa_prefix), (u8 *) body);
+  lsa_get_prefix_hdr(body, &px);
+  return lsa_validate_pxlist(lsa, px.pxcount, sizeof(struct ospf_lsa_prefix), (u8 *) body);
 }
 
 
@@ -556,7 +573,7 @@ lsa_validate_prefix(struct ospf_lsa_header *lsa, struct ospf_lsa_prefix *body)
  * @lsa: LSA header
  * @lsa_type: one of %LSA_T_xxx
  * @ospf2: %true means OSPF version 2, %false means OSPF version 3
- * @body: pointer to LSA body
+ * @body: pointer to LSA body in network order
  *
  * Checks internal structure of given LSA body (minimal length,
  * consistency). Returns true if valid.
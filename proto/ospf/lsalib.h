@@ -27,6 +27,27 @@ static inline void lsa_hton_body1(void *h, u16 len) { lsa_hton_body(h, h, len);
 static inline void lsa_ntoh_body1(void *n, u16 len) { lsa_ntoh_body(n, n, len); };
 #endif
 
+/*
+ * LSA bodies in the LSA db are kept in network byte order, the structures in
+ * ospf.h describe their layout in host order. Whole u32 fields are read by
+ * get_u32(), other fields by these accessors or by decoding a fixed-size part
+ * of the body with lsa_ntoh_body() to a local copy.
+ */
+static inline u32 lsa_get_rt_options(void *body)
+{ return get_u32(&((struct ospf_lsa_rt *) body)->options); }
+
+static inline u32 lsa_get_link_options(void *body)
+{ return get_u32(&((struct ospf_lsa_link *) body)->options); }
+
+static inline ip6_addr lsa_get_link_lladdr(void *body)
+{ return get_ip6(&((struct ospf_lsa_link *) body)->lladdr); }
+
+static inline u32 * lsa_get_prefix_hdr(void *body, struct ospf_lsa_prefix *px)
+{ lsa_ntoh_body(body, px, sizeof(struct ospf_lsa_prefix)); return ((struct ospf_lsa_prefix *) body)->rest; }
+
+static inline u32 * lsa_get_link_hdr(void *body, struct ospf_lsa_link *ll)
+{ lsa_ntoh_body(body, ll, sizeof(struct ospf_lsa_link)); return ((struct ospf_lsa_link *) body)->rest; }
+
 struct ospf_lsa_rt_walk {
   struct top_hash_entry *en;
   void *buf, *bufend;
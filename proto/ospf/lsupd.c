@@ -181,21 +181,71 @@ ospf_add_flushed_to_lsrt(struct ospf_proto *p, struct ospf_neighbor *n)
 
 static int ospf_flood_lsupd(struct ospf_proto *p, struct top_hash_entry **lsa_list, uint lsa_count, uint lsa_min_count, struct ospf_iface *ifa);
 
+/*
+ * LSUPD packets sent on an interface may be paced by the flood_tbf token
+ * bucket (see 'flood rate' option). Flooded LSAs that exceed the limit stay in
+ * the flood queue and flood_timer resumes the flooding later, a full queue is
+ * enlarged instead of dropping them. Requested and retransmitted LSAs that
+ * exceed the limit are put to the retransmission list of the neighbor, so they
+ * are sent with the next retransmission. Delays are counted in flood_limited.
+ */
+static inline int
+ospf_flood_limit(struct ospf_iface *ifa)
+{
+  if (!ifa->flood_tbf.rate || !tbf_limit(&ifa->flood_tbf))
+    return 0;
+
+  ifa->flood_limited++;
+  return 1;
+}
+
+static void
+ospf_flood_timer_hook(timer *t)
+{
+  struct ospf_iface *ifa = t->data;
+  struct ospf_proto *p = ifa->oa->po;
+
+  if (ifa->flood_queue_used && !ev_active(p->flood_event))
+    ev_schedule(p->flood_event);
+}
+
+static void
+ospf_dequeue_lsas(struct ospf_iface *ifa, uint count)
+{
+  uint i;
+
+  for (i = 0; i < count; i++)
+    ifa->flood_queue[i]->ret_count--;
+
+  ifa->flood_queue_used -= count;
+  memmove(ifa->flood_queue, ifa->flood_queue + count, ifa->flood_queue_used * sizeof(void *));
+  bzero(ifa->flood_queue + ifa->flood_queue_used, count * sizeof(void *));
+}
+
+static void
+ospf_grow_flood_queue(struct ospf_iface *ifa)
+{
+  uint old_size = ifa->flood_queue_size;
+  uint new_size = 2 * old_size;
+
+  ifa->flood_queue_size = new_size;
+  ifa->flood_queue = mb_realloc(ifa->flood_queue, new_size * sizeof(void *));
+  bzero(ifa->flood_queue + old_size, (new_size - old_size) * sizeof(void *));
+}
+
 static void
 ospf_enqueue_lsa(struct ospf_proto *p, struct top_hash_entry *en, struct ospf_iface *ifa)
 {
   if (ifa->flood_queue_used == ifa->flood_queue_size)
   {
     /* If we already have full queue, we send some packets */
-    uint sent = ospf_flood_lsupd(p, ifa->flood_queue, ifa->flood_queue_used, ifa->flood_queue_used / 2, ifa);
-    uint i;
+    uint half = ifa->flood_queue_used / 2;
+    uint sent = ospf_flood_lsupd(p, ifa->flood_queue, ifa->flood_queue_used, half, ifa);
+    ospf_dequeue_lsas(ifa, sent);
 
-    for (i = 0; i < sent; i++)
-      ifa->flood_queue[i]->ret_count--;
-
-    ifa->flood_queue_used -= sent;
-    memmove(ifa->flood_queue, ifa->flood_queue + sent, ifa->flood_queue_used * sizeof(void *));
-    bzero(ifa->flood_queue + ifa->flood_queue_used, sent * sizeof(void *));
+    /* LSAs not sent due to pacing are kept */
+    if (ifa->flood_queue_used == ifa->flood_queue_size)
+      ospf_grow_flood_queue(ifa);
   }
 
   en->ret_count++;
@@ -211,7 +261,7 @@ ospf_flood_event(void *ptr)
 {
   struct ospf_proto *p = ptr;
   struct ospf_iface *ifa;
-  int i, count;
+  uint count, sent;
 
   WALK_LIST(ifa, p->iface_list)
   {
@@ -219,13 +269,18 @@ ospf_flood_event(void *ptr)
       continue;
 
     count = ifa->flood_queue_used;
-    ospf_flood_lsupd(p, ifa->flood_queue, count, count, ifa);
+    sent = ospf_flood_lsupd(p, ifa->flood_queue, count, count, ifa);
+    ospf_dequeue_lsas(ifa, MIN(sent, count));
 
-    for (i = 0; i < count; i++)
-      ifa->flood_queue[i]->ret_count--;
+    /* Flooding limited by pacing, resume it later */
+    if (ifa->flood_queue_used)
+    {
+      if (!ifa->flood_timer)
+	ifa->flood_timer = tm_new_set(ifa->pool, ospf_flood_timer_hook, ifa, 0, 0);
 
-    ifa->flood_queue_used = 0;
-    bzero(ifa->flood_queue, count * sizeof(void *));
+      if (!tm_active(ifa->flood_timer))
+	tm_start(ifa->flood_timer, 1);
+    }
   }
 }
 
@@ -359,10 +414,11 @@ ospf_prepare_lsupd(struct ospf_proto *p, struct ospf_iface *ifa,
       pkt = ospf_tx_buffer(ifa);
     }
 
+    /* LSA body is stored in network order */
     struct ospf_lsa_header *buf = ((void *) pkt) + pos;
     lsa_hton_hdr(&en->lsa, buf);
-    lsa_hton_body(en->lsa_body, ((void *) buf) + sizeof(struct ospf_lsa_header),
-		  len - sizeof(struct ospf_lsa_header));
+    memcpy(((void *) buf) + sizeof(struct ospf_lsa_header), en->lsa_body,
+	   len - sizeof(struct ospf_lsa_header));
     buf->age = htons(MIN(en->lsa.age + ifa->inftransdelay, LSA_MAXAGE));
 
     pos += len;
@@ -382,6 +438,9 @@ ospf_flood_lsupd(struct ospf_proto *p, struct top_hash_entry **lsa_list, uint ls
 
   for (i = 0; i < lsa_min_count; i += c)
   {
+    if (ospf_flood_limit(ifa))
+      break;
+
     c = ospf_prepare_lsupd(p, ifa, lsa_list + i, lsa_count - i);
 
     if (!c)	/* Too large LSA */
@@ -412,6 +471,9 @@ ospf_send_lsupd(struct ospf_proto *p, struct top_hash_entry **lsa_list, uint lsa
 
   for (i = 0; i < lsa_count; i += c)
   {
+    if (ospf_flood_limit(ifa))
+      break;
+
     c = ospf_prepare_lsupd(p, ifa, lsa_list + i, lsa_count - i);
 
     if (!c)	/* Too large LSA */
@@ -423,13 +485,23 @@ ospf_send_lsupd(struct ospf_proto *p, struct top_hash_entry **lsa_list, uint lsa
     ospf_send_to(ifa, n->ip);
   }
 
+  /* LSAs not sent due to pacing are sent with the next retransmission */
+  if (i < lsa_count)
+  {
+    OSPF_TRACE(D_PACKETS, "LSUPD to nbr %R on %s paced, %u LSAs deferred",
+	       n->rid, ifa->ifname, lsa_count - i);
+
+    for (c = i; c < lsa_count; c++)
+      ospf_lsa_lsrt_up(lsa_list[c], n);
+  }
+
   return i;
 }
 
 void
 ospf_rxmt_lsupd(struct ospf_proto *p, struct ospf_neighbor *n)
 {
-  uint max = 2 * n->ifa->flood_queue_size;
+  uint max = 2 * ifa_flood_queue_size(n->ifa);
   struct top_hash_entry *entries[max];
   struct top_hash_entry *ret, *nxt, *en;
   uint i = 0;
@@ -578,14 +650,14 @@ ospf_receive_lsupd(struct ospf_packet *pkt, struct ospf_iface *ifa,
 	continue;
       }
 
-      /* Copy and validate LSA body */
+      /* Copy and validate LSA body, it is kept in network order */
       int blen = lsa.length - sizeof(struct ospf_lsa_header);
-      void *body = mb_alloc(p->p.pool, blen);
-      lsa_ntoh_body(lsa_n + 1, body, blen);
+      void *body = ospf_lsa_body_alloc(p, blen);
+      memcpy(body, lsa_n + 1, blen);
 
       if (lsa_validate(&lsa, lsa_type, ospf_is_v2(p), body) == 0)
       {
-	mb_free(body);
+	ospf_lsa_body_free(p, body, blen);
 	SKIP("invalid body");
       }
 
@@ -106,6 +106,8 @@ static int ospf_reload_routes(struct proto *P);
 static int ospf_rte_better(struct rte *new, struct rte *old);
 static int ospf_rte_same(struct rte *new, struct rte *old);
 static void ospf_disp(timer *timer);
+static void ospf_spf_timer_hook(timer *timer);
+static void ospf_lsadb_timer_hook(timer *timer);
 
 static void
 ospf_area_initfib(struct fib_node *fn)
@@ -157,6 +159,12 @@ ospf_area_add(struct ospf_proto *p, struct ospf_area_config *ac)
   fib_init(&oa->rtr, p->p.pool, sizeof(ort), 0, ospf_rt_initort);
   add_area_nets(oa, ac);
 
+  /* Heap of candidates is indexed from 1 */
+  BUFFER_INIT(oa->cand, p->p.pool, 16);
+  BUFFER_PUSH(oa->cand) = NULL;
+  BUFFER_INIT(oa->order, p->p.pool, 16);
+  oa->nhpool = lp_new(p->p.pool, 12*sizeof(struct mpnh));
+
   if (oa->areaid == 0)
     p->backbone = oa;
 
@@ -190,6 +198,9 @@ ospf_area_remove(struct ospf_area *oa)
   fib_free(&oa->rtr);
   fib_free(&oa->net_fib);
   fib_free(&oa->enet_fib);
+  mb_free(oa->cand.data);
+  mb_free(oa->order.data);
+  rfree(oa->nhpool);
 
   if (oa->translator_timer)
     rfree(oa->translator_timer);
@@ -226,6 +237,7 @@ ospf_start(struct proto *P)
   struct ospf_proto *p = (struct ospf_proto *) P;
   struct ospf_config *c = (struct ospf_config *) (P->cf);
   struct ospf_area_config *ac;
+  int i;
 
   p->router_id = proto_get_router_id(P->cf);
   p->ospf2 = c->ospf2;
@@ -237,13 +249,22 @@ ospf_start(struct proto *P)
   p->tick = c->tick;
   p->disp_timer = tm_new_set(P->pool, ospf_disp, p, 0, p->tick);
   tm_start(p->disp_timer, 1);
+  p->spf_timer = tm_new_set(P->pool, ospf_spf_timer_hook, p, 0, 0);
+  p->lsadb_timer = tm_new_set(P->pool, ospf_lsadb_timer_hook, p, 0, c->lsadb_save);
+  p->lsadb_event = ev_new(P->pool);
+  if (c->lsadb_file && c->lsadb_save)
+    tm_start(p->lsadb_timer, c->lsadb_save);
   p->lsab_size = 256;
   p->lsab_used = 0;
   p->lsab = mb_alloc(P->pool, p->lsab_size);
   p->nhpool = lp_new(P->pool, 12*sizeof(struct mpnh));
+  for (i = 0; i < LSA_BODY_SLABS; i++)
+    p->lsa_slab[i] = sl_new(P->pool, LSA_BODY_MIN << i);
+  p->calcspf = 1;
   init_list(&(p->iface_list));
   init_list(&(p->area_list));
   fib_init(&p->rtf, P->pool, sizeof(ort), 0, ospf_rt_initort);
+  init_list(&p->rt_prc);
   p->areano = 0;
   p->gr = ospf_top_new(p, P->pool);
   s_init_list(&(p->lsal));
@@ -266,6 +287,9 @@ ospf_start(struct proto *P)
   WALK_LIST(ic, c->vlink_list)
     ospf_iface_new_vlink(p, ic);
 
+  /* Restore LSA database from snapshot */
+  ospf_lsadb_load(p);
+
   return PS_UP;
 }
 
@@ -381,14 +405,108 @@ ospf_build_attrs(ea_list * next, struct linpool *pool, u32 m1, u32 m2,
 }
 
 
+/*
+ * SPF delay algorithm (RFC 8405)
+ *
+ * Routing table calculation is not started immediately after a change, but
+ * delayed by the SPF timer. The first event after a quiet period is handled
+ * with a short initial delay. If events continue, the router uses the short
+ * delay until the learning period ends and then the long delay, until there
+ * are no events for the hold-down period. Timers for learning and hold-down
+ * are not used, expired periods are detected when an event arrives.
+ */
+static void
+ospf_spf_update_state(struct ospf_proto *p)
+{
+  struct ospf_config *cf = (struct ospf_config *) p->p.cf;
+
+  if (p->spf_state == OSPF_SPF_QUIET)
+    return;
+
+  if (now_btime >= (p->spf_last_event + cf->spf_holddown))
+    p->spf_state = OSPF_SPF_QUIET;
+  else if ((p->spf_state == OSPF_SPF_SHORT_WAIT) && (now_btime >= p->spf_learn_end))
+    p->spf_state = OSPF_SPF_LONG_WAIT;
+}
+
+static void
+ospf_spf_event(struct ospf_proto *p)
+{
+  struct ospf_config *cf = (struct ospf_config *) p->p.cf;
+  btime delay;
+
+  ospf_spf_update_state(p);
+
+  switch (p->spf_state)
+  {
+  case OSPF_SPF_QUIET:
+    p->spf_state = OSPF_SPF_SHORT_WAIT;
+    p->spf_learn_end = now_btime + cf->spf_learn;
+    delay = cf->spf_initial;
+    break;
+
+  case OSPF_SPF_SHORT_WAIT:
+    delay = cf->spf_short;
+    break;
+
+  default:
+    delay = cf->spf_long;
+    break;
+  }
+
+  p->spf_last_event = now_btime;
+
+  if (!tm_active(p->spf_timer))
+    tm_start_btime(p->spf_timer, delay);
+}
+
+static void
+ospf_spf_timer_hook(timer *timer)
+{
+  struct ospf_proto *p = timer->data;
+
+  if (p->calcrt)
+    ospf_rt_spf(p);
+}
+
+static void
+ospf_lsadb_timer_hook(timer *timer)
+{
+  ospf_lsadb_save_start(timer->data);
+}
+
 void
 ospf_schedule_rtcalc(struct ospf_proto *p)
 {
-  if (p->calcrt)
-    return;
+  p->calcspf = 1;
+
+  if (!p->calcrt)
+  {
+    OSPF_TRACE(D_EVENTS, "Scheduling routing table calculation");
+    p->calcrt = 1;
+  }
 
-  OSPF_TRACE(D_EVENTS, "Scheduling routing table calculation");
-  p->calcrt = 1;
+  ospf_spf_event(p);
+}
+
+/**
+ * ospf_schedule_prc - schedule partial routing table calculation
+ * @p: OSPF protocol instance
+ *
+ * Changes of summary and external LSAs do not affect the shortest-path tree,
+ * so just inter-area and external routes have to be recalculated. If a full
+ * calculation is already scheduled, it is kept.
+ */
+void
+ospf_schedule_prc(struct ospf_proto *p)
+{
+  if (!p->calcrt)
+  {
+    OSPF_TRACE(D_EVENTS, "Scheduling partial routing table calculation");
+    p->calcrt = 1;
+  }
+
+  ospf_spf_event(p);
 }
 
 static int
@@ -400,15 +518,20 @@ ospf_reload_routes(struct proto *P)
     OSPF_TRACE(D_EVENTS, "Scheduling routing table calculation with route reload");
 
   p->calcrt = 2;
+  p->calcspf = 1;
+  ospf_spf_event(p);
 
   return 1;
 }
 
 
 /**
- * ospf_disp - invokes routing table calculation, aging and also area_disp()
+ * ospf_disp - invokes LSA origination and aging
  * @timer: timer usually called every @ospf_proto->tick second, @timer->data
  * point to @ospf_proto
+ *
+ * Routing table calculation is not done here, it is triggered by the SPF
+ * timer (see ospf_spf_event()).
  */
 static void
 ospf_disp(timer * timer)
@@ -420,10 +543,6 @@ ospf_disp(timer * timer)
 
   /* Process LSA DB */
   ospf_update_lsadb(p);
-
-  /* Calculate routing table */
-  if (p->calcrt)
-    ospf_rt_spf(p);
 }
 
 
@@ -501,6 +620,8 @@ ospf_shutdown(struct proto *P)
 
   OSPF_TRACE(D_EVENTS, "Shutdown requested");
 
+  ospf_lsadb_save(p);
+
   /* And send to all my neighbors 1WAY */
   WALK_LIST(ifa, p->iface_list)
     ospf_iface_shutdown(ifa);
@@ -666,6 +787,12 @@ ospf_reconfigure(struct proto *P, struct proto_config *c)
   p->disp_timer->recurrent = p->tick;
   tm_start(p->disp_timer, 1);
 
+  p->lsadb_timer->recurrent = new->lsadb_save;
+  if (new->lsadb_file && new->lsadb_save)
+    tm_start(p->lsadb_timer, new->lsadb_save);
+  else
+    tm_stop(p->lsadb_timer);
+
   /* Mark all areas and ifaces */
   WALK_LIST(oa, p->area_list)
     oa->marked = 1;
@@ -738,10 +865,13 @@ ospf_sh_neigh(struct proto *P, char *iff)
   cli_msg(0, "");
 }
 
+static const char *ospf_spf_states[] = { "quiet", "short wait", "long wait" };
+
 void
 ospf_sh(struct proto *P)
 {
   struct ospf_proto *p = (struct ospf_proto *) P;
+  struct ospf_config *c = (struct ospf_config *) P->cf;
   struct ospf_area *oa;
   struct ospf_iface *ifa;
   struct ospf_neighbor *n;
@@ -759,6 +889,13 @@ ospf_sh(struct proto *P)
   cli_msg(-1014, "RFC1583 compatibility: %s", (p->rfc1583 ? "enabled" : "disabled"));
   cli_msg(-1014, "Stub router: %s", (p->stub_router ? "Yes" : "No"));
   cli_msg(-1014, "RT scheduler tick: %d", p->tick);
+  ospf_spf_update_state(p);
+  cli_msg(-1014, "SPF state: %s", ospf_spf_states[p->spf_state]);
+  cli_msg(-1014, "SPF delay: %u ms initial, %u ms short, %u ms long",
+	  (uint) (c->spf_initial TO_MS), (uint) (c->spf_short TO_MS), (uint) (c->spf_long TO_MS));
+  cli_msg(-1014, "SPF hold down: %u ms, time to learn: %u ms",
+	  (uint) (c->spf_holddown TO_MS), (uint) (c->spf_learn TO_MS));
+  cli_msg(-1014, "RT calculations: %u full, %u partial", p->spf_runs, p->prc_runs);
   cli_msg(-1014, "Number of areas: %u", p->areano);
   cli_msg(-1014, "Number of LSAs in DB:\t%u", p->gr->hash_entries);
 
@@ -861,12 +998,15 @@ ospf_sh_iface(struct proto *P, char *iff)
 
 static struct ospf_lsa_header *
 fake_lsa_from_prefix_lsa(struct ospf_lsa_header *dst, struct ospf_lsa_header *src,
-			 struct ospf_lsa_prefix *px)
+			 void *body)
 {
+  struct ospf_lsa_prefix px;
+  lsa_get_prefix_hdr(body, &px);
+
   dst->age = src->age;
-  dst->type_raw = px->ref_type;
-  dst->id = px->ref_id;
-  dst->rt = px->ref_rt;
+  dst->type_raw = px.ref_type;
+  dst->id = px.ref_id;
+  dst->rt = px.ref_rt;
   dst->sn = src->sn;
 
   return dst;
@@ -1024,10 +1164,11 @@ show_lsa_router(struct ospf_proto *p, struct top_hash_entry *he, int verbose)
 	{
 	  struct ospf_lsa_header *net_lsa = &(net_he->lsa);
 	  struct ospf_lsa_net *net_ln = net_he->lsa_body;
+	  u32 netmask = get_u32(&net_ln->optx);
 
 	  cli_msg(-1016, "\t\tnetwork %I/%d metric %u",
-		  ipa_from_u32(net_lsa->id & net_ln->optx),
-		  u32_masklen(net_ln->optx), rtl.metric);
+		  ipa_from_u32(net_lsa->id & netmask),
+		  u32_masklen(netmask), rtl.metric);
 	}
 	else
 	  cli_msg(-1016, "\t\tnetwork [%R] metric %u", rtl.id, rtl.metric);
@@ -1056,7 +1197,8 @@ show_lsa_network(struct top_hash_entry *he, int ospf2)
   if (ospf2)
   {
     cli_msg(-1016, "");
-    cli_msg(-1016, "\tnetwork %I/%d", ipa_from_u32(lsa->id & ln->optx), u32_masklen(ln->optx));
+    u32 netmask = get_u32(&ln->optx);
+    cli_msg(-1016, "\tnetwork %I/%d", ipa_from_u32(lsa->id & netmask), u32_masklen(netmask));
     cli_msg(-1016, "\t\tdr %R", lsa->rt);
   }
   else
@@ -1068,7 +1210,7 @@ show_lsa_network(struct top_hash_entry *he, int ospf2)
   show_lsa_distance(he);
 
   for (i = 0; i < lsa_net_count(lsa); i++)
-    cli_msg(-1016, "\t\trouter %R", ln->routers[i]);
+    cli_msg(-1016, "\t\trouter %R", get_u32(&ln->routers[i]));
 }
 
 static inline void
@@ -1121,7 +1263,7 @@ show_lsa_external(struct top_hash_entry *he, int ospf2)
 static inline void
 show_lsa_prefix(struct top_hash_entry *he, struct top_hash_entry *cnode)
 {
-  struct ospf_lsa_prefix *px = he->lsa_body;
+  struct ospf_lsa_prefix px;
   ip_addr pxa;
   int pxlen;
   u8 pxopts;
@@ -1129,22 +1271,23 @@ show_lsa_prefix(struct top_hash_entry *he, struct top_hash_entry *cnode)
   u32 *buf;
   int i;
 
+  buf = lsa_get_prefix_hdr(he->lsa_body, &px);
+
   /* We check whether given prefix-LSA is related to the current node */
-  if ((px->ref_type != cnode->lsa.type_raw) || (px->ref_rt != cnode->lsa.rt))
+  if ((px.ref_type != cnode->lsa.type_raw) || (px.ref_rt != cnode->lsa.rt))
     return;
 
-  if ((px->ref_type == LSA_T_RT) && (px->ref_id != 0))
+  if ((px.ref_type == LSA_T_RT) && (px.ref_id != 0))
     return;
 
-  if ((px->ref_type == LSA_T_NET) && (px->ref_id != cnode->lsa.id))
+  if ((px.ref_type == LSA_T_NET) && (px.ref_id != cnode->lsa.id))
     return;
 
-  buf = px->rest;
-  for (i = 0; i < px->pxcount; i++)
+  for (i = 0; i < px.pxcount; i++)
     {
       buf = lsa_get_ipv6_prefix(buf, &pxa, &pxlen, &pxopts, &metric);
 
-      if (px->ref_type == LSA_T_RT)
+      if (px.ref_type == LSA_T_RT)
 	cli_msg(-1016, "\t\tstubnet %I/%d metric %u", pxa, pxlen, metric);
       else
 	cli_msg(-1016, "\t\taddress %I/%d", pxa, pxlen);
@@ -19,6 +19,7 @@
 #include "lib/slists.h"
 #include "lib/socket.h"
 #include "lib/timer.h"
+#include "lib/buffer.h"
 #include "lib/resource.h"
 #include "nest/protocol.h"
 #include "nest/iface.h"
@@ -77,11 +78,21 @@
 #define MINLSARRIVAL 1
 #define LSINFINITY 0xffffff
 
+#define LSA_BODY_MIN 16		/* Smallest slab for LSA bodies */
+#define LSA_BODY_SLABS 5	/* Slabs for LSA bodies up to 256 B */
+
 #define OSPF_DEFAULT_TICK 1
 #define OSPF_DEFAULT_STUB_COST 1000
 #define OSPF_DEFAULT_ECMP_LIMIT 16
 #define OSPF_DEFAULT_TRANSINT 40
 
+#define OSPF_DEFAULT_SPF_INITIAL (50 MS_)
+#define OSPF_DEFAULT_SPF_SHORT (200 MS_)
+#define OSPF_DEFAULT_SPF_LONG (5 S_)
+#define OSPF_DEFAULT_SPF_HOLDDOWN (10 S_)
+#define OSPF_DEFAULT_SPF_LEARN (500 MS_)
+#define OSPF_DEFAULT_LSADB_SAVE 60
+
 #define OSPF_MIN_PKT_SIZE 256
 #define OSPF_MAX_PKT_SIZE 65535
 
@@ -92,6 +103,13 @@ struct ospf_config
 {
   struct proto_config c;
   uint tick;
+  btime spf_initial;		/* SPF delay in QUIET state */
+  btime spf_short;		/* SPF delay in SHORT_WAIT state */
+  btime spf_long;		/* SPF delay in LONG_WAIT state */
+  btime spf_holddown;		/* Time without events to return to QUIET state */
+  btime spf_learn;		/* Time to learn, after which LONG_WAIT state is entered */
+  char *lsadb_file;		/* File for LSA database snapshots, or NULL */
+  uint lsadb_save;		/* Interval of periodic snapshots, 0 for none */
   u8 ospf2;
   u8 rfc1583;
   u8 stub_router;
@@ -177,6 +195,7 @@ struct ospf_iface_patt
   int tx_priority;
   u16 tx_length;
   u16 rx_buffer;
+  u16 flood_rate;		/* Max number of LSUPD packets per second, 0 for unlimited */
 
 #define OSPF_RXBUF_MINSIZE 256	/* Minimal allowed size */
   u8 instance_id;
@@ -215,11 +234,23 @@ struct ospf_proto
   slist lsal;			/* List of all LSA's */
   int calcrt;			/* Routing table calculation scheduled?
 				   0=no, 1=normal, 2=forced reload */
+  u8 calcspf;			/* Full SPF needed, otherwise just partial calculation */
+  u8 spf_state;			/* SPF delay state (OSPF_SPF_*) */
+  timer *spf_timer;		/* Delayed routing table calculation */
+  btime spf_last_event;		/* Time of last event requesting calculation */
+  btime spf_learn_end;		/* End of learning period in SHORT_WAIT state */
+  timer *lsadb_timer;		/* Periodic LSA database snapshots */
+  event *lsadb_event;		/* Next step of running snapshot */
+  struct lsadb_save_state *lsadb_state; /* Running snapshot, or NULL */
+  uint prc_seq;			/* Number of partial calculations since last full one */
+  uint spf_runs, prc_runs;	/* Number of full and partial calculations */
   list iface_list;		/* List of OSPF interfaces (struct ospf_iface) */
   list area_list;		/* List of OSPF areas (struct ospf_area) */
   int areano;			/* Number of area I belong to */
   int padj;			/* Number of neighbors in Exchange or Loading state */
   struct fib rtf;		/* Routing table */
+  struct ort *rt_dirty;		/* List of rtf entries changed since last rt_sync() */
+  list rt_prc;			/* List of rtf entries with inter-area or external routes (ort->prc_n) */
   byte ospf2;			/* OSPF v2 or v3 */
   byte rfc1583;			/* RFC1583 compatibility */
   byte stub_router;		/* Do not forward transit traffic */
@@ -231,6 +262,7 @@ struct ospf_proto
   void *lsab;			/* LSA buffer used when originating router LSAs */
   int lsab_size, lsab_used;
   linpool *nhpool;		/* Linpool used for next hops computed in SPF */
+  slab *lsa_slab[LSA_BODY_SLABS]; /* Slabs for small LSA bodies, see ospf_lsa_body_alloc() */
   sock *vlink_sk;		/* IP socket used for vlink TX */
   u32 router_id;
   u32 last_vlink_id;		/* Interface IDs for vlinks (starts at 0x80000000) */
@@ -238,6 +270,11 @@ struct ospf_proto
   struct tbf log_lsa_tbf;	/* TBF for LSA messages */
 };
 
+/* SPF delay states (RFC 8405 5.1) */
+#define OSPF_SPF_QUIET		0
+#define OSPF_SPF_SHORT_WAIT	1
+#define OSPF_SPF_LONG_WAIT	2
+
 struct ospf_area
 {
   node n;
@@ -245,7 +282,9 @@ struct ospf_area
   struct ospf_area_config *ac;	/* Related area config */
   struct top_hash_entry *rt;	/* My own router LSA */
   struct top_hash_entry *pxr_lsa; /* Originated prefix LSA */
-  list cand;			/* List of candidates for RT calc. */
+  BUFFER(struct top_hash_entry *) cand; /* Heap of candidates for RT calc. */
+  BUFFER(struct top_hash_entry *) order; /* Vertices in order found by RT calc. */
+  linpool *nhpool;		/* Nexthops computed by RT calc. for the area */
   struct fib net_fib;		/* Networks to advertise or not */
   struct fib enet_fib;		/* External networks for NSSAs */
   u32 options;			/* Optional features */
@@ -317,8 +356,11 @@ struct ospf_iface
   struct top_hash_entry **flood_queue;	/* LSAs queued for LSUPD */
   u8 update_link_lsa;
   u8 update_net_lsa;
-  u16 flood_queue_used;		/* The current number of LSAs in flood_queue */
-  u16 flood_queue_size;		/* The maximum number of LSAs in flood_queue */
+  uint flood_queue_used;	/* The current number of LSAs in flood_queue */
+  uint flood_queue_size;	/* The maximum number of LSAs in flood_queue */
+  struct tbf flood_tbf;		/* TBF for pacing of LSUPD packets */
+  timer *flood_timer;		/* Resumes flooding limited by flood_tbf */
+  uint flood_limited;		/* Number of times LSUPD packets were delayed by flood_tbf */
   int fadj;			/* Number of fully adjacent neighbors */
   list nbma_list;
   u8 priority;			/* A router priority for DR election */
@@ -730,12 +772,16 @@ lsa_net_count(struct ospf_lsa_header *lsa)
 /* FIXME: these four functions should be significantly redesigned w.r.t. integration,
    also should be named as ospf3_* instead of *_ipv6_* */
 
+/* The lsa_get_* functions read LSA bodies in network order, the put_* functions
+   build LSA bodies in host order (see lsab_flush()) */
+
 static inline u32 *
 lsa_get_ipv6_prefix(u32 *buf, ip_addr *addr, int *pxlen, u8 *pxopts, u16 *rest)
 {
-  u8 pxl = (*buf >> 24);
-  *pxopts = (*buf >> 16);
-  *rest = *buf;
+  u32 w = get_u32(buf);
+  u8 pxl = (w >> 24);
+  *pxopts = (w >> 16);
+  *rest = w;
   *pxlen = pxl;
   buf++;
 
@@ -743,13 +789,13 @@ lsa_get_ipv6_prefix(u32 *buf, ip_addr *addr, int *pxlen, u8 *pxopts, u16 *rest)
 
 #ifdef IPV6
   if (pxl > 0)
-    _I0(*addr) = *buf++;
+    _I0(*addr) = get_u32(buf++);
   if (pxl > 32)
-    _I1(*addr) = *buf++;
+    _I1(*addr) = get_u32(buf++);
   if (pxl > 64)
-    _I2(*addr) = *buf++;
+    _I2(*addr) = get_u32(buf++);
   if (pxl > 96)
-    _I3(*addr) = *buf++;
+    _I3(*addr) = get_u32(buf++);
 
   /* Clean up remaining bits */
   if (pxl < 128)
@@ -762,7 +808,7 @@ lsa_get_ipv6_prefix(u32 *buf, ip_addr *addr, int *pxlen, u8 *pxopts, u16 *rest)
 static inline u32 *
 lsa_get_ipv6_addr(u32 *buf, ip_addr *addr)
 {
-  *addr = *(ip_addr *) buf;
+  *addr = get_ipa(buf);
   return buf + 4;
 }
 
@@ -821,6 +867,7 @@ struct lsadb_show_data {
 
 /* ospf.c */
 void ospf_schedule_rtcalc(struct ospf_proto *p);
+void ospf_schedule_prc(struct ospf_proto *p);
 
 static inline void ospf_notify_rt_lsa(struct ospf_area *oa)
 { oa->update_rt_lsa = 1; }
@@ -886,6 +933,10 @@ struct nbma_node *find_nbma_node_(list *nnl, ip_addr ip);
 static inline struct nbma_node * find_nbma_node(struct ospf_iface *ifa, ip_addr ip)
 { return find_nbma_node_(&ifa->nbma_list, ip); }
 
+/* Initial size of flood_queue, it is enlarged when flooding is paced */
+static inline uint ifa_flood_queue_size(struct ospf_iface *ifa)
+{ return ifa->tx_length / 24; }
+
 /* neighbor.c */
 struct ospf_neighbor *ospf_neighbor_new(struct ospf_iface *ifa);
 void ospf_neigh_sm(struct ospf_neighbor *n, int event);
@@ -959,6 +1010,11 @@ int ospf_send_lsupd(struct ospf_proto *p, struct top_hash_entry **lsa_list, uint
 void ospf_rxmt_lsupd(struct ospf_proto *p, struct ospf_neighbor *n);
 void ospf_receive_lsupd(struct ospf_packet *pkt, struct ospf_iface *ifa, struct ospf_neighbor *n);
 
+/* snapshot.c */
+void ospf_lsadb_save(struct ospf_proto *p);
+void ospf_lsadb_save_start(struct ospf_proto *p);
+void ospf_lsadb_load(struct ospf_proto *p);
+
 /* lsack.c */
 void ospf_enqueue_lsack(struct ospf_neighbor *n, struct ospf_lsa_header *h_n, int queue);
 void ospf_reset_lsack_queue(struct ospf_neighbor *n);
@@ -9,8 +9,13 @@
  */
 
 #include "ospf.h"
+#include "lib/heap.h"
 
-static void add_cand(list * l, struct top_hash_entry *en,
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+
+static void add_cand(struct top_hash_entry *en,
 		     struct top_hash_entry *par, u32 dist,
 		     struct ospf_area *oa, int i);
 static void rt_sync(struct ospf_proto *p);
@@ -27,6 +32,9 @@ ospf_rt_initort(struct fib_node *fn)
   ort *ri = (ort *) fn;
   reset_ri(ri);
   ri->old_rta = NULL;
+  ri->prc_n.next = ri->prc_n.prev = NULL;
+  ri->next_dirty = NULL;
+  ri->dirty = 0;
   ri->fn.flags = 0;
 }
 
@@ -43,9 +51,9 @@ unresolved_vlink(ort *ort)
 }
 
 static inline struct mpnh *
-new_nexthop(struct ospf_proto *p, ip_addr gw, struct iface *iface, byte weight)
+new_nexthop(linpool *pool, ip_addr gw, struct iface *iface, byte weight)
 {
-  struct mpnh *nh = lp_alloc(p->nhpool, sizeof(struct mpnh));
+  struct mpnh *nh = lp_alloc(pool, sizeof(struct mpnh));
   nh->gw = gw;
   nh->iface = iface;
   nh->next = NULL;
@@ -74,7 +82,7 @@ fix_device_nexthops(struct ospf_proto *p, const struct mpnh *n, ip_addr gw)
   struct mpnh **nn2 = &root2;
 
   if (!p->ecmp)
-    return new_nexthop(p, gw, n->iface, n->weight);
+    return new_nexthop(p->nhpool, gw, n->iface, n->weight);
 
   /* This is a bit tricky. We cannot just copy the list and update n->gw,
      because the list should stay sorted, so we create two lists, one with new
@@ -82,7 +90,7 @@ fix_device_nexthops(struct ospf_proto *p, const struct mpnh *n, ip_addr gw)
 
   for (; n; n = n->next)
   {
-    struct mpnh *nn = new_nexthop(p, ipa_zero(n->gw) ? gw : n->gw, n->iface, n->weight);
+    struct mpnh *nn = new_nexthop(p->nhpool, ipa_zero(n->gw) ? gw : n->gw, n->iface, n->weight);
 
     if (ipa_zero(n->gw))
     {
@@ -333,16 +341,27 @@ ort_merge_ext(struct ospf_proto *p, ort *o, const orta *new)
 
 
 
+/* Link rtf entry with inter-area or external route for partial calculation */
+static inline void
+ort_track_prc(struct ospf_proto *p, ort *nf)
+{
+  if (nf->n.type && (nf->n.type != RTS_OSPF) && !nf->prc_n.next)
+    add_tail(&p->rt_prc, &nf->prc_n);
+}
+
 static inline void
 ri_install_net(struct ospf_proto *p, ip_addr prefix, int pxlen, const orta *new)
 {
   ort *old = (ort *) fib_get(&p->rtf, &prefix, pxlen);
   int cmp = orta_compare(p, new, &old->n);
 
+  ort_mark(p, old);
   if (cmp > 0)
     ort_replace(old, new);
   else if (cmp == 0)
     ort_merge(p, old, new);
+
+  ort_track_prc(p, old);
 }
 
 static inline void
@@ -372,10 +391,13 @@ ri_install_ext(struct ospf_proto *p, ip_addr prefix, int pxlen, const orta *new)
   ort *old = (ort *) fib_get(&p->rtf, &prefix, pxlen);
   int cmp = orta_compare_ext(p, new, &old->n);
 
+  ort_mark(p, old);
   if (cmp > 0)
     ort_replace(old, new);
   else if (cmp == 0)
     ort_merge_ext(p, old, new);
+
+  ort_track_prc(p, old);
 }
 
 static inline struct ospf_iface *
@@ -437,7 +459,7 @@ add_network(struct ospf_area *oa, ip_addr px, int pxlen, int metric, struct top_
 
     struct ospf_iface *ifa;
     ifa = ospf_is_v2(p) ? rt_pos_to_ifa(oa, pos) : px_pos_to_ifa(oa, pos);
-    nf.nhs = ifa ? new_nexthop(p, IPA_NONE, ifa->iface, ifa->ecmp_weight) : NULL;
+    nf.nhs = ifa ? new_nexthop(p->nhpool, IPA_NONE, ifa->iface, ifa->ecmp_weight) : NULL;
   }
 
   ri_install_net(p, px, pxlen, &nf);
@@ -445,42 +467,30 @@ add_network(struct ospf_area *oa, ip_addr px, int pxlen, int metric, struct top_
 
 
 
+/*
+ * The calculation of shortest paths for an area is split to two steps. The
+ * first one, spfa_walk_rt() and spfa_walk_net() called from ospf_rt_spfa_tree(),
+ * is the Dijkstra's algorithm itself. It touches only SPF data of vertices of
+ * the area (and the area itself) and it reads the LSA database, therefore it
+ * may be done for several areas in parallel (see ospf_rt_spf_areas()). The
+ * second one, spfa_process_rt() and spfa_process_net() called from
+ * ospf_rt_spfa(), installs routes to the found vertices and their stub
+ * networks to routing tables in the same order as they were found.
+ */
+
 static inline void
-spfa_process_rt(struct ospf_proto *p, struct ospf_area *oa, struct top_hash_entry *act)
+spfa_walk_rt(struct ospf_proto *p, struct ospf_area *oa, struct top_hash_entry *act)
 {
-  struct ospf_lsa_rt *rt = act->lsa_body;
+  u32 options = lsa_get_rt_options(act->lsa_body);
   struct ospf_lsa_rt_walk rtl;
   struct top_hash_entry *tmp;
-  ip_addr prefix;
-  int pxlen, i;
+  int i;
 
-  if (rt->options & OPT_RT_V)
+  if (options & OPT_RT_V)
     oa->trcap = 1;
 
-  /*
-   * In OSPFv3, all routers are added to per-area routing
-   * tables. But we use it just for ASBRs and ABRs. For the
-   * purpose of the last step in SPF - prefix-LSA processing in
-   * spfa_process_prefixes(), we use information stored in LSA db.
-   */
-  if (((rt->options & OPT_RT_E) || (rt->options & OPT_RT_B))
-      && (act->lsa.rt != p->router_id))
-  {
-    orta nf = {
-      .type = RTS_OSPF,
-      .options = rt->options,
-      .metric1 = act->dist,
-      .metric2 = LSINFINITY,
-      .tag = 0,
-      .rid = act->lsa.rt,
-      .oa = oa,
-      .nhs = act->nhs
-    };
-    ri_install_rt(oa, act->lsa.rt, &nf);
-  }
-
   /* Errata 2078 to RFC 5340 4.8.1 - skip links from non-routing nodes */
-  if (ospf_is_v3(p) && (act != oa->rt) && !(rt->options & OPT_R))
+  if (ospf_is_v3(p) && (act != oa->rt) && !(options & OPT_R))
     return;
 
   /* Now process Rt links */
@@ -491,20 +501,7 @@ spfa_process_rt(struct ospf_proto *p, struct ospf_area *oa, struct top_hash_entr
     switch (rtl.type)
     {
     case LSART_STUB:
-
-      /* Should not happen, LSART_STUB is not defined in OSPFv3 */
-      if (ospf_is_v3(p))
-	break;
-
-      /*
-       * RFC 2328 in 16.1. (2a) says to handle stub networks in an
-       * second phase after the SPF for an area is calculated. We get
-       * the same result by handing them here because add_network()
-       * will keep the best (not the first) found route.
-       */
-      prefix = ipa_from_u32(rtl.id & rtl.data);
-      pxlen = u32_masklen(rtl.data);
-      add_network(oa, prefix, pxlen, act->dist + rtl.metric, act, i);
+      /* Stub networks are handled in spfa_process_rt() */
       break;
 
     case LSART_NET:
@@ -517,30 +514,89 @@ spfa_process_rt(struct ospf_proto *p, struct ospf_area *oa, struct top_hash_entr
       break;
     }
 
-    add_cand(&oa->cand, tmp, act, act->dist + rtl.metric, oa, i);
+    add_cand(tmp, act, act->dist + rtl.metric, oa, i);
   }
 }
 
 static inline void
-spfa_process_net(struct ospf_proto *p, struct ospf_area *oa, struct top_hash_entry *act)
+spfa_walk_net(struct ospf_proto *p, struct ospf_area *oa, struct top_hash_entry *act)
 {
   struct ospf_lsa_net *ln = act->lsa_body;
   struct top_hash_entry *tmp;
+  int i, cnt;
+
+  cnt = lsa_net_count(&act->lsa);
+  for (i = 0; i < cnt; i++)
+  {
+    tmp = ospf_hash_find_rt(p->gr, oa->areaid, get_u32(&ln->routers[i]));
+    add_cand(tmp, act, act->dist, oa, -1);
+  }
+}
+
+static inline void
+spfa_process_rt(struct ospf_proto *p, struct ospf_area *oa, struct top_hash_entry *act)
+{
+  u32 options = lsa_get_rt_options(act->lsa_body);
+  struct ospf_lsa_rt_walk rtl;
   ip_addr prefix;
-  int pxlen, i, cnt;
+  int pxlen, i;
 
-  if (ospf_is_v2(p))
+  /*
+   * In OSPFv3, all routers are added to per-area routing
+   * tables. But we use it just for ASBRs and ABRs. For the
+   * purpose of the last step in SPF - prefix-LSA processing in
+   * spfa_process_prefixes(), we use information stored in LSA db.
+   */
+  if (((options & OPT_RT_E) || (options & OPT_RT_B))
+      && (act->lsa.rt != p->router_id))
   {
-    prefix = ipa_from_u32(act->lsa.id & ln->optx);
-    pxlen = u32_masklen(ln->optx);
-    add_network(oa, prefix, pxlen, act->dist, act, -1);
+    orta nf = {
+      .type = RTS_OSPF,
+      .options = options,
+      .metric1 = act->dist,
+      .metric2 = LSINFINITY,
+      .tag = 0,
+      .rid = act->lsa.rt,
+      .oa = oa,
+      .nhs = act->nhs
+    };
+    ri_install_rt(oa, act->lsa.rt, &nf);
   }
 
-  cnt = lsa_net_count(&act->lsa);
-  for (i = 0; i < cnt; i++)
+  /* LSART_STUB is not defined in OSPFv3 */
+  if (ospf_is_v3(p))
+    return;
+
+  for (lsa_walk_rt_init(p, act, &rtl), i = 0; lsa_walk_rt(&rtl); i++)
+  {
+    if (rtl.type != LSART_STUB)
+      continue;
+
+    /*
+     * RFC 2328 in 16.1. (2a) says to handle stub networks in an
+     * second phase after the SPF for an area is calculated. We get
+     * the same result by handing them here because add_network()
+     * will keep the best (not the first) found route.
+     */
+    prefix = ipa_from_u32(rtl.id & rtl.data);
+    pxlen = u32_masklen(rtl.data);
+    add_network(oa, prefix, pxlen, act->dist + rtl.metric, act, i);
+  }
+}
+
+static inline void
+spfa_process_net(struct ospf_proto *p UNUSED4 UNUSED6, struct ospf_area *oa, struct top_hash_entry *act)
+{
+  struct ospf_lsa_net *ln = act->lsa_body;
+  ip_addr prefix;
+  int pxlen;
+
+  if (ospf_is_v2(p))
   {
-    tmp = ospf_hash_find_rt(p->gr, oa->areaid, ln->routers[i]);
-    add_cand(&oa->cand, tmp, act, act->dist, oa, -1);
+    u32 netmask = get_u32(&ln->optx);
+    prefix = ipa_from_u32(act->lsa.id & netmask);
+    pxlen = u32_masklen(netmask);
+    add_network(oa, prefix, pxlen, act->dist, act, -1);
   }
 }
 
@@ -548,7 +604,7 @@ static inline void
 spfa_process_prefixes(struct ospf_proto *p, struct ospf_area *oa)
 {
   struct top_hash_entry *en, *src;
-  struct ospf_lsa_prefix *px;
+  struct ospf_lsa_prefix px;
   ip_addr pxa;
   int pxlen;
   u8 pxopts;
@@ -567,13 +623,13 @@ spfa_process_prefixes(struct ospf_proto *p, struct ospf_area *oa)
     if (en->lsa.age == LSA_MAXAGE)
       continue;
 
-    px = en->lsa_body;
+    buf = lsa_get_prefix_hdr(en->lsa_body, &px);
 
     /* For router prefix-LSA, we would like to find the first router-LSA */
-    if (px->ref_type == LSA_T_RT)
-      src = ospf_hash_find_rt(p->gr, oa->areaid, px->ref_rt);
+    if (px.ref_type == LSA_T_RT)
+      src = ospf_hash_find_rt(p->gr, oa->areaid, px.ref_rt);
     else
-      src = ospf_hash_find(p->gr, oa->areaid, px->ref_id, px->ref_rt, px->ref_type);
+      src = ospf_hash_find(p->gr, oa->areaid, px.ref_id, px.ref_rt, px.ref_type);
 
     if (!src)
       continue;
@@ -585,8 +641,7 @@ spfa_process_prefixes(struct ospf_proto *p, struct ospf_area *oa)
     if ((src->lsa_type != LSA_T_RT) && (src->lsa_type != LSA_T_NET))
       continue;
 
-    buf = px->rest;
-    for (i = 0; i < px->pxcount; i++)
+    for (i = 0; i < px.pxcount; i++)
       {
 	buf = lsa_get_ipv6_prefix(buf, &pxa, &pxlen, &pxopts, &metric);
 
@@ -602,62 +657,239 @@ spfa_process_prefixes(struct ospf_proto *p, struct ospf_area *oa)
   }
 }
 
-/* RFC 2328 16.1. calculating shortest paths for an area */
+/*
+ * Candidates in Dijkstra's algorithm are kept in a binary heap ordered by
+ * distance, indexed from 1. Each candidate knows its position in the heap
+ * (cand_pos), so it can be moved up when a shorter path is found. Networks
+ * are preferred to routers with the same distance (RFC 2328 16.1. (2d)).
+ */
+#define CAND_LESS(a,b)	(((a)->dist < (b)->dist) || \
+			 (((a)->dist == (b)->dist) && ((a)->lsa_type != LSA_T_RT) && ((b)->lsa_type == LSA_T_RT)))
+#define CAND_SWAP(heap,a,b,t)	(t = heap[a], heap[a] = heap[b], heap[b] = t, \
+				 heap[a]->cand_pos = (a), heap[b]->cand_pos = (b))
+
+static inline void
+cand_insert(struct ospf_area *oa, struct top_hash_entry *en)
+{
+  uint num = oa->cand.used;
+  BUFFER_PUSH(oa->cand) = en;
+  en->cand_pos = num;
+  HEAP_INSERT(oa->cand.data, num, struct top_hash_entry *, CAND_LESS, CAND_SWAP);
+}
+
+static inline void
+cand_decrease(struct ospf_area *oa, struct top_hash_entry *en)
+{
+  HEAP_DECREASE(oa->cand.data, oa->cand.used - 1, struct top_hash_entry *, CAND_LESS, CAND_SWAP, en->cand_pos);
+}
+
+static inline void
+cand_delete(struct ospf_area *oa, struct top_hash_entry *en)
+{
+  uint num = oa->cand.used - 1;
+  HEAP_DELETE(oa->cand.data, num, struct top_hash_entry *, CAND_LESS, CAND_SWAP, en->cand_pos);
+  BUFFER_POP(oa->cand);
+  en->cand_pos = 0;
+}
+
+static inline int
+spfa_root_valid(struct ospf_area *oa)
+{
+  return oa->rt && (oa->rt->lsa.age != LSA_MAXAGE);
+}
+
+/* RFC 2328 16.1. Dijkstra's algorithm for an area */
 static void
-ospf_rt_spfa(struct ospf_area *oa)
+ospf_rt_spfa_tree(struct ospf_area *oa)
 {
   struct ospf_proto *p = oa->po;
   struct top_hash_entry *act;
-  node *n;
-
-  if (oa->rt == NULL)
-    return;
-  if (oa->rt->lsa.age == LSA_MAXAGE)
-    return;
-
-  OSPF_TRACE(D_EVENTS, "Starting routing table calculation for area %R", oa->areaid);
 
   /* 16.1. (1) */
-  init_list(&oa->cand);		/* Empty list of candidates */
+  BUFFER_SET(oa->cand, 1);	/* Empty heap of candidates */
+  BUFFER_FLUSH(oa->order);
   oa->trcap = 0;
 
+  if (!spfa_root_valid(oa))
+    return;
+
   DBG("LSA db prepared, adding me into candidate list.\n");
 
   oa->rt->dist = 0;
   oa->rt->color = CANDIDATE;
-  add_head(&oa->cand, &oa->rt->cn);
+  cand_insert(oa, oa->rt);
   DBG("RT LSA: rt: %R, id: %R, type: %u\n",
       oa->rt->lsa.rt, oa->rt->lsa.id, oa->rt->lsa_type);
 
-  while (!EMPTY_LIST(oa->cand))
+  while (oa->cand.used > 1)
   {
-    n = HEAD(oa->cand);
-    act = SKIP_BACK(struct top_hash_entry, cn, n);
-    rem_node(n);
+    act = oa->cand.data[1];
+    cand_delete(oa, act);
 
     DBG("Working on LSA: rt: %R, id: %R, type: %u\n",
 	act->lsa.rt, act->lsa.id, act->lsa_type);
 
     act->color = INSPF;
+    BUFFER_PUSH(oa->order) = act;
+
     switch (act->lsa_type)
     {
     case LSA_T_RT:
-      spfa_process_rt(p, oa, act);
+      spfa_walk_rt(p, oa, act);
       break;
 
     case LSA_T_NET:
-      spfa_process_net(p, oa, act);
+      spfa_walk_net(p, oa, act);
       break;
 
     default:
       log(L_WARN "%s: Unknown LSA type in SPF: %d", p->p.name, act->lsa_type);
     }
   }
+}
+
+/* RFC 2328 16.1. calculating shortest paths for an area */
+static void
+ospf_rt_spfa(struct ospf_area *oa)
+{
+  struct ospf_proto *p = oa->po;
+  struct top_hash_entry *act;
+  uint i;
+
+  /* Shortest-path tree was already built by ospf_rt_spfa_tree() */
+  if (!oa->order.used)
+    return;
+
+  for (i = 0; i < oa->order.used; i++)
+  {
+    act = oa->order.data[i];
+
+    switch (act->lsa_type)
+    {
+    case LSA_T_RT:
+      spfa_process_rt(p, oa, act);
+      break;
+
+    case LSA_T_NET:
+      spfa_process_net(p, oa, act);
+      break;
+    }
+  }
 
   if (ospf_is_v3(p))
     spfa_process_prefixes(p, oa);
 }
 
+#ifdef USE_PTHREADS
+
+struct ospf_spf_job {
+  pthread_mutex_t lock;
+  struct ospf_area **areas;
+  uint count, next;
+};
+
+static struct ospf_area *
+ospf_spf_job_next(struct ospf_spf_job *job)
+{
+  struct ospf_area *oa = NULL;
+
+  pthread_mutex_lock(&job->lock);
+  if (job->next < job->count)
+    oa = job->areas[job->next++];
+  pthread_mutex_unlock(&job->lock);
+
+  return oa;
+}
+
+static void *
+ospf_spf_worker(void *data)
+{
+  struct ospf_spf_job *job = data;
+  struct ospf_area *oa;
+
+  while (oa = ospf_spf_job_next(job))
+    ospf_rt_spfa_tree(oa);
+
+  return NULL;
+}
+
+/*
+ * Workers must not allocate from shared pools, therefore both the heap of
+ * candidates and the array of found vertices are preallocated for the number
+ * of router and network LSAs in the area, which limits their size.
+ */
+static void
+ospf_rt_spf_prealloc(struct ospf_proto *p)
+{
+  struct top_hash_entry *en;
+  struct ospf_area *oa;
+  uint n;
+
+  WALK_LIST(oa, p->area_list)
+    BUFFER_FLUSH(oa->order);
+
+  /* The array of found vertices is used as a counter here */
+  WALK_SLIST(en, p->lsal)
+    if (((en->lsa_type == LSA_T_RT) || (en->lsa_type == LSA_T_NET)) &&
+	(oa = ospf_find_area(p, en->domain)))
+      oa->order.used++;
+
+  WALK_LIST(oa, p->area_list)
+  {
+    n = oa->order.used;
+    BUFFER_SET(oa->order, n);
+    BUFFER_SET(oa->cand, n + 1);
+  }
+}
+
+/*
+ * Shortest-path trees of areas are independent, so with more areas they are
+ * built by up to %OSPF_SPF_THREADS threads (including the main one), which
+ * take areas from a shared job. The LSA database is not changed during that,
+ * as the main thread waits for all workers to finish. Routes are installed
+ * afterwards by the main thread in the usual order of areas.
+ */
+static void
+ospf_rt_spf_areas(struct ospf_proto *p)
+{
+  struct ospf_spf_job job = { .lock = PTHREAD_MUTEX_INITIALIZER };
+  pthread_t threads[OSPF_SPF_THREADS - 1];
+  struct ospf_area *oa;
+  uint i, max, num = 0;
+
+  job.areas = alloca(p->areano * sizeof(struct ospf_area *));
+  WALK_LIST(oa, p->area_list)
+    job.areas[job.count++] = oa;
+
+  max = MIN(job.count, OSPF_SPF_THREADS);
+  if (max > 1)
+    ospf_rt_spf_prealloc(p);
+
+  for (i = 0; i < max - 1; i++, num++)
+    if (pthread_create(&threads[i], NULL, ospf_spf_worker, &job))
+      break;
+
+  ospf_spf_worker(&job);
+
+  for (i = 0; i < num; i++)
+    pthread_join(threads[i], NULL);
+
+  pthread_mutex_destroy(&job.lock);
+}
+
+#else
+
+static void
+ospf_rt_spf_areas(struct ospf_proto *p)
+{
+  struct ospf_area *oa;
+
+  WALK_LIST(oa, p->area_list)
+    ospf_rt_spfa_tree(oa);
+}
+
+#endif
+
 static int
 link_back(struct ospf_area *oa, struct top_hash_entry *en, struct top_hash_entry *par)
 {
@@ -722,7 +954,7 @@ link_back(struct ospf_area *oa, struct top_hash_entry *en, struct top_hash_entry
     cnt = lsa_net_count(&en->lsa);
     for (i = 0; i < cnt; i++)
     {
-      tmp = ospf_hash_find_rt(p->gr, oa->areaid, ln->routers[i]);
+      tmp = ospf_hash_find_rt(p->gr, oa->areaid, get_u32(&ln->routers[i]));
       if (tmp == par)
 	return 1;
     }
@@ -925,6 +1157,9 @@ ospf_rt_sum_tr(struct ospf_area *oa)
       re->n.metric1 = metric;
       re->n.voa = oa;
       re->n.nhs = abr->n.nhs;
+
+      if (en->lsa_type == LSA_T_SUM_NET)
+	ort_mark(p, re);
     }
   }
 }
@@ -1182,7 +1417,10 @@ ospf_rt_abr1(struct ospf_proto *p)
 
     /* RFC 2328 G.3 - incomplete resolution of virtual next hops - networks */
     if (nf->n.type && unresolved_vlink(nf))
+    {
       reset_ri(nf);
+      ort_mark(p, nf);
+    }
 
 
     /* Compute condensed area networks */
@@ -1198,6 +1436,7 @@ ospf_rt_abr1(struct ospf_proto *p)
 	  /* Get a RT entry and mark it to know that it is an area network */
 	  ort *nfi = (ort *) fib_get(&p->rtf, &anet->fn.prefix, anet->fn.pxlen);
 	  nfi->area_net = 1;
+	  ort_mark(p, nfi);
 
 	  /* 16.2. (3) */
 	  if (nfi->n.type == RTS_OSPF_IA)
@@ -1214,6 +1453,7 @@ ospf_rt_abr1(struct ospf_proto *p)
   ip_addr addr = IPA_NONE;
   default_nf = (ort *) fib_get(&p->rtf, &addr, 0);
   default_nf->area_net = 1;
+  ort_mark(p, default_nf);
 
   struct ospf_area *oa;
   WALK_LIST(oa, p->area_list)
@@ -1307,9 +1547,8 @@ ospf_rt_abr2(struct ospf_proto *p)
 	if (!en || (en->color != INSPF))
 	  continue;
 
-	struct ospf_lsa_rt *rt = en->lsa_body;
 	/* There is better candidate - Nt-bit or higher Router ID */
-	if ((rt->options & OPT_RT_NT) || (p->router_id < nf->n.rid))
+	if ((lsa_get_rt_options(en->lsa_body) & OPT_RT_NT) || (p->router_id < nf->n.rid))
 	{
 	  translate = 0;
 	  goto decided;
@@ -1356,6 +1595,7 @@ ospf_rt_abr2(struct ospf_proto *p)
 	  /* Get a RT entry and mark it to know that it is an area network */
 	  nf2 = (ort *) fib_get(&p->rtf, &anet->fn.prefix, anet->fn.pxlen);
 	  nf2->area_net = 1;
+	  ort_mark(p, nf2);
 	}
 
 	u32 metric = (nf->n.type == RTS_OSPF_EXT1) ?
@@ -1419,6 +1659,9 @@ ospf_ext_spf(struct ospf_proto *p)
     if ((en->lsa_type != LSA_T_EXT) && (en->lsa_type != LSA_T_NSSA))
       continue;
 
+    /* Not reset by partial calculation */
+    en->color = OUTSPF;
+
     if (en->lsa.age == LSA_MAXAGE)
       continue;
 
@@ -1546,8 +1789,47 @@ ospf_ext_spf(struct ospf_proto *p)
   }
 }
 
+/*
+ * Cleanup of routing tables and data for partial calculation. Intra-area
+ * routes and SPF data of router and network LSAs are kept, only entries with
+ * inter-area and external routes from the last calculation are reset. Partial
+ * calculation is done just in routers attached to one area, so there are no
+ * condensed area networks and no LSAs originated during calculation.
+ */
+static void
+ospf_rt_reset_prc(struct ospf_proto *p)
+{
+  struct ospf_area *oa;
+  ort *ri;
+
+  while (!EMPTY_LIST(p->rt_prc))
+  {
+    ri = SKIP_BACK(ort, prc_n, HEAD(p->rt_prc));
+    rem_node(&ri->prc_n);
+
+    /* Entries may get intra-area routes in later steps of full calculation */
+    if (ri->n.type == RTS_OSPF)
+      continue;
+
+    ort_mark(p, ri);
+    reset_ri(ri);
+  }
+
+  /* Reset ASBR routing tables, these are small */
+  WALK_LIST(oa, p->area_list)
+  {
+    FIB_WALK(&oa->rtr, nftmp)
+    {
+      ri = (ort *) nftmp;
+      if (ri->n.type != RTS_OSPF)
+	reset_ri(ri);
+    }
+    FIB_WALK_END;
+  }
+}
+
 /* Cleanup of routing tables and data */
-void
+static void
 ospf_rt_reset(struct ospf_proto *p)
 {
   struct ospf_area *oa;
@@ -1555,12 +1837,27 @@ ospf_rt_reset(struct ospf_proto *p)
   struct area_net *anet;
   ort *ri;
 
-  /* Reset old routing table */
+  /*
+   * Reset old routing table. Entries which had a route or an exported route
+   * are marked dirty, so rt_sync() withdraws or removes them if they are not
+   * calculated again. Empty entries are left alone.
+   */
   FIB_WALK(&p->rtf, nftmp)
   {
     ri = (ort *) nftmp;
-    ri->area_net = 0;
-    ri->keep = 0;
+
+    if (ri->area_net)
+    {
+      ri->area_net = 0;
+      ort_mark(p, ri);
+    }
+
+    if (ri->n.type || ri->old_rta)
+      ort_mark(p, ri);
+
+    if (ri->prc_n.next)
+      rem_node(&ri->prc_n);
+
     reset_ri(ri);
   }
   FIB_WALK_END;
@@ -1616,6 +1913,17 @@ ospf_rt_reset(struct ospf_proto *p)
  * Calculation of internal paths in an area is described in 16.1 of RFC 2328.
  * It's based on Dijkstra's shortest path tree algorithms.
  * This function is invoked from ospf_disp().
+ *
+ * When just summary or external LSAs changed since the last calculation (see
+ * ospf_schedule_prc()), the shortest-path trees and intra-area routes from the
+ * last calculation are kept and only inter-area and external routes are
+ * recalculated (partial route calculation). This is done only for routers
+ * attached to one area, as in ABRs the later steps modify intra-area routes.
+ * Partial calculation does not walk the whole routing table, it resets only
+ * entries from the last calculation linked in the list in @p->rt_prc.
+ * Next hops computed in SPF are kept in the nhpool until the next full
+ * calculation, therefore the full calculation is forced after
+ * %OSPF_PRC_MAX partial ones to bound the pool.
  */
 void
 ospf_rt_spf(struct ospf_proto *p)
@@ -1625,14 +1933,43 @@ ospf_rt_spf(struct ospf_proto *p)
   if (p->areano == 0)
     return;
 
-  OSPF_TRACE(D_EVENTS, "Starting routing table calculation");
+  int full = p->calcspf || (p->areano > 1) || (p->prc_seq >= OSPF_PRC_MAX);
+
+  if (full)
+  {
+    OSPF_TRACE(D_EVENTS, "Starting routing table calculation");
+    lp_flush(p->nhpool);
+    WALK_LIST(oa, p->area_list)
+      lp_flush(oa->nhpool);
+    p->calcspf = 0;
+    p->prc_seq = 0;
+    p->spf_runs++;
+  }
+  else
+  {
+    OSPF_TRACE(D_EVENTS, "Starting partial routing table calculation");
+    p->prc_seq++;
+    p->prc_runs++;
+  }
 
   /* 16. (1) */
-  ospf_rt_reset(p);
+  if (full)
+    ospf_rt_reset(p);
+  else
+    ospf_rt_reset_prc(p);
 
   /* 16. (2) */
-  WALK_LIST(oa, p->area_list)
-    ospf_rt_spfa(oa);
+  if (full)
+  {
+    WALK_LIST(oa, p->area_list)
+      if (spfa_root_valid(oa))
+	OSPF_TRACE(D_EVENTS, "Starting routing table calculation for area %R", oa->areaid);
+
+    ospf_rt_spf_areas(p);
+
+    WALK_LIST(oa, p->area_list)
+      ospf_rt_spfa(oa);
+  }
 
   /* 16. (3) */
   ospf_rt_sum(ospf_main_area(p));
@@ -1652,7 +1989,6 @@ ospf_rt_spf(struct ospf_proto *p)
     ospf_rt_abr2(p);
 
   rt_sync(p);
-  lp_flush(p->nhpool);
 
   p->calcrt = 0;
 }
@@ -1696,7 +2032,7 @@ calc_next_hop(struct ospf_area *oa, struct top_hash_entry *en,
     if (!ifa)
       return NULL;
 
-    return new_nexthop(p, IPA_NONE, ifa->iface, ifa->ecmp_weight);
+    return new_nexthop(oa->nhpool, IPA_NONE, ifa->iface, ifa->ecmp_weight);
   }
 
   /* The second case - ptp or ptmp neighbor */
@@ -1707,13 +2043,13 @@ calc_next_hop(struct ospf_area *oa, struct top_hash_entry *en,
       return NULL;
 
     if (ifa->type == OSPF_IT_VLINK)
-      return new_nexthop(p, IPA_NONE, NULL, 0);
+      return new_nexthop(oa->nhpool, IPA_NONE, NULL, 0);
 
     struct ospf_neighbor *m = find_neigh(ifa, rid);
     if (!m || (m->state != NEIGHBOR_FULL))
       return NULL;
 
-    return new_nexthop(p, m->ip, ifa->iface, ifa->ecmp_weight);
+    return new_nexthop(oa->nhpool, m->ip, ifa->iface, ifa->ecmp_weight);
   }
 
   /* The third case - bcast or nbma neighbor */
@@ -1732,7 +2068,7 @@ calc_next_hop(struct ospf_area *oa, struct top_hash_entry *en,
       if (ipa_zero(en->lb))
 	goto bad;
 
-      return new_nexthop(p, en->lb, pn->iface, pn->weight);
+      return new_nexthop(oa->nhpool, en->lb, pn->iface, pn->weight);
     }
     else /* OSPFv3 */
     {
@@ -1746,12 +2082,12 @@ calc_next_hop(struct ospf_area *oa, struct top_hash_entry *en,
       if (!lhe)
 	return NULL;
 
-      struct ospf_lsa_link *llsa = lhe->lsa_body;
+      ip6_addr lladdr = lsa_get_link_lladdr(lhe->lsa_body);
 
-      if (ip6_zero(llsa->lladdr))
+      if (ip6_zero(lladdr))
 	return NULL;
 
-      return new_nexthop(p, ipa_from_ip6(llsa->lladdr), pn->iface, pn->weight);
+      return new_nexthop(oa->nhpool, ipa_from_ip6(lladdr), pn->iface, pn->weight);
     }
   }
 
@@ -1762,15 +2098,12 @@ calc_next_hop(struct ospf_area *oa, struct top_hash_entry *en,
 }
 
 
-/* Add LSA into list of candidates in Dijkstra's algorithm */
+/* Add LSA into heap of candidates in Dijkstra's algorithm */
 static void
-add_cand(list * l, struct top_hash_entry *en, struct top_hash_entry *par,
+add_cand(struct top_hash_entry *en, struct top_hash_entry *par,
 	 u32 dist, struct ospf_area *oa, int pos)
 {
   struct ospf_proto *p = oa->po;
-  node *prev, *n;
-  int added = 0;
-  struct top_hash_entry *act;
 
   /* 16.1. (2b) */
   if (en == NULL)
@@ -1781,8 +2114,7 @@ add_cand(list * l, struct top_hash_entry *en, struct top_hash_entry *par,
   if (ospf_is_v3(p) && (en->lsa_type == LSA_T_RT))
   {
     /* In OSPFv3, check V6 flag */
-    struct ospf_lsa_rt *rt = en->lsa_body;
-    if (!(rt->options & OPT_V6))
+    if (!(lsa_get_rt_options(en->lsa_body) & OPT_V6))
       return;
   }
 
@@ -1836,7 +2168,7 @@ add_cand(list * l, struct top_hash_entry *en, struct top_hash_entry *par,
 
     /* Merge old and new */
     int new_reuse = (par->nhs != nhs);
-    en->nhs = mpnh_merge(en->nhs, nhs, en->nhs_reuse, new_reuse, p->ecmp, p->nhpool);
+    en->nhs = mpnh_merge(en->nhs, nhs, en->nhs_reuse, new_reuse, p->ecmp, oa->nhpool);
     en->nhs_reuse = 1;
     return;
   }
@@ -1844,44 +2176,17 @@ add_cand(list * l, struct top_hash_entry *en, struct top_hash_entry *par,
   DBG("     Adding candidate: rt: %R, id: %R, type: %u\n",
       en->lsa.rt, en->lsa.id, en->lsa_type);
 
-  if (en->color == CANDIDATE)
-  {				/* We found a shorter path */
-    rem_node(&en->cn);
-  }
+  int was_cand = (en->color == CANDIDATE);
+
   en->nhs = nhs;
   en->dist = dist;
   en->color = CANDIDATE;
   en->nhs_reuse = (par->nhs != nhs);
 
-  prev = NULL;
-
-  if (EMPTY_LIST(*l))
-  {
-    add_head(l, &en->cn);
-  }
+  if (was_cand)			/* We found a shorter path */
+    cand_decrease(oa, en);
   else
-  {
-    WALK_LIST(n, *l)
-    {
-      act = SKIP_BACK(struct top_hash_entry, cn, n);
-      if ((act->dist > dist) ||
-	  ((act->dist == dist) && (act->lsa_type == LSA_T_RT)))
-      {
-	if (prev == NULL)
-	  add_head(l, &en->cn);
-	else
-	  insert_node(&en->cn, prev);
-	added = 1;
-	break;
-      }
-      prev = n;
-    }
-
-    if (!added)
-    {
-      add_tail(l, &en->cn);
-    }
-  }
+    cand_insert(oa, en);
 }
 
 static inline int
@@ -1901,7 +2206,6 @@ rt_sync(struct ospf_proto *p)
 {
   struct top_hash_entry *en;
   struct fib_iterator fit;
-  struct fib *fib = &p->rtf;
   ort *nf;
   struct ospf_area *oa;
 
@@ -1911,11 +2215,21 @@ rt_sync(struct ospf_proto *p)
   OSPF_TRACE(D_EVENTS, "Starting routing table synchronisation");
 
   DBG("Now syncing my rt table with nest's\n");
-  FIB_ITERATE_INIT(&fit, fib);
-again1:
-  FIB_ITERATE_START(fib, &fit, nftmp)
+
+  if (reload)
   {
-    nf = (ort *) nftmp;
+    FIB_WALK(&p->rtf, nftmp)
+      ort_mark(p, (ort *) nftmp);
+    FIB_WALK_END;
+  }
+
+  while (nf = p->rt_dirty)
+  {
+    p->rt_dirty = nf->next_dirty;
+    nf->next_dirty = NULL;
+    nf->dirty = 0;
+
+    int valid = !!nf->n.type;
 
     /* Sanity check of next-hop addresses, failure should not happen */
     if (nf->n.type)
@@ -1926,18 +2240,15 @@ again1:
 	{
 	  neighbor *ng = neigh_find2(&p->p, &nh->gw, nh->iface, 0);
 	  if (!ng || (ng->scope == SCOPE_HOST))
-	    { reset_ri(nf); break; }
+	    { valid = 0; break; }
 	}
     }
 
-    /* Remove configured stubnets but keep the entries */
+    /* Do not export configured stubnets, but keep the entries */
     if (nf->n.type && !nf->n.nhs)
-    {
-      reset_ri(nf);
-      nf->keep = 1;
-    }
+      valid = 0;
 
-    if (nf->n.type) /* Add the route */
+    if (valid) /* Add the route */
     {
       rta a0 = {
 	.src = p->p.main_source,
@@ -1995,14 +2306,14 @@ again1:
     }
 
     /* Remove unused rt entry, some special entries are persistent */
-    if (!nf->n.type && !nf->external_rte && !nf->area_net && !nf->keep)
+    if (!nf->n.type && !nf->external_rte && !nf->area_net)
     {
-      FIB_ITERATE_PUT(&fit, nftmp);
-      fib_delete(fib, nftmp);
-      goto again1;
+      if (nf->prc_n.next)
+	rem_node(&nf->prc_n);
+
+      fib_delete(&p->rtf, nf);
     }
   }
-  FIB_ITERATE_END(nftmp);
 
 
   WALK_LIST(oa, p->area_list)
@@ -77,20 +77,41 @@ typedef struct ort
    * (we keep reference), mainly for multipath nexthops.  old_rta == NULL means
    * route was not in the last update, in that case other old_* values are not
    * valid.
+   *
+   * Entries modified during the routing table calculation are marked dirty and
+   * linked to the list in ospf_proto->rt_dirty, so rt_sync() examines just
+   * these entries and not the whole table. Entries are also marked when they
+   * are reset while having a route, so routes that are not calculated again
+   * are withdrawn. Entries with inter-area or external routes are linked to
+   * the list in ospf_proto->rt_prc, so the partial calculation resets just
+   * these entries.
    */
   struct fib_node fn;
   orta n;
   u32 old_metric1, old_metric2, old_tag, old_rid;
   rta *old_rta;
+  node prc_n;			/* Node in list of entries with inter-area or external routes */
+  struct ort *next_dirty;	/* Next entry in list of dirty entries */
   u8 external_rte;
   u8 area_net;
-  u8 keep;
+  u8 dirty;			/* Entry is in list of dirty entries */
 }
 ort;
 
 static inline int rt_is_nssa(ort *nf)
 { return nf->n.options & ORTA_NSSA; }
 
+/* Mark rtf entry to be examined by rt_sync() */
+static inline void ort_mark(struct ospf_proto *p, ort *nf)
+{
+  if (nf->dirty)
+    return;
+
+  nf->dirty = 1;
+  nf->next_dirty = p->rt_dirty;
+  p->rt_dirty = nf;
+}
+
 
 /*
  * Invariants for structs top_hash_entry (nodes of LSA db)
@@ -126,6 +147,9 @@ static inline int rt_is_nssa(ort *nf)
  * appear in ASBR pre-selection and external routes processing.
  */
 
+#define OSPF_PRC_MAX	32	/* Max number of partial calculations in a row */
+#define OSPF_SPF_THREADS 4	/* Max number of threads building shortest-path trees */
+
 void ospf_rt_spf(struct ospf_proto *p);
 void ospf_rt_initort(struct fib_node *fn);
 
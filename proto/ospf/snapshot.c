@@ -0,0 +1,422 @@
+/*
+ *	BIRD -- OSPF LSA Database Snapshots
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/*
+ * The LSA database may be saved to a file (see ospf_lsadb_save()), which is
+ * done periodically and when the protocol is shut down. When the protocol is
+ * started again, LSAs from the snapshot are installed into the LSA database
+ * (see ospf_lsadb_load()) before any adjacency is formed. The database
+ * exchange with neighbors then finds mostly the same LSA instances and just a
+ * few of them have to be requested, while the routing table calculation may
+ * be done immediately from the restored LSAs.
+ *
+ * The snapshot file starts with a header (struct lsadb_file_hdr) followed by
+ * records, each of them is a record header (struct lsadb_rec_hdr) followed by
+ * the LSA (header and body) in the same format as in OSPF packets. All
+ * values are in network byte order. Only received LSAs with area or AS
+ * flooding scope are saved. Self-originated LSAs are originated again after
+ * the start, while link-local LSAs are bound to interface IDs, which may
+ * change. LSA ages are advanced by the time passed since the snapshot was
+ * saved and old snapshots are ignored completely, as LSAs in them are
+ * probably no longer valid.
+ *
+ * Periodic snapshots (see ospf_lsadb_save_start()) are written in steps of
+ * %LSADB_SAVE_STEP LSAs from an event, so a large database does not block the
+ * main loop. The LSA list is walked by an asynchronous iterator, so LSAs may
+ * be added or removed between steps. The snapshot time in the header is the
+ * time of its start, therefore ages of LSAs written later are overestimated
+ * a bit after the load, which is harmless.
+ *
+ * The snapshot is read by mmap(). Records are not aligned in the file, so
+ * they are copied to aligned memory before they are accessed.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ospf.h"
+
+
+#define LSADB_MAGIC	"BIRDLSDB"
+#define LSADB_VERSION	1
+#define LSADB_MAX_AGE	LSREFRESHTIME	/* Older snapshots are ignored */
+#define LSADB_SAVE_STEP	256		/* LSAs written in one step of periodic snapshot */
+
+struct lsadb_file_hdr
+{
+  char magic[8];
+  u32 version;			/* LSADB_VERSION */
+  u32 ospf_version;		/* 2 or 3 */
+  u32 router_id;
+  u32 time;			/* Real time when the snapshot was saved */
+  u32 count;			/* Number of records */
+};
+
+struct lsadb_rec_hdr
+{
+  u32 domain;			/* Area ID, 0 for AS scope */
+  u16 type;			/* LSA type (LSA_T_*) */
+  u16 length;			/* LSA length, including LSA header */
+};
+
+
+static inline int
+lsadb_saved(struct ospf_proto *p, struct top_hash_entry *en)
+{
+  return en->lsa_body && (en->lsa.age < LSA_MAXAGE) &&
+    (en->lsa.rt != p->router_id) && (LSA_SCOPE(en->lsa_type) != LSA_SCOPE_LINK);
+}
+
+struct lsadb_save_state
+{
+  FILE *file;
+  char *name;			/* Snapshot file name */
+  char *tmp;			/* Temporary file name, renamed when done */
+  siterator si;			/* Position in the LSA list */
+  bird_clock_t time;		/* Real time when the snapshot was started */
+  uint count;			/* Number of written records */
+};
+
+static void lsadb_save_event(void *data);
+
+static int
+lsadb_save_open(struct ospf_proto *p)
+{
+  struct ospf_config *cf = (struct ospf_config *) p->p.cf;
+  struct lsadb_save_state *s;
+  struct lsadb_file_hdr fh = {};
+  uint len;
+
+  if (!cf->lsadb_file)
+    return 0;
+
+  len = strlen(cf->lsadb_file);
+  s = mb_allocz(p->p.pool, sizeof(struct lsadb_save_state));
+  s->name = mb_alloc(p->p.pool, len + 1);
+  s->tmp = mb_alloc(p->p.pool, len + 5);
+  strcpy(s->name, cf->lsadb_file);
+  strcpy(s->tmp, cf->lsadb_file);
+  strcat(s->tmp, ".tmp");
+
+  s->file = fopen(s->tmp, "w");
+  if (!s->file)
+  {
+    log(L_ERR "%s: Cannot create LSA database snapshot %s: %m", p->p.name, s->tmp);
+    mb_free(s->name);
+    mb_free(s->tmp);
+    mb_free(s);
+    return 0;
+  }
+
+  /* Space for the header, written at the end */
+  fwrite(&fh, sizeof(fh), 1, s->file);
+
+  s->time = now_real;
+  s_init(&s->si, &p->lsal);
+
+  p->lsadb_state = s;
+  return 1;
+}
+
+static void
+lsadb_save_close(struct ospf_proto *p)
+{
+  struct lsadb_save_state *s = p->lsadb_state;
+  struct lsadb_file_hdr fh = {};
+
+  memcpy(fh.magic, LSADB_MAGIC, sizeof(fh.magic));
+  fh.version = htonl(LSADB_VERSION);
+  fh.ospf_version = htonl(ospf_get_version(p));
+  fh.router_id = htonl(p->router_id);
+  fh.time = htonl(s->time);
+  fh.count = htonl(s->count);
+
+  rewind(s->file);
+  fwrite(&fh, sizeof(fh), 1, s->file);
+
+  int err = ferror(s->file);
+  if (fclose(s->file) || err)
+  {
+    log(L_ERR "%s: Cannot write LSA database snapshot %s: %m", p->p.name, s->tmp);
+    unlink(s->tmp);
+  }
+  else if (rename(s->tmp, s->name) < 0)
+  {
+    log(L_ERR "%s: Cannot rename LSA database snapshot %s: %m", p->p.name, s->tmp);
+    unlink(s->tmp);
+  }
+  else
+    OSPF_TRACE(D_EVENTS, "Saved %u LSAs to %s", s->count, s->name);
+
+  mb_free(s->name);
+  mb_free(s->tmp);
+  mb_free(s);
+  p->lsadb_state = NULL;
+}
+
+/*
+ * Write next @max LSAs of the running snapshot. Returns 1 when the snapshot
+ * is finished and closed, 0 when it should be called again.
+ */
+static int
+lsadb_save_step(struct ospf_proto *p, uint max)
+{
+  struct lsadb_save_state *s = p->lsadb_state;
+  struct lsadb_rec_hdr rh;
+  struct ospf_lsa_header lsa, lsa_n;
+  struct top_hash_entry *en;
+  bird_clock_t age;
+  uint blen;
+
+  en = (void *) s_get(&s->si);
+
+  for (; SNODE_VALID(en); en = SNODE_NEXT(en))
+  {
+    if (!max--)
+    {
+      s_put(&s->si, SNODE en);
+      return 0;
+    }
+
+    if (!lsadb_saved(p, en))
+      continue;
+
+    age = en->init_age + (now - en->inst_time);
+    if (age >= LSA_MAXAGE)
+      continue;
+
+    lsa = en->lsa;
+    lsa.age = age;
+    blen = lsa.length - sizeof(struct ospf_lsa_header);
+
+    rh.domain = htonl(en->domain);
+    rh.type = htons(en->lsa_type);
+    rh.length = htons(lsa.length);
+    lsa_hton_hdr(&lsa, &lsa_n);
+
+    /* LSA body is already in network order */
+    fwrite(&rh, sizeof(rh), 1, s->file);
+    fwrite(&lsa_n, sizeof(lsa_n), 1, s->file);
+    fwrite(en->lsa_body, blen, 1, s->file);
+    s->count++;
+  }
+
+  lsadb_save_close(p);
+  return 1;
+}
+
+static void
+lsadb_save_event(void *data)
+{
+  struct ospf_proto *p = data;
+
+  if (!lsadb_save_step(p, LSADB_SAVE_STEP))
+    ev_schedule(p->lsadb_event);
+}
+
+/**
+ * ospf_lsadb_save_start - start periodic LSA database snapshot
+ * @p: OSPF protocol instance
+ *
+ * This function starts writing of the snapshot of the LSA database to the
+ * file given by the &lsadb_file option, if configured. The snapshot is
+ * written in steps from an event. If the previous snapshot is still being
+ * written, nothing is done.
+ */
+void
+ospf_lsadb_save_start(struct ospf_proto *p)
+{
+  if (p->lsadb_state || !lsadb_save_open(p))
+    return;
+
+  p->lsadb_event->hook = lsadb_save_event;
+  p->lsadb_event->data = p;
+  ev_schedule(p->lsadb_event);
+}
+
+/**
+ * ospf_lsadb_save - save LSA database snapshot
+ * @p: OSPF protocol instance
+ *
+ * This function writes the snapshot of the LSA database to the file given by
+ * the &lsadb_file option, if configured. It is used during the protocol
+ * shutdown, so it writes the whole snapshot (or the rest of the running one)
+ * at once. The snapshot is written to a temporary file which then replaces
+ * the old snapshot, so a valid snapshot is available even if BIRD crashes
+ * during the write.
+ */
+void
+ospf_lsadb_save(struct ospf_proto *p)
+{
+  if (!p->lsadb_state && !lsadb_save_open(p))
+    return;
+
+  ev_postpone(p->lsadb_event);
+  lsadb_save_step(p, ~0U);
+}
+
+static int
+lsadb_load_lsa(struct ospf_proto *p, struct lsadb_rec_hdr *rh, struct ospf_lsa_header *lsa_n, uint elapsed)
+{
+  struct ospf_lsa_header lsa;
+  u32 domain = ntohl(rh->domain);
+  u32 type = ntohs(rh->type);
+  uint len = ntohs(rh->length);
+  uint blen = len - sizeof(struct ospf_lsa_header);
+  void *body;
+
+  if ((lsa_n->checksum == 0) || !lsa_verify_checksum(lsa_n, len))
+    return 0;
+
+  lsa_ntoh_hdr(lsa_n, &lsa);
+
+  if ((lsa.length != len) || (lsa.rt == p->router_id))
+    return 0;
+
+  switch (LSA_SCOPE(type))
+  {
+  case LSA_SCOPE_AREA:
+    if (!ospf_find_area(p, domain))
+      return 0;
+    break;
+
+  case LSA_SCOPE_AS:
+    if (domain != 0)
+      return 0;
+    break;
+
+  default:
+    return 0;
+  }
+
+  if (lsa.age + elapsed >= LSA_MAXAGE)
+    return 0;
+  lsa.age += elapsed;
+
+  /* Keep LSAs already present in the database */
+  if (ospf_hash_find(p->gr, domain, lsa.id, lsa.rt, type))
+    return 0;
+
+  body = ospf_lsa_body_alloc(p, blen);
+  memcpy(body, lsa_n + 1, blen);
+
+  if (!lsa_validate(&lsa, type, ospf_is_v2(p), body))
+  {
+    ospf_lsa_body_free(p, body, blen);
+    return 0;
+  }
+
+  ospf_install_lsa(p, &lsa, type, domain, body);
+  return 1;
+}
+
+/**
+ * ospf_lsadb_load - restore LSA database from snapshot
+ * @p: OSPF protocol instance
+ *
+ * This function reads the snapshot of the LSA database from the file given
+ * by the &lsadb_file option and installs valid LSAs from it into the LSA
+ * database. It is called during the protocol start, after areas are added.
+ * The snapshot is ignored if it was saved by a different router ID or OSPF
+ * version, or if it is older than %LSREFRESHTIME.
+ */
+void
+ospf_lsadb_load(struct ospf_proto *p)
+{
+  struct ospf_config *cf = (struct ospf_config *) p->p.cf;
+  struct lsadb_file_hdr fh;
+  struct lsadb_rec_hdr rh;
+  struct stat st;
+  byte *data, *pos, *end, *buf;
+  uint elapsed, len, count = 0, valid = 0;
+  int fd;
+
+  if (!cf->lsadb_file)
+    return;
+
+  fd = open(cf->lsadb_file, O_RDONLY);
+  if (fd < 0)
+  {
+    if (errno != ENOENT)
+      log(L_ERR "%s: Cannot open LSA database snapshot %s: %m", p->p.name, cf->lsadb_file);
+    return;
+  }
+
+  if ((fstat(fd, &st) < 0) || (st.st_size < (off_t) sizeof(struct lsadb_file_hdr)))
+  {
+    log(L_ERR "%s: Invalid LSA database snapshot %s", p->p.name, cf->lsadb_file);
+    close(fd);
+    return;
+  }
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+  {
+    log(L_ERR "%s: Cannot map LSA database snapshot %s: %m", p->p.name, cf->lsadb_file);
+    return;
+  }
+
+  memcpy(&fh, data, sizeof(fh));
+  end = data + st.st_size;
+
+  /* Aligned copy of one LSA, its length is 16-bit */
+  buf = xmalloc(0x10000);
+
+  if (memcmp(fh.magic, LSADB_MAGIC, sizeof(fh.magic)) ||
+      (ntohl(fh.version) != LSADB_VERSION))
+  {
+    log(L_ERR "%s: Invalid LSA database snapshot %s", p->p.name, cf->lsadb_file);
+    goto done;
+  }
+
+  if ((ntohl(fh.ospf_version) != (u32) ospf_get_version(p)) ||
+      (ntohl(fh.router_id) != p->router_id))
+  {
+    OSPF_TRACE(D_EVENTS, "Ignoring LSA database snapshot of different instance");
+    goto done;
+  }
+
+  elapsed = now_real - (bird_clock_t) ntohl(fh.time);
+  if (elapsed > LSADB_MAX_AGE)
+  {
+    OSPF_TRACE(D_EVENTS, "Ignoring old LSA database snapshot");
+    goto done;
+  }
+
+  for (pos = data + sizeof(fh); pos < end; pos += sizeof(rh) + len)
+  {
+    len = 0;
+    if (pos + sizeof(rh) <= end)
+    {
+      memcpy(&rh, pos, sizeof(rh));
+      len = ntohs(rh.length);
+    }
+
+    if ((len < sizeof(struct ospf_lsa_header)) || (pos + sizeof(rh) + len > end))
+    {
+      log(L_ERR "%s: LSA database snapshot %s is truncated", p->p.name, cf->lsadb_file);
+      break;
+    }
+
+    memcpy(buf, pos + sizeof(rh), len);
+
+    count++;
+    valid += lsadb_load_lsa(p, &rh, (void *) buf, elapsed);
+  }
+
+  OSPF_TRACE(D_EVENTS, "Restored %u of %u LSAs from %s", valid, count, cf->lsadb_file);
+
+ done:
+  xfree(buf);
+  munmap(data, st.st_size);
+}
@@ -26,6 +26,89 @@
 static inline void * lsab_flush(struct ospf_proto *p);
 static inline void lsab_reset(struct ospf_proto *p);
 
+/*
+ * LSA bodies are mostly small (e.g. 16 B for OSPFv2 external LSA) and there
+ * may be a lot of them, so they are allocated from per-size-class slabs
+ * instead of using mb_alloc(), which has a larger overhead per block. Only
+ * large bodies (usually router LSAs) use mb_alloc(). The size of an LSA body
+ * must be known when it is freed, it is usually taken from its LSA header.
+ *
+ * Bodies are stored in network byte order, as they are received and flooded,
+ * so they are copied without conversion between packets, the LSA database and
+ * LSA db snapshots. LSA consumers read them through accessors in lsalib.h and
+ * lsa_walk_rt() and lsa_parse_*() functions. Locally originated bodies are
+ * prepared in lsab in host order and converted by ospf_originate_lsa().
+ */
+static inline int
+lsa_body_class(uint len)
+{
+  int i;
+
+  for (i = 0; i < LSA_BODY_SLABS; i++)
+    if (len <= ((uint) LSA_BODY_MIN << i))
+      return i;
+
+  return -1;
+}
+
+/**
+ * ospf_lsa_body_alloc - allocate LSA body
+ * @p: OSPF protocol instance
+ * @len: length of LSA body
+ */
+void *
+ospf_lsa_body_alloc(struct ospf_proto *p, uint len)
+{
+  int i = lsa_body_class(len);
+  return (i >= 0) ? sl_alloc(p->lsa_slab[i]) : mb_alloc(p->p.pool, len);
+}
+
+/**
+ * ospf_lsa_body_free - free LSA body
+ * @p: OSPF protocol instance
+ * @body: LSA body allocated by ospf_lsa_body_alloc(), may be NULL
+ * @len: length of LSA body
+ */
+void
+ospf_lsa_body_free(struct ospf_proto *p, void *body, uint len)
+{
+  if (!body)
+    return;
+
+  int i = lsa_body_class(len);
+  if (i >= 0)
+    sl_free(p->lsa_slab[i], body);
+  else
+    mb_free(body);
+}
+
+static inline void
+ospf_lsa_body_free_en(struct ospf_proto *p, struct top_hash_entry *en)
+{
+  ospf_lsa_body_free(p, en->lsa_body, en->lsa.length - sizeof(struct ospf_lsa_header));
+}
+
+/*
+ * Changes of summary and external LSAs do not affect the shortest-path tree,
+ * so they trigger just partial routing table calculation.
+ */
+static inline void
+ospf_schedule_rtcalc_lsa(struct ospf_proto *p, struct top_hash_entry *en)
+{
+  switch (en->lsa_type)
+  {
+  case LSA_T_SUM_NET:
+  case LSA_T_SUM_RT:
+  case LSA_T_EXT:
+  case LSA_T_NSSA:
+    ospf_schedule_prc(p);
+    break;
+
+  default:
+    ospf_schedule_rtcalc(p);
+  }
+}
+
 
 /**
  * ospf_install_lsa - install new LSA into database
@@ -41,8 +124,8 @@ static inline void lsab_reset(struct ospf_proto *p);
  * 2328. This function is for received LSA only, locally originated LSAs are
  * installed by ospf_originate_lsa().
  *
- * The LSA body in @body is expected to be mb_allocated by the caller and its
- * ownership is transferred to the LSA entry structure.
+ * The LSA body in @body is expected to be allocated by ospf_lsa_body_alloc()
+ * and its ownership is transferred to the LSA entry structure.
  */
 struct top_hash_entry *
 ospf_install_lsa(struct ospf_proto *p, struct ospf_lsa_header *lsa, u32 type, u32 domain, void *body)
@@ -66,7 +149,7 @@ ospf_install_lsa(struct ospf_proto *p, struct ospf_lsa_header *lsa, u32 type, u3
   if ((en->lsa.age == LSA_MAXAGE) && (lsa->age == LSA_MAXAGE))
     change = 0;
 
-  mb_free(en->lsa_body);
+  ospf_lsa_body_free_en(p, en);
   en->lsa_body = body;
   en->lsa = *lsa;
   en->init_age = en->lsa.age;
@@ -83,7 +166,7 @@ ospf_install_lsa(struct ospf_proto *p, struct ospf_lsa_header *lsa, u32 type, u3
 	     en->lsa_type, en->lsa.id, en->lsa.rt, en->lsa.sn, en->lsa.age);
 
   if (change)
-    ospf_schedule_rtcalc(p);
+    ospf_schedule_rtcalc_lsa(p, en);
 
   return en;
 }
@@ -102,8 +185,8 @@ ospf_install_lsa(struct ospf_proto *p, struct ospf_lsa_header *lsa, u32 type, u3
  * propagating it, or installing the received LSA and immediately flushing it
  * (if there is no local LSA; i.e., @en is NULL or MaxAge).
  *
- * The LSA body in @body is expected to be mb_allocated by the caller and its
- * ownership is transferred to the LSA entry structure or it is freed.
+ * The LSA body in @body is expected to be allocated by ospf_lsa_body_alloc()
+ * and its ownership is transferred to the LSA entry structure or it is freed.
  */
 void
 ospf_advance_lsa(struct ospf_proto *p, struct top_hash_entry *en, struct ospf_lsa_header *lsa, u32 type, u32 domain, void *body)
@@ -123,7 +206,7 @@ ospf_advance_lsa(struct ospf_proto *p, struct top_hash_entry *en, struct ospf_ls
        * reaction is needed and we are already limited by MinLSArrival.
        */
 
-      mb_free(body);
+      ospf_lsa_body_free(p, body, lsa->length - sizeof(struct ospf_lsa_header));
 
       en->lsa.sn = lsa->sn + 1;
       en->lsa.age = 0;
@@ -153,7 +236,7 @@ ospf_advance_lsa(struct ospf_proto *p, struct top_hash_entry *en, struct ospf_ls
       else
       {
 	/* There is already scheduled LSA, so we just free current one */
-	mb_free(en->lsa_body);
+	ospf_lsa_body_free_en(p, en);
       }
 
       en->lsa_body = body;
@@ -231,7 +314,7 @@ ospf_do_originate_lsa(struct ospf_proto *p, struct top_hash_entry *en, void *lsa
   if (ospf_is_v2(p))
     lsa_set_options(&en->lsa, lsa_opts);
 
-  mb_free(en->lsa_body);
+  ospf_lsa_body_free_en(p, en);
   en->lsa_body = lsa_body;
   en->lsa.length = sizeof(struct ospf_lsa_header) + lsa_blen;
   en->lsa.sn++;
@@ -246,7 +329,7 @@ ospf_do_originate_lsa(struct ospf_proto *p, struct top_hash_entry *en, void *lsa
   ospf_flood_lsa(p, en, NULL);
 
   if (en->mode == LSA_M_BASIC)
-    ospf_schedule_rtcalc(p);
+    ospf_schedule_rtcalc_lsa(p, en);
 
   return 1;
 }
@@ -293,6 +376,9 @@ ospf_originate_lsa(struct ospf_proto *p, struct ospf_new_lsa *lsa)
   if (en->mode != lsa->mode)
     en->mode = lsa->mode;
 
+  /* LSA body is prepared in host order, but stored in network order */
+  lsa_hton_body1(lsa_body, lsa_blen);
+
   if (en->next_lsa_body)
   {
     /* Ignore the new LSA if it is the same as the scheduled one */
@@ -302,7 +388,7 @@ ospf_originate_lsa(struct ospf_proto *p, struct ospf_new_lsa *lsa)
       goto drop;
 
     /* Free scheduled LSA */
-    mb_free(en->next_lsa_body);
+    ospf_lsa_body_free(p, en->next_lsa_body, en->next_lsa_blen);
     en->next_lsa_body = NULL;
     en->next_lsa_blen = 0;
     en->next_lsa_opts = 0;
@@ -369,7 +455,7 @@ ospf_refresh_lsa(struct ospf_proto *p, struct top_hash_entry *en)
   {
     /* Copy LSA body as next LSA to get automatic origination after flush is finished */
     en->next_lsa_blen = en->lsa.length - sizeof(struct ospf_lsa_header);
-    en->next_lsa_body = mb_alloc(p->p.pool, en->next_lsa_blen);
+    en->next_lsa_body = ospf_lsa_body_alloc(p, en->next_lsa_blen);
     memcpy(en->next_lsa_body, en->lsa_body, en->next_lsa_blen);
     en->next_lsa_opts = ospf_is_v2(p) ? lsa_get_options(&en->lsa) : 0;
 
@@ -406,7 +492,7 @@ ospf_flush_lsa(struct ospf_proto *p, struct top_hash_entry *en)
 {
   if (en->next_lsa_body)
   {
-    mb_free(en->next_lsa_body);
+    ospf_lsa_body_free(p, en->next_lsa_body, en->next_lsa_blen);
     en->next_lsa_body = NULL;
     en->next_lsa_blen = 0;
     en->next_lsa_opts = 0;
@@ -422,7 +508,7 @@ ospf_flush_lsa(struct ospf_proto *p, struct top_hash_entry *en)
   ospf_flood_lsa(p, en, NULL);
 
   if (en->mode == LSA_M_BASIC)
-    ospf_schedule_rtcalc(p);
+    ospf_schedule_rtcalc_lsa(p, en);
 
   en->mode = LSA_M_BASIC;
 }
@@ -442,7 +528,7 @@ ospf_clear_lsa(struct ospf_proto *p, struct top_hash_entry *en)
   if (en->lsa.sn == LSA_MAXSEQNO)
     en->lsa.sn = LSA_ZEROSEQNO;
 
-  mb_free(en->lsa_body);
+  ospf_lsa_body_free_en(p, en);
   en->lsa_body = NULL;
 }
 
@@ -589,7 +675,7 @@ lsab_allocz(struct ospf_proto *p, uint size)
 static inline void *
 lsab_flush(struct ospf_proto *p)
 {
-  void *r = mb_alloc(p->p.pool, p->lsab_used);
+  void *r = ospf_lsa_body_alloc(p, p->lsab_used);
   memcpy(r, p->lsab, p->lsab_used);
   p->lsab_used = 0;
   return r;
@@ -945,7 +1031,7 @@ prepare_net3_lsa_body(struct ospf_proto *p, struct ospf_iface *ifa)
 	ospf_hash_find(p->gr, ifa->iface_id, n->iface_id, n->rid, LSA_T_LINK);
 
       if (en)
-	options |= ((struct ospf_lsa_link *) en->lsa_body)->options;
+	options |= lsa_get_link_options(en->lsa_body);
 
       net->routers[i] = n->rid;
       i++;
@@ -1260,6 +1346,7 @@ ospf_rt_notify(struct proto *P, rtable *tbl UNUSED, net *n, rte *new, rte *old U
 
     ospf_flush_ext_lsa(p, oa, nf);
     nf->external_rte = 0;
+    ort_mark(p, nf);
 
     /* Old external route might blocked some NSSA translation */
     if ((p->areano > 1) && rt_is_nssa(nf) && nf->n.oa->translate)
@@ -1542,25 +1629,30 @@ add_prefix(struct ospf_proto *p, u32 *px, int offset, int *pxc)
 }
 
 static void
-add_link_lsa(struct ospf_proto *p, struct ospf_lsa_link *ll, int offset, int *pxc)
+add_link_lsa(struct ospf_proto *p, void *body, int offset, int *pxc)
 {
-  u32 *pxb = ll->rest;
+  struct ospf_lsa_link ll;
+  u32 px[IPV6_PREFIX_WORDS(MAX_PREFIX_LENGTH)];
+  u32 *pxb = lsa_get_link_hdr(body, &ll);
   uint j;
 
-  for (j = 0; j < ll->pxcount; pxb = prefix_advance(pxb), j++)
+  for (j = 0; j < ll.pxcount; pxb += IPV6_PREFIX_WORDS(px[0] >> 24), j++)
   {
-    u8 pxlen = (pxb[0] >> 24);
-    u8 pxopts = (pxb[0] >> 16);
+    /* Link-LSA body is in network order, lsab is in host order */
+    lsa_ntoh_body(pxb, px, IPV6_PREFIX_SPACE(get_u32(pxb) >> 24));
+
+    u8 pxlen = (px[0] >> 24);
+    u8 pxopts = (px[0] >> 16);
 
     /* Skip NU or LA prefixes */
     if (pxopts & (OPT_PX_NU | OPT_PX_LA))
       continue;
 
     /* Skip link-local prefixes */
-    if ((pxlen >= 10) && ((pxb[1] & 0xffc00000) == 0xfe800000))
+    if ((pxlen >= 10) && ((px[1] & 0xffc00000) == 0xfe800000))
       continue;
 
-    add_prefix(p, pxb, offset, pxc);
+    add_prefix(p, px, offset, pxc);
   }
 }
 
@@ -14,7 +14,7 @@
 struct top_hash_entry
 {				/* Index for fast mapping (type,rtrid,LSid)->vertex */
   snode n;
-  node cn;			/* For adding into list of candidates
+  uint cand_pos;		/* Position in heap of candidates
 				   in intra-area routing table calculation */
   struct top_hash_entry *next;	/* Next in hash chain */
   struct ospf_lsa_header lsa;
@@ -175,6 +175,8 @@ struct ospf_new_lsa
 struct top_graph *ospf_top_new(struct ospf_proto *p, pool *pool);
 void ospf_top_free(struct top_graph *f);
 
+void *ospf_lsa_body_alloc(struct ospf_proto *p, uint len);
+void ospf_lsa_body_free(struct ospf_proto *p, void *body, uint len);
 struct top_hash_entry * ospf_install_lsa(struct ospf_proto *p, struct ospf_lsa_header *lsa, u32 type, u32 domain, void *body);
 struct top_hash_entry * ospf_originate_lsa(struct ospf_proto *p, struct ospf_new_lsa *lsa);
 void ospf_advance_lsa(struct ospf_proto *p, struct top_hash_entry *en, struct ospf_lsa_header *lsa, u32 type, u32 domain, void *body);
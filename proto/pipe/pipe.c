@@ -15,7 +15,10 @@
  * in the other one.
  *
  * To avoid pipe loops, Pipe keeps a `being updated' flag in each routing
- * table.
+ * table. As announcements are propagated later from an event (see below),
+ * the flag catches only loops of withdraws. Therefore, queued announcements
+ * also count pipes they passed and those which passed more than
+ * %PIPE_MAX_HOPS pipes are dropped as looping.
  *
  * A pipe has two announce hooks, the first connected to the main
  * table, the second connected to the peer table. When a new route is
@@ -28,6 +31,14 @@
  * set to accept, while user configured 'import' and 'export' filters
  * are used as export filters in ahooks 2 and 1. Route limits are
  * handled similarly, but on the import side of ahooks.
+ *
+ * Announced routes are not propagated immediately, they are queued and
+ * propagated by an event in batches of %PIPE_BATCH_SIZE. When a route
+ * changes several times while it is queued, only the last version is
+ * propagated. Withdraws are propagated immediately (and cancel the queued
+ * announcement), so routes of flushed protocols never outlive them. When
+ * the route was not changed by the export filter, its cached &rta is shared
+ * by both tables instead of being looked up again.
  */
 
 #undef LOCAL_DEBUG
@@ -40,20 +51,148 @@
 #include "conf/conf.h"
 #include "filter/filter.h"
 #include "lib/string.h"
+#include "lib/hash.h"
 
 #include "pipe.h"
 
+#define PIPE_UPDATE_KEY(n)	n->prefix, n->pxlen, n->dir, n->src
+#define PIPE_UPDATE_NEXT(n)	n->next
+#define PIPE_UPDATE_EQ(p1,l1,d1,s1,p2,l2,d2,s2) \
+  (ipa_equal(p1, p2) && (l1 == l2) && (d1 == d2) && (s1 == s2))
+#define PIPE_UPDATE_FN(px,l,d,s) \
+  (ipa_hash32(px) ^ u32_hash((((l) << 1) | (d)) ^ (s)->global_id))
+
+#define PIPE_UPDATE_REHASH	pipe_update_rehash
+#define PIPE_UPDATE_PARAMS	/8, *2, 2, 2, 8, 20
+
+HASH_DEFINE_REHASH_FN(PIPE_UPDATE, struct pipe_update)
+
+static uint pipe_hops;			/* Pipes passed by the update being propagated */
+
+static rte *
+pipe_copy_rte(struct pipe_proto *p, rte *new, ea_list *attrs)
+{
+  rta *a0 = new->attrs;
+  rte *e;
+  rta a;
+
+  /*
+   * The cached rta is shared when the route was not changed by the export
+   * filter and has no temporary attributes. Hostentries of the source table
+   * must not be used in the peer table, so routes with them are copied.
+   */
+  if ((p->mode == PIPE_TRANSPARENT) && rta_is_cached(a0) &&
+      (attrs == a0->eattrs) && !a0->hostentry)
+    e = rte_get_temp(rta_clone(a0));
+  else
+    {
+      memcpy(&a, a0, sizeof(rta));
+
+      if (p->mode == PIPE_OPAQUE)
+	{
+	  a.src = p->p.main_source;
+	  a.source = RTS_PIPE;
+	}
+
+      a.aflags = 0;
+      a.eattrs = attrs;
+      a.hostentry = NULL;
+      e = rte_get_temp(rta_lookup(&a));
+    }
+
+  e->pflags = 0;
+
+  if (p->mode == PIPE_TRANSPARENT)
+    {
+      /* Copy protocol specific embedded attributes. */
+      memcpy(&(e->u), &(new->u), sizeof(e->u));
+      e->pref = new->pref;
+      e->pflags = new->pflags;
+    }
+
+  return e;
+}
+
+static void
+pipe_propagate(struct pipe_proto *p, uint dir, ip_addr prefix, int pxlen, rte *e, struct rte_src *src, uint hops)
+{
+  uint old_hops = pipe_hops;
+  struct announce_hook *ah = (dir == PIPE_DIR_PEER) ? p->peer_ahook : p->p.main_ahook;
+  rtable *src_table = (dir == PIPE_DIR_PEER) ? p->p.table : p->peer_table;
+  net *nn;
+
+  /* Withdraws do not create empty networks in the peer table */
+  if (e)
+    {
+      nn = net_get(ah->table, prefix, pxlen);
+      e->net = nn;
+    }
+  else
+    nn = net_find(ah->table, prefix, pxlen);
+
+  /* Updates queued by pipes notified synchronously inherit the hop count */
+  src_table->pipe_busy = 1;
+  pipe_hops = hops;
+  rte_update2(ah, nn, e, src);
+  pipe_hops = old_hops;
+  src_table->pipe_busy = 0;
+}
+
+static void
+pipe_free_update(struct pipe_proto *p, struct pipe_update *u)
+{
+  rem_node(&u->n);
+  HASH_REMOVE2(p->update_hash, PIPE_UPDATE, p->p.pool, u);
+  rt_unlock_source(u->src);
+  sl_free(p->update_slab, u);
+}
+
+static void
+pipe_update_event(void *data)
+{
+  struct pipe_proto *p = data;
+  struct pipe_update *u;
+  uint cnt = 0;
+
+  p->update_batches++;
+
+  while (!EMPTY_LIST(p->update_queue))
+    {
+      if (cnt++ >= PIPE_BATCH_SIZE)
+	{
+	  ev_schedule(p->update_event);
+	  return;
+	}
+
+      u = HEAD(p->update_queue);
+      pipe_propagate(p, u->dir, u->prefix, u->pxlen, u->new, u->src, u->hops);
+      pipe_free_update(p, u);
+    }
+}
+
+static void
+pipe_flush_updates(struct pipe_proto *p)
+{
+  struct pipe_update *u;
+
+  while (!EMPTY_LIST(p->update_queue))
+    {
+      u = HEAD(p->update_queue);
+      rte_free(u->new);
+      pipe_free_update(p, u);
+    }
+}
+
 static void
 pipe_rt_notify(struct proto *P, rtable *src_table, net *n, rte *new, rte *old, ea_list *attrs)
 {
   struct pipe_proto *p = (struct pipe_proto *) P;
-  struct announce_hook *ah = (src_table == P->table) ? p->peer_ahook : P->main_ahook;
-  rtable *dst_table = ah->table;
+  uint dir = (src_table == P->table) ? PIPE_DIR_PEER : PIPE_DIR_MAIN;
+  rtable *dst_table = (dir == PIPE_DIR_PEER) ? p->peer_table : P->table;
+  static struct tbf rl_loop = TBF_DEFAULT_LOG_LIMITS;
+  struct pipe_update *u;
   struct rte_src *src;
-
-  net *nn;
   rte *e;
-  rta a;
 
   if (!new && !old)
     return;
@@ -65,43 +204,57 @@ pipe_rt_notify(struct proto *P, rtable *src_table, net *n, rte *new, rte *old, e
       return;
     }
 
-  nn = net_get(dst_table, n->n.prefix, n->n.pxlen);
-  if (new)
+  if (new && (pipe_hops >= PIPE_MAX_HOPS))
     {
-      memcpy(&a, new->attrs, sizeof(rta));
+      log_rl(&rl_loop, L_ERR "Pipe loop detected when sending %I/%d to table %s (%u pipes passed)",
+	     n->n.prefix, n->n.pxlen, dst_table->name, pipe_hops);
+      return;
+    }
 
-      if (p->mode == PIPE_OPAQUE)
-	{
-	  a.src = P->main_source;
-	  a.source = RTS_PIPE;
-	}
+  e = new ? pipe_copy_rte(p, new, attrs) : NULL;
+  src = new ? e->attrs->src : old->attrs->src;
+  u = HASH_FIND(p->update_hash, PIPE_UPDATE, n->n.prefix, n->n.pxlen, dir, src);
 
-      a.aflags = 0;
-      a.eattrs = attrs;
-      a.hostentry = NULL;
-      e = rte_get_temp(&a);
-      e->net = nn;
-      e->pflags = 0;
-
-      if (p->mode == PIPE_TRANSPARENT)
+  /*
+   * Withdraws are propagated immediately, so no route of a protocol which is
+   * flushed stays in the peer table. Announcements are queued and propagated
+   * in batches, only the last queued update of a route is propagated.
+   */
+  if (!e)
+    {
+      if (u)
 	{
-	  /* Copy protocol specific embedded attributes. */
-	  memcpy(&(e->u), &(new->u), sizeof(e->u));
-	  e->pref = new->pref;
-	  e->pflags = new->pflags;
+	  rte_free(u->new);
+	  pipe_free_update(p, u);
 	}
 
-      src = a.src;
+      pipe_propagate(p, dir, n->n.prefix, n->n.pxlen, NULL, src, pipe_hops + 1);
+      return;
     }
-  else
+
+  if (u)
     {
-      e = NULL;
-      src = old->attrs->src;
+      rte_free(u->new);
+      u->new = e;
+      u->hops = pipe_hops + 1;
+      p->update_merged++;
+      return;
     }
 
-  src_table->pipe_busy = 1;
-  rte_update2(ah, nn, e, src);
-  src_table->pipe_busy = 0;
+  u = sl_alloc(p->update_slab);
+  u->prefix = n->n.prefix;
+  u->pxlen = n->n.pxlen;
+  u->dir = dir;
+  u->hops = pipe_hops + 1;
+  u->src = src;
+  u->new = e;
+  rt_lock_source(src);
+
+  HASH_INSERT2(p->update_hash, PIPE_UPDATE, P->pool, u);
+  add_tail(&p->update_queue, &u->n);
+
+  if (!ev_active(p->update_event))
+    ev_schedule(p->update_event);
 }
 
 static int
@@ -179,9 +332,28 @@ pipe_start(struct proto *P)
       rt_lock_source(P->main_source);
     }
 
+  p->update_event = ev_new(P->pool);
+  p->update_event->hook = pipe_update_event;
+  p->update_event->data = p;
+  p->update_slab = sl_new(P->pool, sizeof(struct pipe_update));
+  init_list(&p->update_queue);
+  HASH_INIT(p->update_hash, P->pool, 8);
+  p->update_batches = p->update_merged = 0;
+
   return PS_UP;
 }
 
+static int
+pipe_shutdown(struct proto *P)
+{
+  struct pipe_proto *p = (struct pipe_proto *) P;
+
+  /* Queued updates are discarded, routes are flushed anyway */
+  pipe_flush_updates(p);
+
+  return PS_DOWN;
+}
+
 static void
 pipe_cleanup(struct proto *P)
 {
@@ -338,7 +510,11 @@ pipe_show_proto_info(struct proto *P)
   proto_show_limit(cf->c.out_limit, "Export limit:");
 
   if (P->proto_state != PS_DOWN)
-    pipe_show_stats(p);
+    {
+      pipe_show_stats(p);
+      cli_msg(-1006, "  Update batches: %u (%u updates merged)",
+	      p->update_batches, p->update_merged);
+    }
 }
 
 
@@ -351,6 +527,7 @@ struct protocol proto_pipe = {
   .postconfig =		pipe_postconfig,
   .init =		pipe_init,
   .start =		pipe_start,
+  .shutdown =		pipe_shutdown,
   .cleanup =		pipe_cleanup,
   .reconfigure =	pipe_reconfigure,
   .copy_config = 	pipe_copy_config,
@@ -9,21 +9,49 @@
 #ifndef _BIRD_PIPE_H_
 #define _BIRD_PIPE_H_
 
+#include "nest/route.h"
+#include "lib/event.h"
+#include "lib/hash.h"
+
 #define PIPE_OPAQUE 0
 #define PIPE_TRANSPARENT 1
 
+#define PIPE_DIR_PEER 0			/* From the primary table to the peer table */
+#define PIPE_DIR_MAIN 1			/* From the peer table to the primary table */
+
+#define PIPE_BATCH_SIZE 1024		/* Queued updates propagated in one step */
+#define PIPE_MAX_HOPS 32		/* Longer chains of pipes are considered loops */
+
 struct pipe_config {
   struct proto_config c;
   struct rtable_config *peer;		/* Table we're connected to */
   int mode;				/* PIPE_OPAQUE or PIPE_TRANSPARENT */
 };
 
+struct pipe_update {
+  node n;				/* Node in update_queue */
+  struct pipe_update *next;		/* Hash chain */
+  ip_addr prefix;
+  u8 pxlen;
+  u8 dir;				/* PIPE_DIR_* */
+  u8 hops;				/* Number of pipes passed, including this one */
+  struct rte_src *src;			/* Source of the route, locked */
+  rte *new;				/* Route to be announced */
+};
+
 struct pipe_proto {
   struct proto p;
   struct rtable *peer_table;
   struct announce_hook *peer_ahook;	/* Announce hook for direction peer->primary */
   struct proto_stats peer_stats;	/* Statistics for the direction peer->primary */
   int mode;				/* PIPE_OPAQUE or PIPE_TRANSPARENT */
+
+  event *update_event;			/* Propagation of queued updates */
+  slab *update_slab;
+  list update_queue;			/* Queued updates (struct pipe_update) */
+  HASH(struct pipe_update) update_hash;	/* Queued updates by network, direction and source */
+  uint update_batches;			/* Number of propagation steps */
+  uint update_merged;			/* Updates replaced by later ones while queued */
 };
 
 
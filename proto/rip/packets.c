@@ -422,6 +422,76 @@ rip_receive_request(struct rip_proto *p, struct rip_iface *ifa, struct rip_packe
 }
 
 
+/* Prepare RTE block for the entry, returns 0 if it should not be sent via @ifa */
+static int
+rip_get_entry_block(struct rip_proto *p, struct rip_iface *ifa, struct rip_entry *en, struct rip_block *rte)
+{
+  /* Dummy entries */
+  if (!en->valid)
+    return 0;
+
+  /* Stale entries that should be removed */
+  if ((en->valid == RIP_ENTRY_STALE) &&
+      ((en->changed + ifa->cf->garbage_time) <= now))
+    return 0;
+
+  /* Triggered updates */
+  if (en->changed < ifa->tx_changed)
+    return 0;
+
+  *rte = (struct rip_block) {
+    .prefix = en->n.prefix,
+    .pxlen = en->n.pxlen,
+    .metric = en->metric,
+    .tag = en->tag
+  };
+
+  if (en->iface == ifa->iface)
+    rte->next_hop = en->next_hop;
+
+  if (rip_is_v2(p) && (ifa->cf->version == RIP_V1))
+  {
+    /* Skipping subnets (i.e. not hosts, classful networks or default route) */
+    if (ip4_masklen(ip4_class_mask(ipa_to_ip4(en->n.prefix))) != en->n.pxlen)
+      return 0;
+
+    rte->tag = 0;
+    rte->pxlen = 0;
+    rte->next_hop = IPA_NONE;
+  }
+
+  /* Split horizon */
+  if (en->from == ifa->iface && ifa->cf->split_horizon)
+  {
+    if (ifa->cf->poison_reverse)
+    {
+      rte->metric = p->infinity;
+      rte->next_hop = IPA_NONE;
+    }
+    else
+      return 0;
+  }
+
+  return 1;
+}
+
+static byte *
+rip_put_entry_block(struct rip_proto *p, byte *pos, struct rip_block *rte, ip_addr *last_next_hop)
+{
+  // TRACE(D_PACKETS, "    %I/%d -> %I metric %d", rte->prefix, rte->pxlen, rte->next_hop, rte->metric);
+
+  /* RIPng next hop entry */
+  if (rip_is_ng(p) && !ipa_equal(rte->next_hop, *last_next_hop))
+  {
+    *last_next_hop = rte->next_hop;
+    rip_put_next_hop(p, pos, rte);
+    pos += RIP_BLOCK_LENGTH;
+  }
+
+  rip_put_block(p, pos, rte);
+  return pos + RIP_BLOCK_LENGTH;
+}
+
 static int
 rip_send_response(struct rip_proto *p, struct rip_iface *ifa)
 {
@@ -432,6 +502,7 @@ rip_send_response(struct rip_proto *p, struct rip_iface *ifa)
   byte *max = rip_tx_buffer(ifa) + ifa->tx_plen -
     (rip_is_v2(p) ? RIP_BLOCK_LENGTH : 2*RIP_BLOCK_LENGTH);
   ip_addr last_next_hop = IPA_NONE;
+  struct rip_block rte;
   int send = 0;
 
   struct rip_packet *pkt = (void *) pos;
@@ -440,21 +511,35 @@ rip_send_response(struct rip_proto *p, struct rip_iface *ifa)
   pkt->unused = 0;
   pos += rip_pkt_hdrlen(ifa);
 
-  FIB_ITERATE_START(&p->rtable, &ifa->tx_fit, z)
+  /* Triggered updates walk just entries changed since ifa->tx_changed */
+  if (ifa->tx_changed)
   {
-    struct rip_entry *en = (struct rip_entry *) z;
+    while (NODE_VALID(ifa->tx_next))
+    {
+      struct rip_entry *en = SKIP_BACK(struct rip_entry, changed_n, ifa->tx_next);
 
-    /* Dummy entries */
-    if (!en->valid)
-      goto next_entry;
+      if (rip_get_entry_block(p, ifa, en, &rte))
+      {
+	/* Not enough space for current entry */
+	if (pos > max)
+	  goto break_loop;
 
-    /* Stale entries that should be removed */
-    if ((en->valid == RIP_ENTRY_STALE) &&
-	((en->changed + ifa->cf->garbage_time) <= now))
-      goto next_entry;
+	pos = rip_put_entry_block(p, pos, &rte, &last_next_hop);
+	send = 1;
+      }
+
+      ifa->tx_next = ifa->tx_next->next;
+    }
+
+    ifa->tx_next = NULL;
+    goto done;
+  }
+
+  FIB_ITERATE_START(&p->rtable, &ifa->tx_fit, z)
+  {
+    struct rip_entry *en = (struct rip_entry *) z;
 
-    /* Triggered updates */
-    if (en->changed < ifa->tx_changed)
+    if (!rip_get_entry_block(p, ifa, en, &rte))
       goto next_entry;
 
     /* Not enough space for current entry */
@@ -464,56 +549,14 @@ rip_send_response(struct rip_proto *p, struct rip_iface *ifa)
       goto break_loop;
     }
 
-    struct rip_block rte = {
-      .prefix = en->n.prefix,
-      .pxlen = en->n.pxlen,
-      .metric = en->metric,
-      .tag = en->tag
-    };
-
-    if (en->iface == ifa->iface)
-      rte.next_hop = en->next_hop;
-
-    if (rip_is_v2(p) && (ifa->cf->version == RIP_V1))
-    {
-      /* Skipping subnets (i.e. not hosts, classful networks or default route) */
-      if (ip4_masklen(ip4_class_mask(ipa_to_ip4(en->n.prefix))) != en->n.pxlen)
-	goto next_entry;
-
-      rte.tag = 0;
-      rte.pxlen = 0;
-      rte.next_hop = IPA_NONE;
-    }
-
-    /* Split horizon */
-    if (en->from == ifa->iface && ifa->cf->split_horizon)
-    {
-      if (ifa->cf->poison_reverse)
-      {
-	rte.metric = p->infinity;
-	rte.next_hop = IPA_NONE;
-      }
-      else
-	goto next_entry;
-    }
-
-    // TRACE(D_PACKETS, "    %I/%d -> %I metric %d", rte.prefix, rte.pxlen, rte.next_hop, rte.metric);
-
-    /* RIPng next hop entry */
-    if (rip_is_ng(p) && !ipa_equal(rte.next_hop, last_next_hop))
-    {
-      last_next_hop = rte.next_hop;
-      rip_put_next_hop(p, pos, &rte);
-      pos += RIP_BLOCK_LENGTH;
-    }
-
-    rip_put_block(p, pos, &rte);
-    pos += RIP_BLOCK_LENGTH;
+    pos = rip_put_entry_block(p, pos, &rte, &last_next_hop);
     send = 1;
 
   next_entry: ;
   }
   FIB_ITERATE_END(z);
+
+done:
   ifa->tx_active = 0;
 
   /* Do not send empty packet */
@@ -549,7 +592,19 @@ rip_send_table(struct rip_proto *p, struct rip_iface *ifa, ip_addr addr, bird_cl
   ifa->tx_active = 1;
   ifa->tx_addr = addr;
   ifa->tx_changed = changed;
-  FIB_ITERATE_INIT(&ifa->tx_fit, &p->rtable);
+
+  if (changed)
+  {
+    /* Find the first entry changed since @changed, from the end of the list */
+    node *n;
+    WALK_LIST_BACKWARDS(n, p->changed_list)
+      if (SKIP_BACK(struct rip_entry, changed_n, n)->changed < changed)
+	break;
+
+    ifa->tx_next = n->next;
+  }
+  else
+    FIB_ITERATE_INIT(&ifa->tx_fit, &p->rtable);
 
   rip_update_csn(p, ifa);
 
@@ -757,7 +812,8 @@ rip_open_socket(struct rip_iface *ifa)
   sk->tos = ifa->cf->tx_tos;
   sk->priority = ifa->cf->tx_priority;
   sk->ttl = ifa->cf->ttl_security ? 255 : 1;
-  sk->flags = SKF_LADDR_RX | ((ifa->cf->ttl_security == 1) ? SKF_TTL_RX : 0);
+  sk->flags = SKF_LADDR_RX | SKF_BATCH_RX | SKF_BATCH_TX |
+    ((ifa->cf->ttl_security == 1) ? SKF_TTL_RX : 0);
 
   /* sk->rbsize and sk->tbsize are handled in rip_iface_update_buffers() */
 
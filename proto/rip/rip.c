@@ -52,6 +52,12 @@
  * active update session per interface, as the associated state (including the
  * fib iterator) is stored directly in &rip_iface structure.
  *
+ * Entries are also kept in a list ordered by the time of their last change
+ * (&changed_list in &rip_proto), an entry is moved to its end whenever its
+ * outgoing route changes. Triggered updates walk just the tail of the list with
+ * entries changed since the update was scheduled, so their cost depends on the
+ * number of changes and not on the size of the routing table.
+ *
  * RIP neighbors are represented by structures &rip_neighbor. Compared to
  * neighbor handling in other routing protocols, RIP does not have explicit
  * neighbor discovery and adjacency maintenance, which makes the &rip_neighbor
@@ -101,6 +107,30 @@ rip_init_entry(struct fib_node *fn)
   memset((byte *)fn + offset, 0, sizeof(struct rip_entry) - offset);
 }
 
+static void
+rip_unlink_changed(struct rip_proto *p, struct rip_entry *en)
+{
+  struct rip_iface *ifa;
+
+  if (!en->changed_n.next)
+    return;
+
+  /* Move active triggered updates to the next entry */
+  WALK_LIST(ifa, p->iface_list)
+    if (ifa->tx_next == &en->changed_n)
+      ifa->tx_next = en->changed_n.next;
+
+  rem_node(&en->changed_n);
+}
+
+static void
+rip_mark_changed(struct rip_proto *p, struct rip_entry *en)
+{
+  rip_unlink_changed(p, en);
+  add_tail(&p->changed_list, &en->changed_n);
+  en->changed = now;
+}
+
 static struct rip_rte *
 rip_add_rte(struct rip_proto *p, struct rip_rte **rp, struct rip_rte *src)
 {
@@ -384,7 +414,7 @@ rip_rt_notify(struct proto *P, struct rtable *table UNUSED, struct network *net,
   /* Activate triggered updates */
   if (en->metric != old_metric)
   {
-    en->changed = now;
+    rip_mark_changed(p, en);
     rip_trigger_update(p);
   }
 }
@@ -882,6 +912,7 @@ rip_timer(timer *t)
     if (!en->valid && !en->routes)
     {
       FIB_ITERATE_PUT(&fit, node);
+      rip_unlink_changed(p, en);
       fib_delete(&p->rtable, node);
       goto loop;
     }
@@ -1105,6 +1136,7 @@ rip_start(struct proto *P)
 
   init_list(&p->iface_list);
   fib_init(&p->rtable, P->pool, sizeof(struct rip_entry), 0, rip_init_entry);
+  init_list(&p->changed_list);
   p->rte_slab = sl_new(P->pool, sizeof(struct rip_rte));
   p->timer = tm_new_set(P->pool, rip_timer, p, 0, 0);
 
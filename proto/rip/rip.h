@@ -94,6 +94,7 @@ struct rip_proto
 {
   struct proto p;
   struct fib rtable;			/* Internal routing table */
+  list changed_list;			/* Entries ordered by changed time (struct rip_entry) */
   list iface_list;			/* List of interfaces (struct rip_iface) */
   slab *rte_slab;			/* Slab for internal routes (struct rip_rte) */
   timer *timer;				/* Main protocol timer */
@@ -134,6 +135,7 @@ struct rip_iface
   ip_addr tx_addr;			/* Update session destination address */
   bird_clock_t tx_changed;		/* Minimal changed time for triggered update */
   struct fib_iterator tx_fit;		/* FIB iterator in RIP routing table (p.rtable) */
+  node *tx_next;			/* Next node in p.changed_list for triggered update */
 };
 
 struct rip_neighbor
@@ -160,6 +162,7 @@ struct rip_entry
   ip_addr next_hop;			/* Outgoing route next hop */
 
   bird_clock_t changed;			/* Last time when the outgoing route metric changed */
+  node changed_n;			/* Node in p.changed_list, unlinked if next is NULL */
 };
 
 struct rip_rte
@@ -205,7 +208,10 @@ rip_reset_tx_session(struct rip_proto *p, struct rip_iface *ifa)
 {
   if (ifa->tx_active)
   {
-    FIB_ITERATE_UNLINK(&ifa->tx_fit, &p->rtable);
+    if (!ifa->tx_changed)
+      FIB_ITERATE_UNLINK(&ifa->tx_fit, &p->rtable);
+
+    ifa->tx_next = NULL;
     ifa->tx_active = 0;
   }
 }
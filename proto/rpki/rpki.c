@@ -0,0 +1,734 @@
+/*
+ *	BIRD -- The Resource Public Key Infrastructure (RPKI) to Router Protocol
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: RPKI to Router Protocol
+ *
+ * The RPKI protocol implements the client side of the RPKI-to-Router
+ * protocol (RFC 6810, RFC 8210). It connects to an RPKI cache server over
+ * TCP and keeps a ROA table synchronized with validated ROA payloads (VRPs)
+ * provided by the cache.
+ *
+ * After a connection is established, a Reset Query is sent to get the whole
+ * set of VRPs, or a Serial Query if we already have data from a session with
+ * the cache, so just changes since our serial number are transferred. Queries
+ * are repeated periodically (refresh timer) or when a Serial Notify is
+ * received. Version 1 of the protocol is offered, but the protocol falls back
+ * to version 0 when the cache does not support it.
+ *
+ * VRPs received in a Cache Response are not applied immediately, they are
+ * collected in a list of pending updates (&rpki_update) and applied to the
+ * ROA table at once when End of Data is received (rpki_apply_updates()).
+ * Therefore, routes are never validated against a partially updated set of
+ * VRPs. ROA entries from the cache are added to the ROA table with source
+ * %ROA_SRC_RPKI, changes of the ROA table are processed by the ROA table code,
+ * which also triggers revalidation of routes in affected networks.
+ *
+ * When the connection fails, the protocol tries to reconnect after the retry
+ * interval and keeps existing data. If there is no successful update in the
+ * expire interval, ROA entries from the cache are removed from the ROA table.
+ *
+ * Router Key PDUs (BGPsec) are ignored. BIRD is compiled for a single address
+ * family, prefix PDUs of the other address family are ignored.
+ */
+
+#undef LOCAL_DEBUG
+
+#include "rpki.h"
+#include "lib/unaligned.h"
+
+
+#define RPKI_HDR_LENGTH		8
+#define RPKI_ERROR_TIMEOUT	5	/* Time for sending an Error Report before closing */
+
+static void rpki_connect(struct rpki_proto *p);
+static void rpki_query(struct rpki_proto *p);
+
+static const char *rpki_state_names[] = {
+  [RPKI_CS_IDLE] = "Idle",
+  [RPKI_CS_CONNECT] = "Connect",
+  [RPKI_CS_ESTABLISHED] = "Established",
+  [RPKI_CS_SYNC] = "Sync",
+  [RPKI_CS_ERROR] = "Error"
+};
+
+static const char *rpki_err_names[] = {
+  [RPKI_ERR_CORRUPT_DATA] = "Corrupt data",
+  [RPKI_ERR_INTERNAL_ERROR] = "Internal error",
+  [RPKI_ERR_NO_DATA_AVAILABLE] = "No data available",
+  [RPKI_ERR_INVALID_REQUEST] = "Invalid request",
+  [RPKI_ERR_UNSUPPORTED_VERSION] = "Unsupported protocol version",
+  [RPKI_ERR_UNSUPPORTED_PDU_TYPE] = "Unsupported PDU type",
+  [RPKI_ERR_UNKNOWN_WITHDRAWAL] = "Withdrawal of unknown record",
+  [RPKI_ERR_DUPLICATE_ANNOUNCEMENT] = "Duplicate announcement",
+  [RPKI_ERR_UNEXPECTED_VERSION] = "Unexpected protocol version"
+};
+
+static inline const char *
+rpki_err_name(uint code)
+{
+  return (code < ARRAY_SIZE(rpki_err_names)) ? rpki_err_names[code] : "Unknown error";
+}
+
+static inline struct roa_table *
+rpki_table(struct rpki_proto *p)
+{
+  return p->roa_cf->table;
+}
+
+
+/*
+ *	Connection management
+ */
+
+static void
+rpki_flush_updates(struct rpki_proto *p)
+{
+  lp_flush(p->update_pool);
+  p->updates = NULL;
+  p->updates_last = &p->updates;
+  p->in_response = 0;
+}
+
+static void
+rpki_close(struct rpki_proto *p)
+{
+  rfree(p->sk);
+  p->sk = NULL;
+
+  rpki_flush_updates(p);
+  tm_stop(p->refresh_timer);
+}
+
+/* Close the connection and try to reconnect later */
+static void
+rpki_fail(struct rpki_proto *p)
+{
+  rpki_close(p);
+
+  TRACE(D_EVENTS, "Reconnecting in %u seconds", p->retry_time);
+  p->state = RPKI_CS_IDLE;
+  tm_start(p->retry_timer, p->retry_time);
+}
+
+static void
+rpki_sock_err(sock *sk, int err)
+{
+  struct rpki_proto *p = sk->data;
+
+  if (err)
+    log(L_WARN "%s: Connection to %I lost: %M", p->p.name, p->cf->remote_ip, err);
+  else
+    log(L_WARN "%s: Connection to %I closed", p->p.name, p->cf->remote_ip);
+
+  rpki_fail(p);
+}
+
+static int
+rpki_send(struct rpki_proto *p, uint type, uint session, uint len)
+{
+  int rv;
+  byte *buf = p->sk->tbuf;
+
+  buf[0] = p->version;
+  buf[1] = type;
+  put_u16(buf + 2, session);
+  put_u32(buf + 4, len);
+
+  if ((rv = sk_send(p->sk, len)) < 0)
+    TRACE(D_PACKETS, "Cannot send PDU type %u", type);
+
+  return rv;
+}
+
+/* TX hook after an Error Report was queued, it is sent now */
+static void
+rpki_error_sent(sock *sk)
+{
+  struct rpki_proto *p = sk->data;
+
+  rpki_fail(p);
+}
+
+/**
+ * rpki_error - report an error to the cache
+ * @p: RPKI instance
+ * @code: error code (RPKI_ERR_*)
+ * @pdu: erroneous PDU, may be NULL
+ * @len: length of the erroneous PDU
+ *
+ * This function sends an Error Report with the (possibly truncated)
+ * erroneous PDU to the cache, closes the connection and schedules a
+ * reconnection. When the report cannot be written at once, the connection
+ * is closed by rpki_error_sent() after it is flushed, or by the retry
+ * timer after %RPKI_ERROR_TIMEOUT seconds. Received data are ignored
+ * meanwhile.
+ */
+static void
+rpki_error(struct rpki_proto *p, uint code, byte *pdu, uint len)
+{
+  const char *text = rpki_err_name(code);
+  uint tlen = strlen(text);
+  byte *pos = p->sk->tbuf + RPKI_HDR_LENGTH;
+
+  log(L_REMOTE "%s: Error: %s", p->p.name, text);
+
+  /* Encapsulated PDU must fit into the TX buffer */
+  len = MIN(len, RPKI_TX_BUFFER_SIZE - RPKI_HDR_LENGTH - 8 - tlen);
+
+  put_u32(pos, len);
+  if (len)
+    memcpy(pos + 4, pdu, len);
+  pos += 4 + len;
+
+  put_u32(pos, tlen);
+  memcpy(pos + 4, text, tlen);
+  pos += 4 + tlen;
+
+  if (rpki_send(p, RPKI_PDU_ERROR_REPORT, code, pos - p->sk->tbuf) == 0)
+  {
+    p->state = RPKI_CS_ERROR;
+    p->sk->tx_hook = rpki_error_sent;
+    rpki_flush_updates(p);
+    tm_stop(p->refresh_timer);
+    tm_start(p->retry_timer, RPKI_ERROR_TIMEOUT);
+    return;
+  }
+
+  rpki_fail(p);
+}
+
+static void
+rpki_connected(sock *sk)
+{
+  struct rpki_proto *p = sk->data;
+
+  TRACE(D_EVENTS, "Connected to %I", p->cf->remote_ip);
+  sk->tx_hook = NULL;
+
+  p->state = RPKI_CS_ESTABLISHED;
+  p->version_fixed = 0;
+  rpki_query(p);
+}
+
+static int rpki_rx(sock *sk, uint size);
+
+static void
+rpki_connect(struct rpki_proto *p)
+{
+  sock *sk = sk_new(p->p.pool);
+  sk->type = SK_TCP_ACTIVE;
+  sk->daddr = p->cf->remote_ip;
+  sk->dport = p->cf->remote_port;
+  sk->vrf = p->p.vrf;
+  sk->rbsize = RPKI_RX_BUFFER_SIZE;
+  sk->tbsize = RPKI_TX_BUFFER_SIZE;
+  sk->tos = IP_PREC_INTERNET_CONTROL;
+  sk->tx_hook = rpki_connected;
+  sk->rx_hook = rpki_rx;
+  sk->err_hook = rpki_sock_err;
+  sk->data = p;
+  p->sk = sk;
+
+  TRACE(D_EVENTS, "Connecting to %I port %u", sk->daddr, sk->dport);
+  p->state = RPKI_CS_CONNECT;
+
+  if (sk_open(sk) < 0)
+  {
+    sk_log_error(sk, p->p.name);
+    rpki_fail(p);
+  }
+}
+
+/* Send Serial Query or Reset Query, depending on available data */
+static void
+rpki_query(struct rpki_proto *p)
+{
+  if (p->have_data)
+  {
+    TRACE(D_PACKETS, "Sending Serial Query (session %u, serial %u)", p->session_id, p->serial);
+    put_u32(p->sk->tbuf + RPKI_HDR_LENGTH, p->serial);
+    rpki_send(p, RPKI_PDU_SERIAL_QUERY, p->session_id, RPKI_HDR_LENGTH + 4);
+    p->reset = 0;
+  }
+  else
+  {
+    TRACE(D_PACKETS, "Sending Reset Query");
+    rpki_send(p, RPKI_PDU_RESET_QUERY, 0, RPKI_HDR_LENGTH);
+    p->reset = 1;
+  }
+
+  p->state = RPKI_CS_SYNC;
+  tm_stop(p->refresh_timer);
+}
+
+static void
+rpki_retry_timer(timer *t)
+{
+  struct rpki_proto *p = t->data;
+
+  if (p->state == RPKI_CS_ERROR)
+  {
+    log(L_WARN "%s: Error Report not sent in time, closing", p->p.name);
+    rpki_fail(p);
+    return;
+  }
+
+  rpki_connect(p);
+}
+
+static void
+rpki_refresh_timer(timer *t)
+{
+  struct rpki_proto *p = t->data;
+
+  if (p->state == RPKI_CS_ESTABLISHED)
+    rpki_query(p);
+}
+
+static void
+rpki_expire_timer(timer *t)
+{
+  struct rpki_proto *p = t->data;
+  struct roa_table *tab = rpki_table(p);
+
+  log(L_WARN "%s: No update for %u seconds, removing ROAs", p->p.name, p->expire_time);
+
+  if (tab)
+    roa_flush(tab, ROA_SRC_RPKI);
+
+  p->have_data = 0;
+  p->roa_count = 0;
+}
+
+
+/*
+ *	Data processing
+ */
+
+/* Apply pending updates to the ROA table, called on End of Data */
+static void
+rpki_apply_updates(struct rpki_proto *p)
+{
+  struct roa_table *tab = rpki_table(p);
+  struct rpki_update *u;
+
+  if (!tab)
+    return;
+
+  if (p->reset)
+  {
+    roa_flush(tab, ROA_SRC_RPKI);
+    p->roa_count = 0;
+  }
+
+  for (u = p->updates; u; u = u->next)
+    if (u->announce)
+    {
+      roa_add_item(tab, u->prefix, u->pxlen, u->maxlen, u->asn, ROA_SRC_RPKI);
+      p->roa_count++;
+    }
+    else if (!p->reset)
+    {
+      roa_delete_item(tab, u->prefix, u->pxlen, u->maxlen, u->asn, ROA_SRC_RPKI);
+      p->roa_count -= !!p->roa_count;
+    }
+}
+
+static int
+rpki_rx_prefix(struct rpki_proto *p, byte *pdu, uint len)
+{
+  uint type = pdu[1];
+  uint alen = (type == RPKI_PDU_IPV4_PREFIX) ? 4 : 16;
+  uint maxpx = 8 * alen;
+
+  if (len != RPKI_HDR_LENGTH + 8 + alen)
+    return RPKI_ERR_CORRUPT_DATA;
+
+  if (!p->in_response)
+    return RPKI_ERR_CORRUPT_DATA;
+
+  uint flags = pdu[8];
+  uint pxlen = pdu[9];
+  uint maxlen = pdu[10];
+  byte *addr = pdu + 12;
+  u32 asn = get_u32(addr + alen);
+
+  if ((pxlen > maxpx) || (maxlen > maxpx) || (pxlen > maxlen))
+    return RPKI_ERR_CORRUPT_DATA;
+
+  /* Prefixes of the other address family are ignored */
+  if (alen != sizeof(ip_addr))
+    return -1;
+
+  struct rpki_update *u = lp_alloc(p->update_pool, sizeof(struct rpki_update));
+  u->next = NULL;
+  u->prefix = ipa_and(get_ipa(addr), ipa_mkmask(pxlen));
+  u->pxlen = pxlen;
+  u->maxlen = maxlen;
+  u->announce = flags & 1;
+  u->asn = asn;
+
+  *p->updates_last = u;
+  p->updates_last = &u->next;
+
+  return -1;
+}
+
+static int
+rpki_rx_end_of_data(struct rpki_proto *p, byte *pdu, uint len)
+{
+  struct rpki_config *cf = p->cf;
+
+  if (len != ((p->version == RPKI_VERSION_0) ? 12 : 24))
+    return RPKI_ERR_CORRUPT_DATA;
+
+  if (!p->in_response || (get_u16(pdu + 2) != p->session_id))
+    return RPKI_ERR_CORRUPT_DATA;
+
+  rpki_apply_updates(p);
+
+  p->serial = get_u32(pdu + 8);
+  p->have_data = 1;
+
+  /* Timing parameters from the cache, with ranges from RFC 8210 6. */
+  if (p->version >= RPKI_VERSION_1)
+  {
+    u32 refresh = get_u32(pdu + 12);
+    u32 retry = get_u32(pdu + 16);
+    u32 expire = get_u32(pdu + 20);
+
+    if (!cf->keep_refresh_time && (refresh >= 1) && (refresh <= 86400))
+      p->refresh_time = refresh;
+
+    if (!cf->keep_retry_time && (retry >= 1) && (retry <= 7200))
+      p->retry_time = retry;
+
+    if (!cf->keep_expire_time && (expire >= 600) && (expire <= 172800))
+      p->expire_time = expire;
+  }
+
+  TRACE(D_EVENTS, "Synchronized (session %u, serial %u, %u ROAs)",
+	p->session_id, p->serial, p->roa_count);
+
+  rpki_flush_updates(p);
+  p->state = RPKI_CS_ESTABLISHED;
+  tm_start(p->refresh_timer, p->refresh_time);
+  tm_start(p->expire_timer, p->expire_time);
+
+  return -1;
+}
+
+static int
+rpki_rx_error_report(struct rpki_proto *p, byte *pdu, uint len)
+{
+  uint code = get_u16(pdu + 2);
+
+  if (len < RPKI_HDR_LENGTH + 8)
+    return RPKI_ERR_CORRUPT_DATA;
+
+  uint plen = get_u32(pdu + 8);
+  if (plen > len - RPKI_HDR_LENGTH - 8)
+    return RPKI_ERR_CORRUPT_DATA;
+
+  uint tlen = get_u32(pdu + 12 + plen);
+  if (tlen > len - RPKI_HDR_LENGTH - 8 - plen)
+    return RPKI_ERR_CORRUPT_DATA;
+
+  char *text = alloca(tlen + 1);
+  memcpy(text, pdu + 16 + plen, tlen);
+  text[tlen] = 0;
+
+  log(L_REMOTE "%s: Error report from cache: %s%s%s", p->p.name,
+      rpki_err_name(code), tlen ? ": " : "", text);
+
+  /* Errors are never answered by errors */
+  rpki_fail(p);
+  return -2;
+}
+
+/* Returns error code, -1 to continue, or -2 if the connection was closed */
+static int
+rpki_rx_pdu(struct rpki_proto *p, byte *pdu, uint len)
+{
+  uint version = pdu[0];
+  uint type = pdu[1];
+
+  /*
+   * The cache answers the first query with its version, which may be lower
+   * than ours. Then both sides must use that version (RFC 8210 7.)
+   */
+  if (!p->version_fixed && (version < p->version))
+  {
+    TRACE(D_EVENTS, "Falling back to protocol version %u", version);
+    p->version = version;
+  }
+
+  if (version != p->version)
+  {
+    if (type == RPKI_PDU_ERROR_REPORT)
+      return rpki_rx_error_report(p, pdu, len);
+
+    return p->version_fixed ? RPKI_ERR_UNEXPECTED_VERSION : RPKI_ERR_UNSUPPORTED_VERSION;
+  }
+
+  p->version_fixed = 1;
+
+  switch (type)
+  {
+  case RPKI_PDU_SERIAL_NOTIFY:
+    if (len != RPKI_HDR_LENGTH + 4)
+      return RPKI_ERR_CORRUPT_DATA;
+
+    TRACE(D_PACKETS, "Serial Notify received (serial %u)", get_u32(pdu + 8));
+
+    if (p->state == RPKI_CS_ESTABLISHED)
+      rpki_query(p);
+    return -1;
+
+  case RPKI_PDU_CACHE_RESPONSE:
+    if ((len != RPKI_HDR_LENGTH) || (p->state != RPKI_CS_SYNC) || p->in_response)
+      return RPKI_ERR_CORRUPT_DATA;
+
+    TRACE(D_PACKETS, "Cache Response received (session %u)", get_u16(pdu + 2));
+
+    /* Session ID is assigned by the cache in a response to Reset Query */
+    if (p->reset)
+      p->session_id = get_u16(pdu + 2);
+    else if (get_u16(pdu + 2) != p->session_id)
+      return RPKI_ERR_CORRUPT_DATA;
+
+    p->in_response = 1;
+    return -1;
+
+  case RPKI_PDU_IPV4_PREFIX:
+  case RPKI_PDU_IPV6_PREFIX:
+    return rpki_rx_prefix(p, pdu, len);
+
+  case RPKI_PDU_END_OF_DATA:
+    TRACE(D_PACKETS, "End of Data received");
+    return rpki_rx_end_of_data(p, pdu, len);
+
+  case RPKI_PDU_CACHE_RESET:
+    if (len != RPKI_HDR_LENGTH)
+      return RPKI_ERR_CORRUPT_DATA;
+
+    TRACE(D_PACKETS, "Cache Reset received");
+
+    /* Existing data are replaced after the next End of Data */
+    rpki_flush_updates(p);
+    p->have_data = 0;
+    rpki_query(p);
+    return -1;
+
+  case RPKI_PDU_ROUTER_KEY:
+    if (p->version == RPKI_VERSION_0)
+      return RPKI_ERR_UNSUPPORTED_PDU_TYPE;
+    return -1;
+
+  case RPKI_PDU_ERROR_REPORT:
+    return rpki_rx_error_report(p, pdu, len);
+
+  default:
+    return RPKI_ERR_UNSUPPORTED_PDU_TYPE;
+  }
+}
+
+static int
+rpki_rx(sock *sk, uint size)
+{
+  struct rpki_proto *p = sk->data;
+  byte *pos = sk->rbuf;
+  byte *end = pos + size;
+  uint len;
+  int res;
+
+  /* Closing after an Error Report */
+  if (p->state == RPKI_CS_ERROR)
+    return 1;
+
+  while (end >= pos + RPKI_HDR_LENGTH)
+  {
+    len = get_u32(pos + 4);
+
+    if ((len < RPKI_HDR_LENGTH) || (len > RPKI_MAX_PDU_LENGTH))
+    {
+      rpki_error(p, RPKI_ERR_CORRUPT_DATA, pos, RPKI_HDR_LENGTH);
+      return 0;
+    }
+
+    if (end < pos + len)
+      break;
+
+    res = rpki_rx_pdu(p, pos, len);
+
+    if (res == -2)
+      return 0;
+
+    if (res >= 0)
+    {
+      rpki_error(p, res, pos, len);
+      return 0;
+    }
+
+    pos += len;
+  }
+
+  if (pos != sk->rbuf)
+  {
+    memmove(sk->rbuf, pos, end - pos);
+    sk->rpos = sk->rbuf + (end - pos);
+  }
+
+  return 0;
+}
+
+
+/*
+ *	Protocol glue
+ */
+
+static struct proto *
+rpki_init(struct proto_config *c)
+{
+  struct proto *P = proto_new(c, sizeof(struct rpki_proto));
+  struct rpki_proto *p = (void *) P;
+
+  p->cf = (void *) c;
+
+  return P;
+}
+
+static int
+rpki_start(struct proto *P)
+{
+  struct rpki_proto *p = (void *) P;
+  struct rpki_config *cf = p->cf;
+
+  p->roa_cf = cf->roa_table;
+  p->retry_timer = tm_new_set(P->pool, rpki_retry_timer, p, 0, 0);
+  p->refresh_timer = tm_new_set(P->pool, rpki_refresh_timer, p, 0, 0);
+  p->expire_timer = tm_new_set(P->pool, rpki_expire_timer, p, 0, 0);
+  p->update_pool = lp_new(P->pool, 4080);
+  p->sk = NULL;
+
+  /* Nothing may survive from a session before the protocol restart */
+  rpki_flush_updates(p);
+  p->state = RPKI_CS_IDLE;
+  p->reset = 0;
+  p->version_fixed = 0;
+  p->version = RPKI_MAX_VERSION;
+  p->have_data = 0;
+  p->roa_count = 0;
+  p->refresh_time = cf->refresh_time;
+  p->retry_time = cf->retry_time;
+  p->expire_time = cf->expire_time;
+
+  rpki_connect(p);
+
+  return PS_UP;
+}
+
+static int
+rpki_shutdown(struct proto *P)
+{
+  struct rpki_proto *p = (void *) P;
+  struct roa_table *tab = rpki_table(p);
+
+  /* Table is NULL if it was removed from the configuration */
+  if (tab)
+    roa_flush(tab, ROA_SRC_RPKI);
+
+  p->sk = NULL;
+  p->state = RPKI_CS_IDLE;
+
+  return PS_DOWN;
+}
+
+static int
+rpki_reconfigure(struct proto *P, struct proto_config *c)
+{
+  struct rpki_proto *p = (void *) P;
+  struct rpki_config *old = p->cf;
+  struct rpki_config *new = (void *) c;
+
+  if (strcmp(old->roa_table->name, new->roa_table->name) ||
+      !ipa_equal(old->remote_ip, new->remote_ip) ||
+      (old->remote_port != new->remote_port))
+    return 0;
+
+  p->cf = new;
+  p->roa_cf = new->roa_table;
+
+  /* Values from the cache are replaced by configured ones, until next update */
+  if ((new->refresh_time != old->refresh_time) || new->keep_refresh_time)
+    p->refresh_time = new->refresh_time;
+
+  if ((new->retry_time != old->retry_time) || new->keep_retry_time)
+    p->retry_time = new->retry_time;
+
+  if ((new->expire_time != old->expire_time) || new->keep_expire_time)
+    p->expire_time = new->expire_time;
+
+  if (tm_active(p->refresh_timer))
+    tm_start(p->refresh_timer, p->refresh_time);
+
+  return 1;
+}
+
+static void
+rpki_copy_config(struct proto_config *dest, struct proto_config *src)
+{
+  /* Just a shallow copy */
+  proto_copy_rest(dest, src, sizeof(struct rpki_config));
+}
+
+static void
+rpki_get_status(struct proto *P, byte *buf)
+{
+  struct rpki_proto *p = (void *) P;
+
+  if (P->proto_state == PS_DOWN)
+    buf[0] = 0;
+  else
+    bsprintf(buf, "%s", rpki_state_names[p->state]);
+}
+
+static void
+rpki_show_proto_info(struct proto *P)
+{
+  struct rpki_proto *p = (void *) P;
+
+  cli_msg(-1006, "  Cache:            %I port %u", p->cf->remote_ip, p->cf->remote_port);
+  cli_msg(-1006, "  ROA table:        %s", p->roa_cf ? p->roa_cf->name : "-");
+  cli_msg(-1006, "  State:            %s", rpki_state_names[p->state]);
+  cli_msg(-1006, "  Protocol version: %u", p->version);
+
+  if (p->have_data)
+  {
+    cli_msg(-1006, "  Session ID:       %u", p->session_id);
+    cli_msg(-1006, "  Serial number:    %u", p->serial);
+  }
+
+  cli_msg(-1006, "  ROAs:             %u", p->roa_count);
+  cli_msg(-1006, "  Refresh interval: %u", p->refresh_time);
+  cli_msg(-1006, "  Retry interval:   %u", p->retry_time);
+  cli_msg(-1006, "  Expire interval:  %u", p->expire_time);
+}
+
+
+struct protocol proto_rpki = {
+  .name =		"RPKI",
+  .template =		"rpki%d",
+  .config_size =	sizeof(struct rpki_config),
+  .init =		rpki_init,
+  .start =		rpki_start,
+  .shutdown =		rpki_shutdown,
+  .reconfigure =	rpki_reconfigure,
+  .copy_config =	rpki_copy_config,
+  .get_status =		rpki_get_status,
+  .show_proto_info =	rpki_show_proto_info
+};
@@ -0,0 +1,112 @@
+/*
+ *	BIRD -- The Resource Public Key Infrastructure (RPKI) to Router Protocol
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_RPKI_H_
+#define _BIRD_RPKI_H_
+
+#include "nest/bird.h"
+#include "nest/cli.h"
+#include "nest/protocol.h"
+#include "nest/route.h"
+#include "lib/resource.h"
+#include "lib/socket.h"
+#include "lib/timer.h"
+
+
+#define RPKI_PORT		323	/* IANA assigned port for rpki-rtr */
+
+#define RPKI_VERSION_0		0	/* RFC 6810 */
+#define RPKI_VERSION_1		1	/* RFC 8210 */
+#define RPKI_MAX_VERSION	RPKI_VERSION_1
+
+#define RPKI_DEFAULT_REFRESH_TIME 3600
+#define RPKI_DEFAULT_RETRY_TIME	600
+#define RPKI_DEFAULT_EXPIRE_TIME 7200
+
+#define RPKI_RX_BUFFER_SIZE	4096
+#define RPKI_TX_BUFFER_SIZE	1024
+#define RPKI_MAX_PDU_LENGTH	RPKI_RX_BUFFER_SIZE
+
+/* PDU types */
+#define RPKI_PDU_SERIAL_NOTIFY	0
+#define RPKI_PDU_SERIAL_QUERY	1
+#define RPKI_PDU_RESET_QUERY	2
+#define RPKI_PDU_CACHE_RESPONSE	3
+#define RPKI_PDU_IPV4_PREFIX	4
+#define RPKI_PDU_IPV6_PREFIX	6
+#define RPKI_PDU_END_OF_DATA	7
+#define RPKI_PDU_CACHE_RESET	8
+#define RPKI_PDU_ROUTER_KEY	9
+#define RPKI_PDU_ERROR_REPORT	10
+
+/* Error codes */
+#define RPKI_ERR_CORRUPT_DATA		0
+#define RPKI_ERR_INTERNAL_ERROR		1
+#define RPKI_ERR_NO_DATA_AVAILABLE	2
+#define RPKI_ERR_INVALID_REQUEST	3
+#define RPKI_ERR_UNSUPPORTED_VERSION	4
+#define RPKI_ERR_UNSUPPORTED_PDU_TYPE	5
+#define RPKI_ERR_UNKNOWN_WITHDRAWAL	6
+#define RPKI_ERR_DUPLICATE_ANNOUNCEMENT	7
+#define RPKI_ERR_UNEXPECTED_VERSION	8
+
+/* Connection states */
+#define RPKI_CS_IDLE		0	/* Waiting for retry timer */
+#define RPKI_CS_CONNECT		1	/* Connecting to the cache */
+#define RPKI_CS_ESTABLISHED	2	/* Connected, waiting for refresh or notify */
+#define RPKI_CS_SYNC		3	/* Connected, query was sent */
+#define RPKI_CS_ERROR		4	/* Error Report is being sent, then closing */
+
+struct rpki_config {
+  struct proto_config c;
+  struct roa_table_config *roa_table;	/* ROA table to be synchronized */
+  ip_addr remote_ip;			/* Address of the cache */
+  u16 remote_port;			/* Port of the cache */
+  u32 refresh_time;			/* Interval between Serial Queries */
+  u32 retry_time;			/* Interval between failed connection attempts */
+  u32 expire_time;			/* Validity of data after last successful update */
+  u8 keep_refresh_time;			/* Do not accept refresh time from the cache */
+  u8 keep_retry_time;			/* Do not accept retry time from the cache */
+  u8 keep_expire_time;			/* Do not accept expire time from the cache */
+};
+
+struct rpki_update {
+  struct rpki_update *next;
+  ip_addr prefix;
+  u8 pxlen;
+  u8 maxlen;
+  u8 announce;				/* Announcement (1) or withdrawal (0) */
+  u32 asn;
+};
+
+struct rpki_proto {
+  struct proto p;
+  struct rpki_config *cf;
+  struct roa_table_config *roa_cf;	/* ROA table config, its table is NULL when removed */
+  sock *sk;				/* TCP connection to the cache */
+  timer *retry_timer;			/* Reconnection after failure */
+  timer *refresh_timer;			/* Periodic Serial Query */
+  timer *expire_timer;			/* Expiration of data without successful update */
+  linpool *update_pool;			/* Linpool for pending updates */
+  struct rpki_update *updates;		/* Updates received in current Cache Response */
+  struct rpki_update **updates_last;
+
+  u8 state;				/* Connection state (RPKI_CS_*) */
+  u8 version;				/* Protocol version in use */
+  u8 version_fixed;			/* Version was confirmed by a PDU from the cache */
+  u8 have_data;				/* Session ID and serial number are valid */
+  u8 reset;				/* Current synchronization is a full reset */
+  u8 in_response;			/* Cache Response received, End of Data expected */
+  u16 session_id;			/* Session ID of the cache */
+  u32 serial;				/* Serial number of the last synchronization */
+  u32 refresh_time;			/* Current intervals, may be changed by the cache */
+  u32 retry_time;
+  u32 expire_time;
+  uint roa_count;			/* Number of received ROAs */
+};
+
+
+#endif
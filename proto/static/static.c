@@ -31,7 +31,10 @@
  * The only other thing worth mentioning is that when asked for reconfiguration,
  * Static not only compares the two configurations, but it also calculates
  * difference between the lists of static routes and it just inserts the
- * newly added routes and removes the obsolete ones.
+ * newly added routes and removes the obsolete ones. Routes of the new
+ * configuration are temporarily indexed by their network in a hash table,
+ * so the old routes are matched to them in linear time even for large
+ * configurations.
  */
 
 #undef LOCAL_DEBUG
@@ -45,6 +48,7 @@
 #include "filter/filter.h"
 #include "lib/string.h"
 #include "lib/alloca.h"
+#include "lib/hash.h"
 
 #include "static.h"
 
@@ -459,12 +463,6 @@ static_init(struct proto_config *c)
   return p;
 }
 
-static inline int
-static_same_net(struct static_route *x, struct static_route *y)
-{
-  return ipa_equal(x->net, y->net) && (x->masklen == y->masklen);
-}
-
 static inline int
 static_same_dest(struct static_route *x, struct static_route *y)
 {
@@ -503,8 +501,31 @@ static_same_rte(struct static_route *x, struct static_route *y)
 }
 
 
+#define SRH_KEY(r)		r->net, r->masklen
+#define SRH_NEXT(r)		r->next_hash
+#define SRH_EQ(n1,l1,n2,l2)	ipa_equal(n1, n2) && l1 == l2
+#define SRH_FN(n,l)		ipa_hash32(n) ^ u32_hash(l)
+
+#define SRH_REHASH		static_srh_rehash
+#define SRH_PARAMS		/8, *2, 2, 2, 8, 24
+
+HASH_DEFINE_REHASH_FN(SRH, struct static_route)
+
+typedef HASH(struct static_route) static_route_hash;
+
 static void
-static_match(struct proto *p, struct static_route *r, struct static_config *n)
+static_hash_routes(struct proto *p, static_route_hash *h, list *l)
+{
+  struct static_route *r;
+
+  /* For duplicate networks, the first route is found, like in list order */
+  WALK_LIST(r, *l)
+    if (!HASH_FIND(*h, SRH, r->net, r->masklen))
+      HASH_INSERT2(*h, SRH, p->pool, r);
+}
+
+static void
+static_match(struct proto *p, struct static_route *r, static_route_hash *h)
 {
   struct static_route *t;
 
@@ -518,18 +539,13 @@ static_match(struct proto *p, struct static_route *r, struct static_config *n)
   if (r->neigh)
     r->neigh->data = NULL;
 
-  WALK_LIST(t, n->iface_routes)
-    if (static_same_net(r, t))
-      goto found;
-
-  WALK_LIST(t, n->other_routes)
-    if (static_same_net(r, t))
-      goto found;
-
-  static_remove(p, r);
-  return;
+  t = HASH_FIND(*h, SRH, r->net, r->masklen);
+  if (!t)
+  {
+    static_remove(p, r);
+    return;
+  }
 
- found:
   /* If destination is different, force reinstall */
   if ((r->installed > 0) && !static_same_rte(r, t))
     t->installed = -1;
@@ -549,15 +565,23 @@ static_reconfigure(struct proto *p, struct proto_config *new)
   struct static_config *o = (void *) p->cf;
   struct static_config *n = (void *) new;
   struct static_route *r;
+  static_route_hash h;
 
   if (cf_igp_table(o) != cf_igp_table(n))
     return 0;
 
+  /* Index new routes by network, interface routes take precedence */
+  HASH_INIT(h, p->pool, 10);
+  static_hash_routes(p, &h, &n->iface_routes);
+  static_hash_routes(p, &h, &n->other_routes);
+
   /* Delete all obsolete routes and reset neighbor entries */
   WALK_LIST(r, o->iface_routes)
-    static_match(p, r, n);
+    static_match(p, r, &h);
   WALK_LIST(r, o->other_routes)
-    static_match(p, r, n);
+    static_match(p, r, &h);
+
+  HASH_FREE(h);
 
   /* Now add all new routes, those not changed will be ignored by static_install() */
   WALK_LIST(r, n->iface_routes)
@@ -0,0 +1,262 @@
+/*
+ *	BIRD Internet Routing Daemon -- Page Allocator
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: Pages
+ *
+ * Slabs and linear memory pools allocate their memory in aligned pages of
+ * %MEM_PAGE_SIZE bytes from the page allocator. The alignment allows slabs to
+ * find a slab head for an object just by masking its address. Freed pages are
+ * kept in a small cache shared by all allocators, so that the usual churn of
+ * slab heads and linpool chunks (e.g. during route updates) does not reach
+ * the system allocator. The page cache is protected by a mutex, as pages are
+ * allocated also from other threads (e.g. BFD).
+ *
+ * Pages are carved from arenas, large blocks of anonymous memory mapped
+ * directly from the kernel. Arenas are aligned to their size, so the kernel
+ * may back them by transparent huge pages, which reduces TLB pressure when
+ * walking large routing tables. Arenas are never unmapped. When too many free
+ * pages accumulate in the cache (e.g. after a large prefix withdrawal), the
+ * excess pages are released to the kernel by madvise() and kept aside as
+ * released pages, which are reused (before fresh arena memory) when needed
+ * again. Therefore, the resident size of BIRD shrinks after a route flap.
+ * Pages are released only when the system page size divides %MEM_PAGE_SIZE,
+ * so that madvise() never covers a part of a system page used by another
+ * page. On systems with larger pages (e.g. 16 kB or 64 kB), excess pages just
+ * stay in the cache.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "nest/bird.h"
+#include "lib/resource.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define KEEP_PAGES_MAX	256		/* Max number of cached free pages */
+#define ARENA_SIZE	(2 << 20)	/* Size of one arena, matches huge page size */
+
+struct free_page {
+  struct free_page *next;
+};
+
+static struct free_page *free_pages;	/* Cached free pages */
+static uint free_page_count;
+
+static void **released_pages;		/* Pages released to the kernel, their content is lost */
+static uint released_page_count, released_page_max;
+
+static byte *arena_pos, *arena_end;	/* Unused part of the current arena */
+static size_t arena_total;		/* Total size of all arenas */
+
+static int page_can_release;		/* Pages may be released by madvise() */
+
+#ifdef USE_PTHREADS
+static pthread_mutex_t page_mutex = PTHREAD_MUTEX_INITIALIZER;
+static inline void page_lock(void) { pthread_mutex_lock(&page_mutex); }
+static inline void page_unlock(void) { pthread_mutex_unlock(&page_mutex); }
+#else
+static inline void page_lock(void) { }
+static inline void page_unlock(void) { }
+#endif
+
+static void
+arena_new(void)
+{
+  byte *ptr, *start;
+
+  /* Map twice the size and trim to get the arena aligned to its size */
+  ptr = mmap(NULL, 2 * ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED)
+    die("Unable to map page arena: %m");
+
+  start = (byte *) BIRD_ALIGN((uintptr_t) ptr, (uintptr_t) ARENA_SIZE);
+  if (start > ptr)
+    munmap(ptr, start - ptr);
+  if (start + ARENA_SIZE < ptr + 2 * ARENA_SIZE)
+    munmap(start + ARENA_SIZE, ptr + ARENA_SIZE - start);
+
+#ifdef MADV_HUGEPAGE
+  madvise(start, ARENA_SIZE, MADV_HUGEPAGE);
+#endif
+
+  arena_pos = start;
+  arena_end = start + ARENA_SIZE;
+  arena_total += ARENA_SIZE;
+}
+
+/**
+ * page_init - initialize the page allocator
+ *
+ * This function is called from resource_init(). It checks whether the system
+ * page size allows releasing of unused pages to the kernel.
+ */
+void
+page_init(void)
+{
+#if defined(MADV_DONTNEED) || defined(MADV_FREE)
+  long sys_page_size = sysconf(_SC_PAGESIZE);
+  page_can_release = (sys_page_size > 0) && !(MEM_PAGE_SIZE % sys_page_size);
+#endif
+}
+
+static int
+page_release(void *ptr)
+{
+  int rv = -1;
+
+#ifdef MADV_DONTNEED
+  rv = madvise(ptr, MEM_PAGE_SIZE, MADV_DONTNEED);
+#elif defined(MADV_FREE)
+  rv = madvise(ptr, MEM_PAGE_SIZE, MADV_FREE);
+#endif
+
+  if (rv < 0)
+  {
+    /* Should not happen, keep the page cached and stop releasing */
+    log(L_WARN "Unable to release memory page: %m");
+    page_can_release = 0;
+    return 0;
+  }
+
+  if (released_page_count == released_page_max)
+  {
+    released_page_max = released_page_max ? 2 * released_page_max : 64;
+    released_pages = xrealloc(released_pages, released_page_max * sizeof(void *));
+  }
+
+  released_pages[released_page_count++] = ptr;
+  return 1;
+}
+
+/**
+ * alloc_page - allocate a page
+ *
+ * This function returns a block of %MEM_PAGE_SIZE bytes, aligned to
+ * %MEM_PAGE_SIZE, either from the page cache, from released pages or
+ * from the current arena.
+ */
+void *
+alloc_page(void)
+{
+  void *ptr;
+
+  page_lock();
+  if (free_pages)
+  {
+    struct free_page *fp = free_pages;
+    free_pages = fp->next;
+    free_page_count--;
+    ptr = fp;
+  }
+  else if (released_page_count)
+    ptr = released_pages[--released_page_count];
+  else
+  {
+    if (arena_pos == arena_end)
+      arena_new();
+
+    ptr = arena_pos;
+    arena_pos += MEM_PAGE_SIZE;
+  }
+  page_unlock();
+
+  return ptr;
+}
+
+/**
+ * free_page - free a page
+ * @ptr: page allocated by alloc_page()
+ *
+ * This function returns the page to the page cache. When the cache grows
+ * too large, its excess pages are released to the kernel.
+ */
+void
+free_page(void *ptr)
+{
+  struct free_page *fp = ptr;
+
+  page_lock();
+  fp->next = free_pages;
+  free_pages = fp;
+  free_page_count++;
+
+  if (page_can_release && (free_page_count > 2 * KEEP_PAGES_MAX))
+    while (free_page_count > KEEP_PAGES_MAX)
+    {
+      fp = free_pages;
+      free_pages = fp->next;
+      free_page_count--;
+
+      if (!page_release(fp))
+      {
+	fp->next = free_pages;
+	free_pages = fp;
+	free_page_count++;
+	break;
+      }
+    }
+  page_unlock();
+}
+
+/**
+ * page_cache_size - get size of the page cache
+ *
+ * This function returns the amount of memory kept in cached free pages,
+ * which is not accounted to any resource.
+ */
+size_t
+page_cache_size(void)
+{
+  size_t size;
+
+  page_lock();
+  size = (size_t) free_page_count * MEM_PAGE_SIZE;
+  page_unlock();
+
+  return size;
+}
+
+/**
+ * page_released_size - get size of released pages
+ *
+ * This function returns the amount of arena memory which has been
+ * released to the kernel and is not resident anymore.
+ */
+size_t
+page_released_size(void)
+{
+  size_t size;
+
+  page_lock();
+  size = (size_t) released_page_count * MEM_PAGE_SIZE;
+  page_unlock();
+
+  return size;
+}
+
+/**
+ * page_arena_size - get size of page arenas
+ *
+ * This function returns the total amount of memory mapped for page
+ * arenas, including parts which have not been used yet.
+ */
+size_t
+page_arena_size(void)
+{
+  size_t size;
+
+  page_lock();
+  size = arena_total;
+  page_unlock();
+
+  return size;
+}
@@ -32,6 +32,8 @@
 #include <netinet/icmp6.h>
 
 #include "nest/bird.h"
+#include "lib/buffer.h"
+#include "lib/heap.h"
 #include "lib/lists.h"
 #include "lib/resource.h"
 #include "lib/timer.h"
@@ -68,6 +70,8 @@ rf_free(resource *r)
 {
   struct rfile *a = (struct rfile *) r;
 
+  /* Messages queued for the file must be written first */
+  log_writer_flush();
   fclose(a->f);
 }
 
@@ -101,6 +105,63 @@ tracked_fopen(pool *p, char *name, char *mode)
   return f;
 }
 
+
+/*
+ *	Wakeup pipes
+ */
+
+void
+pipe_new(int *pfds)
+{
+  int rv = pipe(pfds);
+  if (rv < 0)
+    die("pipe: %m");
+
+  if (fcntl(pfds[0], F_SETFL, O_NONBLOCK) < 0)
+    die("fcntl(O_NONBLOCK): %m");
+
+  if (fcntl(pfds[1], F_SETFL, O_NONBLOCK) < 0)
+    die("fcntl(O_NONBLOCK): %m");
+}
+
+void
+pipe_drain(int fd)
+{
+  char buf[64];
+  int rv;
+
+ try:
+  rv = read(fd, buf, 64);
+  if (rv < 0)
+  {
+    if (errno == EINTR)
+      goto try;
+    if (errno == EAGAIN)
+      return;
+    die("wakeup read: %m");
+  }
+  if (rv == 64)
+    goto try;
+}
+
+void
+pipe_kick(int fd)
+{
+  u64 v = 1;
+  int rv;
+
+ try:
+  rv = write(fd, &v, sizeof(u64));
+  if (rv < 0)
+  {
+    if (errno == EINTR)
+      goto try;
+    if (errno == EAGAIN)
+      return;
+    die("wakeup write: %m");
+  }
+}
+
 /**
  * DOC: Timers
  *
@@ -113,21 +174,25 @@ tracked_fopen(pool *p, char *name, char *mode)
  * which are integral numbers interpreted as a relative number of seconds since
  * some fixed time point in past. The current time can be read
  * from variable @now with reasonable accuracy and is monotonic. There is also
- * a current 'absolute' time in variable @now_real reported by OS.
+ * a current 'absolute' time in variable @now_real reported by OS. Timers
+ * themselves are kept with microsecond precision (&btime), the corresponding
+ * current time is in variable @now_btime.
  *
  * Each timer is described by a &timer structure containing a pointer
  * to the handler function (@hook), data private to this function (@data),
  * time the function should be called at (@expires, 0 for inactive timers),
  * for the other fields see |timer.h|.
+ *
+ * Active timers are kept in a binary heap ordered by their precise expiration
+ * time, so starting and stopping a timer is O(log n) and the nearest timer is
+ * always available in O(1).
  */
 
-#define NEAR_TIMER_LIMIT 4
-
-static list near_timers, far_timers;
-static bird_clock_t first_far_timer = TIME_INFINITY;
+static BUFFER(timer *) timers;
 
 /* now must be different from 0, because 0 is a special value in timer->expires */
 bird_clock_t now = 1, now_real, boot_time;
+btime now_btime = 1 S;
 
 static void
 update_times_plain(void)
@@ -141,6 +206,7 @@ update_times_plain(void)
    log(L_WARN "Time jump, delta %d s", delta);
 
   now_real = new_time;
+  now_btime = ((s64) now) S;
 }
 
 static void
@@ -153,6 +219,8 @@ update_times_gettime(void)
   if (rv != 0)
     die("clock_gettime: %m");
 
+  now_btime = ((s64) ts.tv_sec S) + (ts.tv_nsec / 1000);
+
   if (ts.tv_sec != now) {
     if (ts.tv_sec < now)
       log(L_ERR "Monotonic timer is broken");
@@ -183,6 +251,16 @@ init_times(void)
 }
 
 
+#define TIMER_LESS(a,b)		((a)->expires_btime < (b)->expires_btime)
+#define TIMER_SWAP(heap,a,b,t)	(t = heap[a], heap[a] = heap[b], heap[b] = t, \
+				   heap[a]->index = (a), heap[b]->index = (b))
+
+static inline uint timers_count(void)
+{ return timers.used - 1; }
+
+static inline timer *timers_first(void)
+{ return (timers.used > 1) ? timers.data[1] : NULL; }
+
 static void
 tm_free(resource *r)
 {
@@ -202,7 +280,7 @@ tm_dump(resource *r)
   if (t->recurrent)
     debug("recur %d, ", t->recurrent);
   if (t->expires)
-    debug("expires in %d sec)\n", t->expires - now);
+    debug("expires in %d ms)\n", (int) ((t->expires_btime - now_btime) TO_MS));
   else
     debug("inactive)\n");
 }
@@ -228,17 +306,36 @@ timer *
 tm_new(pool *p)
 {
   timer *t = ralloc(p, &tm_class);
+  t->index = -1;
   return t;
 }
 
-static inline void
-tm_insert_near(timer *t)
+static void
+tm_set(timer *t, btime when)
 {
-  node *n = HEAD(near_timers);
+  uint tc = timers_count();
 
-  while (n->next && (SKIP_BACK(timer, n, n)->expires < t->expires))
-    n = n->next;
-  insert_node(&t->n, n->prev);
+  /* Coarse expiration time is rounded up, so tm_remains() never underestimates */
+  bird_clock_t expires = now + (bird_clock_t) ((when - now_btime + (1 S) - 1) TO_S);
+  t->expires = MAX(expires, now);
+
+  if (!t->expires_btime)
+  {
+    t->index = ++tc;
+    t->expires_btime = when;
+    BUFFER_PUSH(timers) = t;
+    HEAP_INSERT(timers.data, tc, timer *, TIMER_LESS, TIMER_SWAP);
+  }
+  else if (t->expires_btime < when)
+  {
+    t->expires_btime = when;
+    HEAP_INCREASE(timers.data, tc, timer *, TIMER_LESS, TIMER_SWAP, t->index);
+  }
+  else if (t->expires_btime > when)
+  {
+    t->expires_btime = when;
+    HEAP_DECREASE(timers.data, tc, timer *, TIMER_LESS, TIMER_SWAP, t->index);
+  }
 }
 
 /**
@@ -251,8 +348,8 @@ tm_insert_near(timer *t)
  * started, it's @expire time is replaced by the new value.
  *
  * You can have set the @randomize field of @t, the timeout
- * will be increased by a random number of seconds chosen
- * uniformly from range 0 .. @randomize.
+ * will be increased by a random amount of time chosen
+ * uniformly from range 0 .. @randomize seconds.
  *
  * You can call tm_start() from the handler function of the timer
  * to request another run of the timer. Also, you can set the @recurrent
@@ -261,24 +358,25 @@ tm_insert_near(timer *t)
 void
 tm_start(timer *t, unsigned after)
 {
-  bird_clock_t when;
+  tm_start_btime(t, ((btime) after) S);
+}
 
+/**
+ * tm_start_btime - start a timer with sub-second precision
+ * @t: timer
+ * @after: time in microseconds the timer should be run after
+ *
+ * This function is like tm_start(), but the timeout is specified
+ * in &btime units. The @randomize and @recurrent fields of @t are
+ * still interpreted in seconds.
+ */
+void
+tm_start_btime(timer *t, btime after)
+{
   if (t->randomize)
-    after += random() % (t->randomize + 1);
-  when = now + after;
-  if (t->expires == when)
-    return;
-  if (t->expires)
-    rem_node(&t->n);
-  t->expires = when;
-  if (after <= NEAR_TIMER_LIMIT)
-    tm_insert_near(t);
-  else
-    {
-      if (!first_far_timer || first_far_timer > when)
-	first_far_timer = when;
-      add_tail(&far_timers, &t->n);
-    }
+    after += (random() % (t->randomize * 1000 + 1)) MS;
+
+  tm_set(t, now_btime + MAX(after, 0));
 }
 
 /**
@@ -291,48 +389,41 @@ tm_start(timer *t, unsigned after)
 void
 tm_stop(timer *t)
 {
-  if (t->expires)
-    {
-      rem_node(&t->n);
-      t->expires = 0;
-    }
+  if (!t->expires_btime)
+    return;
+
+  uint tc = timers_count();
+
+  HEAP_DELETE(timers.data, tc, timer *, TIMER_LESS, TIMER_SWAP, t->index);
+  BUFFER_POP(timers);
+
+  t->index = -1;
+  t->expires = 0;
+  t->expires_btime = 0;
 }
 
-static void
-tm_dump_them(char *name, list *l)
+void
+tm_dump_all(void)
 {
-  node *n;
   timer *t;
+  uint i;
 
-  debug("%s timers:\n", name);
-  WALK_LIST(n, *l)
+  debug("Timers:\n");
+  for (i = 1; i < timers.used; i++)
     {
-      t = SKIP_BACK(timer, n, n);
+      t = timers.data[i];
       debug("%p ", t);
       tm_dump(&t->r);
     }
   debug("\n");
 }
 
-void
-tm_dump_all(void)
-{
-  tm_dump_them("Near", &near_timers);
-  tm_dump_them("Far", &far_timers);
-}
-
-static inline time_t
+static inline btime
 tm_first_shot(void)
 {
-  time_t x = first_far_timer;
+  timer *t = timers_first();
 
-  if (!EMPTY_LIST(near_timers))
-    {
-      timer *t = SKIP_BACK(timer, n, HEAD(near_timers));
-      if (t->expires < x)
-	x = t->expires;
-    }
-  return x;
+  return t ? t->expires_btime : BTIME_INFINITY;
 }
 
 void io_log_event(void *hook, void *data);
@@ -340,43 +431,29 @@ void io_log_event(void *hook, void *data);
 static void
 tm_shot(void)
 {
+  btime base_time = now_btime;
   timer *t;
-  node *n, *m;
 
-  if (first_far_timer <= now)
-    {
-      bird_clock_t limit = now + NEAR_TIMER_LIMIT;
-      first_far_timer = TIME_INFINITY;
-      n = HEAD(far_timers);
-      while (m = n->next)
-	{
-	  t = SKIP_BACK(timer, n, n);
-	  if (t->expires <= limit)
-	    {
-	      rem_node(n);
-	      tm_insert_near(t);
-	    }
-	  else if (t->expires < first_far_timer)
-	    first_far_timer = t->expires;
-	  n = m;
-	}
-    }
-  while ((n = HEAD(near_timers)) -> next)
+  while (t = timers_first())
     {
-      int delay;
-      t = SKIP_BACK(timer, n, n);
-      if (t->expires > now)
-	break;
-      rem_node(n);
-      delay = t->expires - now;
-      t->expires = 0;
+      if (t->expires_btime > base_time)
+	return;
+
       if (t->recurrent)
 	{
-	  int i = t->recurrent - delay;
-	  if (i < 0)
-	    i = 0;
-	  tm_start(t, i);
+	  btime when = t->expires_btime + (((btime) t->recurrent) S);
+
+	  if (when <= now_btime)
+	    when = now_btime + (((btime) t->recurrent) S);
+
+	  if (t->randomize)
+	    when += (random() % (t->randomize * 1000 + 1)) MS;
+
+	  tm_set(t, when);
 	}
+      else
+	tm_stop(t);
+
       io_log_event(t->hook, t->data);
       t->hook(t);
     }
@@ -1077,6 +1154,8 @@ sk_free(resource *r)
   sock *s = (sock *) r;
 
   sk_free_bufs(s);
+  xfree(s->rx_batch);
+  xfree(s->tx_batch);
   if (s->fd >= 0)
   {
     close(s->fd);
@@ -1642,6 +1721,278 @@ sk_recvmsg(sock *s)
 
 static inline void reset_tx_buffer(sock *s) { s->ttx = s->tpos = s->tbuf; }
 
+
+/*
+ *	Batched datagram I/O
+ */
+
+#define SK_BATCH_MAX	16		/* Max number of datagrams per syscall */
+
+struct sk_rx_batch {
+  uint bsize;				/* Size of one datagram buffer */
+  struct mmsghdr msgs[SK_BATCH_MAX];
+  struct iovec iov[SK_BATCH_MAX];
+  sockaddr src[SK_BATCH_MAX];
+  byte cmsg[SK_BATCH_MAX][CMSG_RX_SPACE];
+  byte buf[];
+};
+
+struct sk_tx_item {
+  ip_addr saddr, daddr;
+  uint dport, len;
+  struct iface *iface;
+};
+
+struct sk_tx_batch {
+  uint bsize;				/* Size of one datagram buffer */
+  uint count;				/* Number of queued datagrams */
+  uint sent;				/* Number of already sent datagrams from the queue */
+  struct sk_tx_item items[SK_BATCH_MAX];
+  byte buf[];
+};
+
+static inline int
+sk_tx_batch_pending(sock *s)
+{
+  return s->tx_batch && (s->tx_batch->sent < s->tx_batch->count);
+}
+
+#ifdef HAVE_RECVMMSG
+
+static struct sk_rx_batch *
+sk_rx_batch_get(sock *s)
+{
+  struct sk_rx_batch *b = s->rx_batch;
+
+  if (b && (b->bsize == s->rbsize))
+    return b;
+
+  xfree(b);
+  b = s->rx_batch = xmalloc(sizeof(struct sk_rx_batch) + SK_BATCH_MAX * s->rbsize);
+  b->bsize = s->rbsize;
+
+  return b;
+}
+
+static int
+sk_read_batch(sock *s)
+{
+  struct sk_rx_batch *b = sk_rx_batch_get(s);
+  int thread = s->flags & SKF_THREAD;
+  byte *rbuf = s->rbuf;
+  int i, n;
+
+  for (i = 0; i < SK_BATCH_MAX; i++)
+  {
+    b->iov[i] = (struct iovec) { b->buf + i * b->bsize, b->bsize };
+    b->msgs[i].msg_hdr = (struct msghdr) {
+      .msg_name = &b->src[i].sa,
+      .msg_namelen = sizeof(sockaddr),
+      .msg_iov = &b->iov[i],
+      .msg_iovlen = 1,
+      .msg_control = b->cmsg[i],
+      .msg_controllen = CMSG_RX_SPACE,
+      .msg_flags = 0
+    };
+  }
+
+  n = recvmmsg(s->fd, b->msgs, SK_BATCH_MAX, 0, NULL);
+  if (n < 0)
+  {
+    if (errno != EINTR && errno != EAGAIN)
+      s->err_hook(s, errno);
+    return 0;
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    struct msghdr *msg = &b->msgs[i].msg_hdr;
+    uint len = b->msgs[i].msg_len;
+
+    sockaddr_read(&b->src[i], s->af, &s->faddr, NULL, &s->fport);
+    sk_process_cmsgs(s, msg);
+
+    if (msg->msg_flags & MSG_TRUNC)
+      s->flags |= SKF_TRUNCATED;
+    else
+      s->flags &= ~SKF_TRUNCATED;
+
+    s->rbuf = b->buf + i * b->bsize;
+    s->rpos = s->rbuf + len;
+    s->rx_hook(s, len);
+
+    /* We need to be careful since the socket could have been deleted by the hook */
+    if (!thread && (current_sock != s))
+      return 1;
+
+    s->rbuf = s->rpos = rbuf;
+
+    if (!s->rx_hook)
+      break;
+  }
+
+  return 1;
+}
+
+#endif
+
+#ifdef HAVE_SENDMMSG
+
+static int
+sk_tx_batch_queue(sock *s)
+{
+  struct sk_tx_batch *b = s->tx_batch;
+  uint len = s->tpos - s->tbuf;
+  int e;
+
+  /* Queue is full or has to be reallocated */
+  if (b && ((b->count == SK_BATCH_MAX) || (b->bsize != s->tbsize)))
+  {
+    e = sk_flush(s);
+    if (e < 0)
+      return e;
+
+    if (e == 0)
+    {
+      /* Keep the datagram in tbuf for later, or drop it like sk_maybe_write() */
+      if (!s->tx_hook)
+	reset_tx_buffer(s);
+      return 0;
+    }
+  }
+
+  if (!b || (b->bsize != s->tbsize))
+  {
+    xfree(b);
+    b = s->tx_batch = xmalloc(sizeof(struct sk_tx_batch) + SK_BATCH_MAX * s->tbsize);
+    b->bsize = s->tbsize;
+    b->count = b->sent = 0;
+  }
+
+  b->items[b->count] = (struct sk_tx_item) {
+    .saddr = s->saddr,
+    .daddr = s->daddr,
+    .dport = s->dport,
+    .iface = s->iface,
+    .len = len
+  };
+  memcpy(b->buf + b->count * b->bsize, s->tbuf, len);
+  b->count++;
+
+  reset_tx_buffer(s);
+  return 1;
+}
+
+static int
+sk_tx_batch_send(sock *s)
+{
+  struct sk_tx_batch *b = s->tx_batch;
+  struct mmsghdr msgs[SK_BATCH_MAX];
+  struct iovec iov[SK_BATCH_MAX];
+  sockaddr dst[SK_BATCH_MAX];
+  byte cmsg_buf[SK_BATCH_MAX][CMSG_TX_SPACE];
+  uint i, num = b->count - b->sent;
+  int n;
+
+  /* Per-datagram values are temporarily set to the socket for sk_prepare_cmsgs() */
+  ip_addr saddr = s->saddr, daddr = s->daddr;
+  uint dport = s->dport;
+  struct iface *iface = s->iface;
+
+  for (i = 0; i < num; i++)
+  {
+    struct sk_tx_item *it = &b->items[b->sent + i];
+
+    iov[i] = (struct iovec) { b->buf + (b->sent + i) * b->bsize, it->len };
+    sockaddr_fill(&dst[i], s->af, it->daddr, it->iface, it->dport);
+
+    msgs[i].msg_len = 0;
+    msgs[i].msg_hdr = (struct msghdr) {
+      .msg_name = &dst[i].sa,
+      .msg_namelen = SA_LEN(dst[i]),
+      .msg_iov = &iov[i],
+      .msg_iovlen = 1
+    };
+
+    if (s->flags & SKF_PKTINFO)
+    {
+      s->saddr = it->saddr;
+      s->iface = it->iface;
+      sk_prepare_cmsgs(s, &msgs[i].msg_hdr, cmsg_buf[i], CMSG_TX_SPACE);
+    }
+  }
+
+  s->saddr = saddr;
+  s->daddr = daddr;
+  s->dport = dport;
+  s->iface = iface;
+
+  n = sendmmsg(s->fd, msgs, num, 0);
+
+  if (n > 0)
+    b->sent += n;
+
+  return n;
+}
+
+/**
+ * sk_flush - send queued datagrams
+ * @s: socket
+ *
+ * For sockets with %SKF_BATCH_TX flag, this function sends all datagrams
+ * queued by sk_send() or sk_send_to() using as few syscalls as possible.
+ * Return values are the same as for sk_send(). For other sockets, the
+ * function does nothing and returns 1.
+ */
+int
+sk_flush(sock *s)
+{
+  struct sk_tx_batch *b = s->tx_batch;
+  int e;
+
+  while (sk_tx_batch_pending(s))
+  {
+    e = sk_tx_batch_send(s);
+
+    if (e < 0)
+    {
+      if (errno == EINTR)
+	continue;
+
+      if (errno != EAGAIN)
+      {
+	/* Drop the failed datagram, the rest is sent later */
+	b->sent++;
+	s->err_hook(s, errno);
+	return -1;
+      }
+
+      /* Without tx_hook, datagrams are dropped like in sk_maybe_write() */
+      if (!s->tx_hook)
+	b->sent = b->count;
+
+      if (!sk_tx_batch_pending(s))
+	b->count = b->sent = 0;
+      return 0;
+    }
+  }
+
+  if (b)
+    b->count = b->sent = 0;
+  return 1;
+}
+
+#else
+
+int
+sk_flush(sock *s UNUSED)
+{
+  return 1;
+}
+
+#endif
+
+
 static int
 sk_maybe_write(sock *s)
 {
@@ -1678,6 +2029,11 @@ sk_maybe_write(sock *s)
       if (s->tbuf == s->tpos)
 	return 1;
 
+#ifdef HAVE_SENDMMSG
+      if ((s->flags & SKF_BATCH_TX) && !(s->flags & SKF_HDRINCL))
+	return sk_tx_batch_queue(s);
+#endif
+
       e = sk_sendmsg(s);
 
       if (e < 0)
@@ -1824,6 +2180,11 @@ sk_read(sock *s, int revents)
 
   default:
     {
+#ifdef HAVE_RECVMMSG
+      if (s->flags & SKF_BATCH_RX)
+	return sk_read_batch(s);
+#endif
+
       int e = sk_recvmsg(s);
 
       if (e < 0)
@@ -1858,6 +2219,9 @@ sk_write(sock *s)
     }
 
   default:
+    if (sk_tx_batch_pending(s) && (sk_flush(s) <= 0))
+      return 0;
+
     if (s->ttx != s->tpos && sk_maybe_write(s) > 0)
     {
       if (s->tx_hook)
@@ -2066,8 +2430,8 @@ volatile int async_shutdown_flag;
 void
 io_init(void)
 {
-  init_list(&near_timers);
-  init_list(&far_timers);
+  BUFFER_INIT(timers, &root_pool, 4);
+  BUFFER_PUSH(timers) = NULL;
   init_list(&sock_list);
   init_list(&global_event_list);
   krt_io_init();
@@ -2077,6 +2441,26 @@ io_init(void)
   srandom((int) now_real);
 }
 
+static void
+sk_flush_all(void)
+{
+  sock *s;
+
+  if (EMPTY_LIST(sock_list))
+    return;
+
+  current_sock = SKIP_BACK(sock, n, HEAD(sock_list));
+  while (s = current_sock)
+  {
+    if (sk_tx_batch_pending(s))
+      sk_flush(s);
+
+    /* The socket could have been deleted by the error hook */
+    if (s == current_sock)
+      current_sock = sk_next(s);
+  }
+}
+
 static int short_loops = 0;
 #define SHORT_LOOP_MAX 10
 
@@ -2084,7 +2468,7 @@ void
 io_loop(void)
 {
   int poll_tout;
-  time_t tout;
+  btime tout;
   int nfds, events, pout;
   sock *s;
   node *n;
@@ -2098,15 +2482,19 @@ io_loop(void)
     timers:
       update_times();
       tout = tm_first_shot();
-      if (tout <= now)
+      if (tout <= now_btime)
 	{
 	  tm_shot();
 	  goto timers;
 	}
-      poll_tout = (events ? 0 : MIN(tout - now, 3)) * 1000; /* Time in milliseconds */
+      /* Time in milliseconds, rounded up to not wake up before the timer expires,
+	 clamped before the subtraction, so BTIME_INFINITY cannot overflow */
+      poll_tout = events ? 0 : (MIN(tout, now_btime + 3 S) - now_btime + (1 MS) - 1) TO_MS;
 
       io_close_event();
 
+      sk_flush_all();
+
       nfds = 0;
       WALK_LIST(n, sock_list)
 	{
@@ -2117,7 +2505,7 @@ io_loop(void)
 	      pfd[nfds].fd = s->fd;
 	      pfd[nfds].events |= POLLIN;
 	    }
-	  if (s->tx_hook && s->ttx != s->tpos)
+	  if ((s->tx_hook && s->ttx != s->tpos) || sk_tx_batch_pending(s))
 	    {
 	      pfd[nfds].fd = s->fd;
 	      pfd[nfds].events |= POLLOUT;
@@ -13,6 +13,17 @@
  * messages to system logs and to the debug output. Message classes
  * used by this module are described in |birdlib.h| and also in the
  * user's manual.
+ *
+ * Messages for log files and MRT dumps may be written by a separate writer
+ * thread, so the main loop does not wait for the disk (see the 'log buffer'
+ * option). Messages are copied to a ring buffer, from which the writer thread
+ * writes them to their files. Producers are serialized by the log mutex, so
+ * the ring has just one producer and one consumer and positions in it are
+ * shared without locking. The writer mutex is used only to sleep when the ring
+ * is empty (the writer) or full (a producer). Whether a message which does
+ * not fit into a full ring is dropped, or the producer waits for free space,
+ * is also configurable. Pending messages are written before a file is closed
+ * and before BIRD exits.
  */
 
 #include <stdio.h>
@@ -21,6 +32,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 #include "nest/bird.h"
 #include "nest/cli.h"
@@ -87,6 +99,425 @@ static char *class_names[] = {
 };
 
 
+/*
+ *	Asynchronous writer
+ */
+
+#define LWM_WRITE	0		/* Write data to the file */
+#define LWM_CLOSE	1		/* Close the file */
+#define LWM_SKIP	2		/* Padding at the end of the ring */
+
+#ifdef USE_PTHREADS
+
+#define LW_ALIGN	16
+#define LW_MAX_IOV	64
+
+struct lw_msg {
+  u32 size;				/* Size of the entry, including padding */
+  u32 op;				/* LWM_* */
+  s32 fd;
+  u32 len;				/* Length of data following the header */
+};
+
+struct log_writer {
+  byte *buf;
+  u32 size;				/* Size of the ring, power of two */
+  u64 head;				/* Read position, advanced by the writer thread */
+  u64 tail;				/* Write position, advanced by producers */
+  int sleeping;				/* The writer waits for data */
+  int waiting;				/* A producer waits for free space */
+  int stop;				/* The writer should exit when the ring is empty */
+  int drop;				/* Drop messages when the ring is full */
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t data_cond;
+  pthread_cond_t space_cond;
+};
+
+static struct log_writer *log_writer;	/* NULL if disabled, protected by log_lock() */
+
+static struct {
+  uint messages;			/* Queued messages */
+  uint dropped;				/* Messages dropped as the ring was full */
+  uint dropped_bytes;
+  uint waits;				/* Producer waited for free space */
+  uint errors;				/* Failed writes */
+  uint peak;				/* Maximal amount of queued data */
+} lw_stats;
+
+static inline struct lw_msg *
+lw_msg_at(struct log_writer *w, u64 pos)
+{
+  return (struct lw_msg *) (w->buf + (pos & (w->size - 1)));
+}
+
+static void
+lw_sleep(struct log_writer *w)
+{
+  pthread_mutex_lock(&w->mutex);
+  __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+
+  while ((w->head == __atomic_load_n(&w->tail, __ATOMIC_SEQ_CST)) && !w->stop)
+    pthread_cond_wait(&w->data_cond, &w->mutex);
+
+  __atomic_store_n(&w->sleeping, 0, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&w->mutex);
+}
+
+static void
+lw_writev(int fd, struct iovec *iov, uint cnt)
+{
+  while (cnt)
+  {
+    ssize_t n = writev(fd, iov, cnt);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+	continue;
+
+      __atomic_fetch_add(&lw_stats.errors, 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+    /* Skip what was written */
+    while (cnt && ((size_t) n >= iov->iov_len))
+    {
+      n -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+
+    if (cnt)
+    {
+      iov->iov_base = (byte *) iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+}
+
+static void *
+lw_main(void *arg)
+{
+  struct log_writer *w = arg;
+  struct iovec iov[LW_MAX_IOV];
+  struct lw_msg *m;
+  u64 head, tail;
+  uint cnt;
+  int fd;
+
+  for (;;)
+  {
+    head = w->head;
+    tail = __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+    {
+      if (w->stop)
+	return NULL;
+
+      lw_sleep(w);
+      continue;
+    }
+
+    m = lw_msg_at(w, head);
+    switch (m->op)
+    {
+    case LWM_WRITE:
+      /* Consecutive writes to the same file are gathered */
+      fd = m->fd;
+      cnt = 0;
+      for (;;)
+      {
+	iov[cnt].iov_base = m + 1;
+	iov[cnt].iov_len = m->len;
+	cnt++;
+	head += m->size;
+
+	if ((head == tail) || (cnt == LW_MAX_IOV))
+	  break;
+
+	m = lw_msg_at(w, head);
+	if ((m->op != LWM_WRITE) || (m->fd != fd))
+	  break;
+      }
+
+      lw_writev(fd, iov, cnt);
+      break;
+
+    case LWM_CLOSE:
+      if (close(m->fd) < 0)
+	__atomic_fetch_add(&lw_stats.errors, 1, __ATOMIC_RELAXED);
+      head += m->size;
+      break;
+
+    default:
+      head += m->size;
+    }
+
+    __atomic_store_n(&w->head, head, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&w->waiting, __ATOMIC_SEQ_CST))
+    {
+      pthread_mutex_lock(&w->mutex);
+      pthread_cond_broadcast(&w->space_cond);
+      pthread_mutex_unlock(&w->mutex);
+    }
+  }
+}
+
+/* Wait until the writer thread reaches position @pos, called under log_lock() */
+static void
+lw_wait(struct log_writer *w, u64 pos)
+{
+  if (__atomic_load_n(&w->head, __ATOMIC_ACQUIRE) >= pos)
+    return;
+
+  pthread_mutex_lock(&w->mutex);
+  __atomic_store_n(&w->waiting, 1, __ATOMIC_SEQ_CST);
+
+  while (__atomic_load_n(&w->head, __ATOMIC_SEQ_CST) < pos)
+    pthread_cond_wait(&w->space_cond, &w->mutex);
+
+  __atomic_store_n(&w->waiting, 0, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&w->mutex);
+}
+
+/* Queue a message, called under log_lock() */
+static int
+lw_put(struct log_writer *w, int fd, uint op, const void *data, uint len, int nodrop)
+{
+  uint need = BIRD_ALIGN(sizeof(struct lw_msg) + len, LW_ALIGN);
+  u64 tail = w->tail;
+  uint pos = tail & (w->size - 1);
+  uint skip = (pos + need > w->size) ? (w->size - pos) : 0;
+  struct lw_msg *m;
+
+  /* Messages longer than the ring are rejected, callers split long data */
+  if (need > w->size / 2)
+    goto drop;
+
+  if (tail + skip + need - __atomic_load_n(&w->head, __ATOMIC_ACQUIRE) > w->size)
+  {
+    if (w->drop && !nodrop)
+      goto drop;
+
+    lw_stats.waits++;
+    lw_wait(w, tail + skip + need - w->size);
+  }
+
+  if (skip)
+  {
+    m = lw_msg_at(w, tail);
+    m->size = skip;
+    m->op = LWM_SKIP;
+    tail += skip;
+  }
+
+  m = lw_msg_at(w, tail);
+  *m = (struct lw_msg) { .size = need, .op = op, .fd = fd, .len = len };
+  if (len)
+    memcpy(m + 1, data, len);
+  tail += need;
+
+  __atomic_store_n(&w->tail, tail, __ATOMIC_SEQ_CST);
+
+  lw_stats.messages++;
+  lw_stats.peak = MAX(lw_stats.peak, (uint) (tail - __atomic_load_n(&w->head, __ATOMIC_RELAXED)));
+
+  if (__atomic_load_n(&w->sleeping, __ATOMIC_SEQ_CST))
+  {
+    pthread_mutex_lock(&w->mutex);
+    pthread_cond_signal(&w->data_cond);
+    pthread_mutex_unlock(&w->mutex);
+  }
+
+  return 1;
+
+drop:
+  lw_stats.dropped++;
+  lw_stats.dropped_bytes += len;
+  return 0;
+}
+
+/*
+ * Queue a message if the writer is enabled, called under log_lock(). Returns
+ * 1 if the message was queued, 0 if it was dropped, -1 if it should be written
+ * directly.
+ */
+static inline int
+lw_enqueue(int fd, uint op, const void *data, uint len, int nodrop)
+{
+  return log_writer ? lw_put(log_writer, fd, op, data, len, nodrop) : -1;
+}
+
+/* Maximal length of data queued at once */
+static inline uint
+lw_max_length(void)
+{
+  return log_writer ? log_writer->size / 4 : ~0U;
+}
+
+static inline void
+lw_drain(void)
+{
+  if (log_writer)
+    lw_wait(log_writer, log_writer->tail);
+}
+
+static struct log_writer *
+lw_start(uint size)
+{
+  struct log_writer *w = xmalloc(sizeof(struct log_writer));
+  int rv;
+
+  memset(w, 0, sizeof(struct log_writer));
+  w->size = size;
+  w->buf = xmalloc(size);
+  pthread_mutex_init(&w->mutex, NULL);
+  pthread_cond_init(&w->data_cond, NULL);
+  pthread_cond_init(&w->space_cond, NULL);
+
+  rv = pthread_create(&w->thread, NULL, lw_main, w);
+  if (rv)
+    die("pthread_create(): %M", rv);
+
+  return w;
+}
+
+/* Write pending messages and stop the writer thread, called under log_lock() */
+static void
+lw_stop(struct log_writer *w)
+{
+  pthread_mutex_lock(&w->mutex);
+  w->stop = 1;
+  pthread_cond_signal(&w->data_cond);
+  pthread_mutex_unlock(&w->mutex);
+
+  pthread_join(w->thread, NULL);
+
+  pthread_cond_destroy(&w->data_cond);
+  pthread_cond_destroy(&w->space_cond);
+  pthread_mutex_destroy(&w->mutex);
+  xfree(w->buf);
+  xfree(w);
+}
+
+static void
+log_writer_exit(void)
+{
+  log_writer_flush();
+}
+
+/**
+ * log_writer_setup - configure the asynchronous writer
+ * @size: size of the ring buffer in bytes, 0 to disable the writer
+ * @drop: drop messages when the buffer is full, instead of waiting
+ *
+ * This function starts, stops or resizes the writer thread according to the
+ * configuration. It is called from sysdep_commit(), after the daemon forked.
+ * Messages queued before a change are written first.
+ */
+void
+log_writer_setup(uint size, int drop)
+{
+  static int atexit_done;
+  struct log_writer *w = NULL;
+
+  if (size)
+    size = 1U << (u32_log2(size - 1) + 1);
+
+  /* The thread is created without the lock held, as die() needs it */
+  if (size && (!log_writer || (log_writer->size != size)))
+    w = lw_start(size);
+
+  log_lock();
+  if (log_writer && (!size || w))
+  {
+    lw_stop(log_writer);
+    log_writer = NULL;
+  }
+
+  if (w)
+    log_writer = w;
+
+  if (log_writer)
+    log_writer->drop = drop;
+  log_unlock();
+
+  if (w && !atexit_done)
+  {
+    atexit(log_writer_exit);
+    atexit_done = 1;
+  }
+}
+
+/**
+ * log_writer_flush - write pending messages
+ *
+ * This function waits until all queued messages are written. It is called
+ * before a log or MRT file is closed, so no messages are written to a closed
+ * (or reused) file descriptor.
+ */
+void
+log_writer_flush(void)
+{
+  log_lock();
+  lw_drain();
+  log_unlock();
+}
+
+void
+log_writer_show(void)
+{
+  struct log_writer *w = log_writer;
+
+  if (w)
+    cli_msg(-1027, "Buffer:        %u bytes, %s when full", w->size, w->drop ? "drop" : "wait");
+  else
+    cli_msg(-1027, "Buffer:        disabled");
+
+  cli_msg(-1027, "Queued:        %u bytes, peak %u bytes",
+	  w ? (uint) (w->tail - __atomic_load_n(&w->head, __ATOMIC_RELAXED)) : 0, lw_stats.peak);
+  cli_msg(-1027, "Messages:      %u", lw_stats.messages);
+  cli_msg(-1027, "Dropped:       %u messages, %u bytes", lw_stats.dropped, lw_stats.dropped_bytes);
+  cli_msg(-1027, "Waits:         %u", lw_stats.waits);
+  cli_msg(-1027, "Write errors:  %u", __atomic_load_n(&lw_stats.errors, __ATOMIC_RELAXED));
+  cli_msg(0, "");
+}
+
+#else
+
+static inline int lw_enqueue(int fd UNUSED, uint op UNUSED, const void *data UNUSED, uint len UNUSED, int nodrop UNUSED) { return -1; }
+static inline uint lw_max_length(void) { return ~0U; }
+static inline void lw_drain(void) { }
+void log_writer_setup(uint size UNUSED, int drop UNUSED) { }
+void log_writer_flush(void) { }
+void log_writer_show(void) { cli_msg(0, "Asynchronous writer is not available"); }
+
+#endif
+
+static int
+log_write(int fd, const byte *buf, uint len)
+{
+  while (len)
+  {
+    int n = write(fd, buf, len);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+	continue;
+      return -1;
+    }
+
+    buf += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+
 /**
  * log_commit - commit a log message
  * @class: message class information (%L_DEBUG to %L_BUG, see |lib/birdlib.h|)
@@ -115,23 +546,34 @@ log_commit(int class, buffer *buf)
 	continue;
       if (l->fh)
 	{
+	  char line[TM_DATETIME_BUFFER_SIZE + LOG_BUFFER_SIZE + 16];
+	  int len;
+
 	  if (l->terminal_flag)
-	    fputs("bird: ", l->fh);
+	    len = bsnprintf(line, sizeof(line), "bird: %s\n", buf->start);
 	  else
 	    {
 	      byte tbuf[TM_DATETIME_BUFFER_SIZE];
 	      tm_format_datetime(tbuf, &config->tf_log, now);
-	      fprintf(l->fh, "%s <%s> ", tbuf, class_names[class]);
+	      len = bsnprintf(line, sizeof(line), "%s <%s> %s\n", tbuf, class_names[class], buf->start);
+	    }
+
+	  /* Written by the writer thread if enabled, otherwise directly */
+	  if (lw_enqueue(fileno(l->fh), LWM_WRITE, line, len, 0) < 0)
+	    {
+	      fputs(line, l->fh);
+	      fflush(l->fh);
 	    }
-	  fputs(buf->start, l->fh);
-	  fputc('\n', l->fh);
-	  fflush(l->fh);
 	}
 #ifdef HAVE_SYSLOG_H
       else
 	syslog(syslog_priorities[class], "%s", buf->start);
 #endif
     }
+
+  /* Fatal messages must be written before BIRD exits or aborts */
+  if (class >= L_FATAL[0])
+    lw_drain();
   log_unlock();
 
   /* cli_echo is not thread-safe, so call it just from the main thread */
@@ -337,6 +779,66 @@ mrt_dump_message(struct proto *p, u16 type, u16 subtype, byte *buf, u32 len)
   put_u16(buf+6, subtype);
   put_u32(buf+8, len - MRTDUMP_HDR_LENGTH);
 
-  if (p->cf->global->mrtdump_file != -1)
-    write(p->cf->global->mrtdump_file, buf, len);
+  if (p->cf->global->mrtdump_file == -1)
+    return;
+
+  log_lock();
+  if (lw_enqueue(p->cf->global->mrtdump_file, LWM_WRITE, buf, len, 0) < 0)
+    log_write(p->cf->global->mrtdump_file, buf, len);
+  log_unlock();
+}
+
+/**
+ * mrt_dump_write - write MRT dump data
+ * @fd: file descriptor
+ * @buf: data to be written
+ * @len: length of data
+ *
+ * This function writes a block of MRT records to a file. If the writer thread
+ * is enabled, data are queued for it, never dropped, and write errors are just
+ * counted. Otherwise they are written directly. Returns -1 (with errno set) if
+ * a direct write failed, 0 otherwise.
+ */
+int
+mrt_dump_write(int fd, byte *buf, uint len)
+{
+  int rv = 0;
+
+  log_lock();
+  while (len)
+  {
+    uint n = MIN(len, lw_max_length());
+
+    if (lw_enqueue(fd, LWM_WRITE, buf, n, 1) < 0)
+    {
+      rv = log_write(fd, buf, len);
+      break;
+    }
+
+    buf += n;
+    len -= n;
+  }
+  log_unlock();
+
+  return rv;
+}
+
+/**
+ * mrt_dump_close - close MRT dump file
+ * @fd: file descriptor
+ *
+ * This function closes a file written by mrt_dump_write(), after all data
+ * queued for it are written. Returns -1 if a direct close failed.
+ */
+int
+mrt_dump_close(int fd)
+{
+  int rv = 0;
+
+  log_lock();
+  if (lw_enqueue(fd, LWM_CLOSE, NULL, 0, 1) < 0)
+    rv = close(fd);
+  log_unlock();
+
+  return rv;
 }
@@ -185,25 +185,37 @@ int
 sysdep_commit(struct config *new, struct config *old UNUSED)
 {
   log_switch(debug_flag, &new->logfiles, new->syslog_name);
+  log_writer_setup(new->log_buffer_size, new->log_buffer_drop);
   return 0;
 }
 
 static int
-unix_read_config(struct config **cp, char *name)
+unix_open_config(struct config **cp, char *name)
 {
   struct config *conf = config_alloc(name);
-  int ret;
 
   *cp = conf;
   conf->file_fd = open(name, O_RDONLY);
-  if (conf->file_fd < 0)
-    return 0;
+  return conf->file_fd >= 0;
+}
+
+static int
+unix_parse_config(struct config *conf)
+{
+  int ret;
+
   cf_read_hook = cf_read;
   ret = config_parse(conf);
   close(conf->file_fd);
   return ret;
 }
 
+static int
+unix_read_config(struct config **cp, char *name)
+{
+  return unix_open_config(cp, name) && unix_parse_config(*cp);
+}
+
 static struct config *
 read_config(void)
 {
@@ -220,85 +232,313 @@ read_config(void)
   return conf;
 }
 
+static void
+cmd_reconfig_msg(cli *c, int r)
+{
+  switch (r)
+    {
+    case CONF_DONE:	cli_printf(c,  3, "Reconfigured"); break;
+    case CONF_PROGRESS: cli_printf(c,  4, "Reconfiguration in progress"); break;
+    case CONF_QUEUED:	cli_printf(c,  5, "Reconfiguration already in progress, queueing new config"); break;
+    case CONF_UNQUEUED:	cli_printf(c, 17, "Reconfiguration already in progress, removing queued config"); break;
+    case CONF_CONFIRM:	cli_printf(c, 18, "Reconfiguration confirmed"); break;
+    case CONF_SHUTDOWN:	cli_printf(c,  6, "Reconfiguration ignored, shutting down"); break;
+    case CONF_NOTHING:	cli_printf(c, 19, "Nothing to do"); break;
+    default:		break;
+    }
+}
+
+/* Hack for scheduled undo notification */
+cli *cmd_reconfig_stored_cli;
+
 void
-async_config(void)
+cmd_reconfig_undo_notify(void)
 {
+  if (cmd_reconfig_stored_cli)
+    {
+      cli *c = cmd_reconfig_stored_cli;
+      cli_printf(c, CLI_ASYNC_CODE, "Config timeout expired, starting undo");
+      cli_write_trigger(c);
+    }
+}
+
+
+/*
+ *	Configuration jobs
+ *
+ *	A configuration file requested by CLI or SIGHUP is opened in the main
+ *	thread, but parsed in a separate thread when threads are available,
+ *	so routing goes on while a large configuration is parsed. The requesting
+ *	CLI is suspended until the job is finished, other CLI commands wait for
+ *	the parser (see config_parsing). The new configuration is committed in
+ *	the main thread.
+ */
+
+#define CFJ_CHECK	1		/* Only check the configuration */
+#define CFJ_RECONFIG	2		/* Reconfiguration requested by CLI */
+#define CFJ_SIGHUP	3		/* Reconfiguration requested by SIGHUP */
+
+struct config_job {
   struct config *conf;
+  cli *cli;				/* Requesting CLI, NULL for SIGHUP or when closed */
+  int action;				/* CFJ_* */
+  int type, timeout;			/* Arguments of config_commit() */
+  int result;				/* Result of config_parse() */
+  int done;				/* Parsing finished (protected by mutex) */
+};
 
-  log(L_INFO "Reconfiguration requested by SIGHUP");
-  if (!unix_read_config(&conf, config_name))
+static struct config_job config_job;
+static int async_config_pending;	/* SIGHUP received during running job */
+
+static void
+config_job_done(void)
+{
+  struct config_job *j = &config_job;
+  struct config *conf = j->conf;
+  cli *c = j->cli;
+
+  if (!j->result)
     {
-      if (conf->err_msg)
-	log(L_ERR "%s, line %d: %s", conf->err_file_name, conf->err_lino, conf->err_msg);
+      if (c)
+	cli_printf(c, 8002, "%s, line %d: %s", conf->err_file_name, conf->err_lino, conf->err_msg);
       else
-	log(L_ERR "Unable to open configuration file %s: %m", config_name);
+	log(L_ERR "%s, line %d: %s", conf->err_file_name, conf->err_lino, conf->err_msg);
       config_free(conf);
+      return;
+    }
+
+  if (j->action == CFJ_CHECK)
+    {
+      if (c)
+	cli_printf(c, 20, "Configuration OK");
+      config_free(conf);
+      return;
+    }
+
+  int r = config_commit(conf, j->type, j->timeout);
+
+  if (c && (r >= 0) && (j->timeout > 0))
+    {
+      cmd_reconfig_stored_cli = c;
+      cli_printf(c, -22, "Undo scheduled in %d s", j->timeout);
     }
-  else
-    config_commit(conf, RECONFIG_HARD, 0);
+
+  if (c)
+    cmd_reconfig_msg(c, r);
 }
 
-static struct config *
-cmd_read_config(char *name)
+#ifdef USE_PTHREADS
+
+#include <pthread.h>
+
+static pthread_t config_job_thread;
+static pthread_mutex_t config_job_mutex;
+static pthread_cond_t config_job_cond;
+static event *config_job_event;		/* Starts the thread, outside of CLI parser */
+static sock *config_job_rs;		/* Notifications for the main thread */
+static int config_job_wfd;
+static void (*config_job_call)(void *);	/* Pending sysdep_main_call() */
+static void *config_job_call_data;
+static THREAD_LOCAL int config_job_self;	/* Running in the job thread */
+
+static void *
+config_job_main(void *arg UNUSED)
 {
-  struct config *conf;
+  config_job_self = 1;
+  int result = unix_parse_config(config_job.conf);
 
-  if (!name)
-    name = config_name;
+  pthread_mutex_lock(&config_job_mutex);
+  config_job.result = result;
+  config_job.done = 1;
+  pipe_kick(config_job_wfd);
+  pthread_mutex_unlock(&config_job_mutex);
 
-  cli_msg(-2, "Reading configuration from %s", name);
-  if (!unix_read_config(&conf, name))
+  return NULL;
+}
+
+static void
+config_job_run(void *data UNUSED)
+{
+  int rv = pthread_create(&config_job_thread, NULL, config_job_main, NULL);
+  if (rv)
+    die("pthread_create(): %M", rv);
+}
+
+static int
+config_job_notify(sock *sk, uint size UNUSED)
+{
+  int done;
+  cli *c;
+
+  pipe_drain(sk->fd);
+
+  pthread_mutex_lock(&config_job_mutex);
+  if (config_job_call)
     {
-      if (conf->err_msg)
-	cli_msg(8002, "%s, line %d: %s", conf->err_file_name, conf->err_lino, conf->err_msg);
-      else
-	cli_msg(8002, "%s: %m", name);
-      config_free(conf);
-      conf = NULL;
+      config_job_call(config_job_call_data);
+      config_job_call = NULL;
+      pthread_cond_signal(&config_job_cond);
     }
+  done = config_job.done;
+  pthread_mutex_unlock(&config_job_mutex);
 
-  return conf;
+  if (!done)
+    return 0;
+
+  pthread_join(config_job_thread, NULL);
+  config_parsing = 0;
+
+  c = config_job.cli;
+  config_job_done();
+
+  if (c)
+    {
+      c->cleanup = NULL;
+      cli_resume(c);
+    }
+
+  cli_parser_done();
+
+  if (async_config_pending)
+    {
+      async_config_pending = 0;
+      async_config();
+    }
+
+  return 0;
 }
 
-void
-cmd_check_config(char *name)
+static void
+config_job_err(sock *sk UNUSED, int err)
 {
-  struct config *conf = cmd_read_config(name);
-  if (!conf)
-    return;
+  log(L_ERR "Config notify socket error: %M", err);
+}
 
-  cli_msg(20, "Configuration OK");
-  config_free(conf);
+static void
+config_job_cli_cleanup(cli *c UNUSED)
+{
+  /* The job goes on without its CLI */
+  config_job.cli = NULL;
 }
 
 static void
-cmd_reconfig_msg(int r)
+config_job_init(void)
 {
-  switch (r)
+  int pfds[2];
+  sock *sk;
+
+  pthread_mutex_init(&config_job_mutex, NULL);
+  pthread_cond_init(&config_job_cond, NULL);
+
+  config_job_event = ev_new(&root_pool);
+  config_job_event->hook = config_job_run;
+
+  pipe_new(pfds);
+  sk = sk_new(&root_pool);
+  sk->type = SK_MAGIC;
+  sk->rx_hook = config_job_notify;
+  sk->err_hook = config_job_err;
+  sk->fd = pfds[0];
+  if (sk_open(sk) < 0)
+    die("config: sk_open failed");
+  config_job_rs = sk;
+  config_job_wfd = pfds[1];
+}
+
+#endif
+
+/**
+ * sysdep_main_call - call a function in the main thread
+ * @hook: function to be called
+ * @data: its argument
+ *
+ * Code called by the parser, which may run in background, uses this function
+ * to access data owned by the main thread. It returns after @hook finished.
+ */
+void
+sysdep_main_call(void (*hook)(void *), void *data)
+{
+#ifdef USE_PTHREADS
+  if (config_job_self)
     {
-    case CONF_DONE:	cli_msg( 3, "Reconfigured"); break;
-    case CONF_PROGRESS: cli_msg( 4, "Reconfiguration in progress"); break;
-    case CONF_QUEUED:	cli_msg( 5, "Reconfiguration already in progress, queueing new config"); break;
-    case CONF_UNQUEUED:	cli_msg(17, "Reconfiguration already in progress, removing queued config"); break;
-    case CONF_CONFIRM:	cli_msg(18, "Reconfiguration confirmed"); break;
-    case CONF_SHUTDOWN:	cli_msg( 6, "Reconfiguration ignored, shutting down"); break;
-    case CONF_NOTHING:	cli_msg(19, "Nothing to do"); break;
-    default:		break;
+      pthread_mutex_lock(&config_job_mutex);
+      config_job_call = hook;
+      config_job_call_data = data;
+      pipe_kick(config_job_wfd);
+
+      while (config_job_call)
+	pthread_cond_wait(&config_job_cond, &config_job_mutex);
+      pthread_mutex_unlock(&config_job_mutex);
+      return;
     }
+#endif
+
+  hook(data);
 }
 
-/* Hack for scheduled undo notification */
-cli *cmd_reconfig_stored_cli;
+static void
+config_job_start(char *name, cli *c, int action, int type, int timeout)
+{
+  struct config *conf;
+
+  if (c)
+    cli_printf(c, -2, "Reading configuration from %s", name);
+
+  if (!unix_open_config(&conf, name))
+    {
+      if (c)
+	cli_printf(c, 8002, "%s: %m", name);
+      else
+	log(L_ERR "Unable to open configuration file %s: %m", name);
+      config_free(conf);
+      return;
+    }
+
+  config_job = (struct config_job) {
+    .conf = conf,
+    .cli = c,
+    .action = action,
+    .type = type,
+    .timeout = timeout,
+  };
+
+#ifdef USE_PTHREADS
+  if (!config_job_event)
+    config_job_init();
+
+  /* The thread is started by an event, CLI command is still being parsed */
+  config_parsing = 1;
+  ev_schedule(config_job_event);
+
+  if (c)
+    {
+      cli_suspend(c);
+      c->cleanup = config_job_cli_cleanup;
+    }
+#else
+  config_job.result = unix_parse_config(conf);
+  config_job_done();
+#endif
+}
 
 void
-cmd_reconfig_undo_notify(void)
+async_config(void)
 {
-  if (cmd_reconfig_stored_cli)
+  if (config_parsing)
     {
-      cli *c = cmd_reconfig_stored_cli;
-      cli_printf(c, CLI_ASYNC_CODE, "Config timeout expired, starting undo");
-      cli_write_trigger(c);
+      /* Restarted when the running job is finished */
+      async_config_pending = 1;
+      return;
     }
+
+  log(L_INFO "Reconfiguration requested by SIGHUP");
+  config_job_start(config_name, NULL, CFJ_SIGHUP, RECONFIG_HARD, 0);
+}
+
+void
+cmd_check_config(char *name)
+{
+  config_job_start(name ?: config_name, this_cli, CFJ_CHECK, 0, 0);
 }
 
 void
@@ -307,19 +547,7 @@ cmd_reconfig(char *name, int type, int timeout)
   if (cli_access_restricted())
     return;
 
-  struct config *conf = cmd_read_config(name);
-  if (!conf)
-    return;
-
-  int r = config_commit(conf, type, timeout);
-
-  if ((r >= 0) && (timeout > 0))
-    {
-      cmd_reconfig_stored_cli = this_cli;
-      cli_msg(-22, "Undo scheduled in %d s", timeout);
-    }
-
-  cmd_reconfig_msg(r);
+  config_job_start(name ?: config_name, this_cli, CFJ_RECONFIG, type, timeout);
 }
 
 void
@@ -329,7 +557,7 @@ cmd_reconfig_confirm(void)
     return;
 
   int r = config_confirm();
-  cmd_reconfig_msg(r);
+  cmd_reconfig_msg(this_cli, r);
 }
 
 void
@@ -341,7 +569,7 @@ cmd_reconfig_undo(void)
   cli_msg(-21, "Undo requested");
 
   int r = config_undo();
-  cmd_reconfig_msg(r);
+  cmd_reconfig_msg(this_cli, r);
 }
 
 /*
@@ -365,8 +593,14 @@ cli_write(cli *c)
       s->tbuf = o->outpos;
       o->outpos = o->wpos;
 
-      if (sk_send(s, len) <= 0)
-	return;
+      int res = sk_send(s, len);
+      if (res <= 0)
+	{
+	  /* On error (res < 0), the CLI is already freed */
+	  if (!res)
+	    c->tx_blocked = 1;
+	  return;
+	}
 
       c->tx_pos = o->next;
     }
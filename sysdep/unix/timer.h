@@ -21,16 +21,19 @@ typedef struct timer {
   void *data;
   uint randomize;			/* Amount of randomization */
   uint recurrent;			/* Timer recurrence */
-  node n;				/* Internal link */
+  int index;				/* Internal position in timer heap */
   bird_clock_t expires;			/* 0=inactive */
+  btime expires_btime;			/* Precise expiration time, 0=inactive */
 } timer;
 
 timer *tm_new(pool *);
 void tm_start(timer *, uint after);
+void tm_start_btime(timer *, btime after);
 void tm_stop(timer *);
 void tm_dump_all(void);
 
 extern bird_clock_t now; 		/* Relative, monotonic time in seconds */
+extern btime now_btime;			/* Relative, monotonic time in microseconds */
 extern bird_clock_t now_real;		/* Time in seconds since fixed known epoch */
 extern bird_clock_t boot_time;
 
@@ -104,6 +104,9 @@ void io_loop(void);
 void io_log_dump(void);
 int sk_open_unix(struct birdsock *s, char *name);
 void *tracked_fopen(struct pool *, char *name, char *mode);
+void pipe_new(int *pfds);
+void pipe_drain(int fd);
+void pipe_kick(int fd);
 void test_old_bird(char *path);
 
 
@@ -116,6 +119,9 @@ void krt_io_init(void);
 void main_thread_init(void);
 void log_init_debug(char *);		/* Initialize debug dump to given file (NULL=stderr, ""=off) */
 void log_switch(int debug, list *l, char *); /* Use l=NULL for initial switch */
+void log_writer_setup(uint size, int drop);
+void log_writer_flush(void);
+void log_writer_show(void);
 
 struct log_config {
   node n;